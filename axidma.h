@@ -0,0 +1,92 @@
+#ifndef AXIDMA_H
+#define AXIDMA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef BIT
+#define BIT(n)                          (1u << (n))
+#endif
+
+/*********************************************************************/
+/*              AXI DMA (single channel) register map                */
+/*               based on "LogiCORE IP Product Guide"                */
+/*********************************************************************/
+// MM2S CONTROL
+#define AXIDMA_MM2S_DMACR               0x00                    // MM2S_DMACR
+#define AXIDMA_MM2S_DMASR               0x04                    // MM2S_DMASR
+#define AXIDMA_MM2S_CURDESC             0x08                    // must align 0x40 addresses
+#define AXIDMA_MM2S_CURDESC_MSB         0x0C                    // unused with 32bit addresses
+#define AXIDMA_MM2S_TAILDESC            0x10                    // must align 0x40 addresses
+#define AXIDMA_MM2S_TAILDESC_MSB        0x14                    // unused with 32bit addresses
+#define AXIDMA_SG_CTL                   0x2C                    // CACHE CONTROL
+
+// DMACR bits
+#define AXIDMA_CR_RUNSTOP               BIT(0)
+#define AXIDMA_CR_RESET                 BIT(2)
+#define AXIDMA_CR_IOC_IRQEN             BIT(12)
+#define AXIDMA_CR_DLY_IRQEN             BIT(13)
+#define AXIDMA_CR_ERR_IRQEN             BIT(14)
+#define AXIDMA_CR_IRQTHRESH_SHIFT       16
+#define AXIDMA_CR_IRQTHRESH_MASK        (0xFFu << AXIDMA_CR_IRQTHRESH_SHIFT)
+#define AXIDMA_CR_IRQDELAY_SHIFT        24
+#define AXIDMA_CR_IRQDELAY_MASK         (0xFFu << AXIDMA_CR_IRQDELAY_SHIFT)
+
+// DMASR bits, the irq bits are write-one-to-clear
+#define AXIDMA_SR_HALTED                BIT(0)
+#define AXIDMA_SR_IDLE                  BIT(1)
+#define AXIDMA_SR_SGINCLD               BIT(3)
+#define AXIDMA_SR_DMA_INT_ERR           BIT(4)
+#define AXIDMA_SR_DMA_SLV_ERR           BIT(5)
+#define AXIDMA_SR_DMA_DEC_ERR           BIT(6)
+#define AXIDMA_SR_SG_INT_ERR            BIT(8)
+#define AXIDMA_SR_SG_SLV_ERR            BIT(9)
+#define AXIDMA_SR_SG_DEC_ERR            BIT(10)
+#define AXIDMA_SR_IOC_IRQ               BIT(12)
+#define AXIDMA_SR_DLY_IRQ               BIT(13)
+#define AXIDMA_SR_ERR_IRQ               BIT(14)
+#define AXIDMA_SR_ERR_MASK              (AXIDMA_SR_DMA_INT_ERR | AXIDMA_SR_DMA_SLV_ERR | AXIDMA_SR_DMA_DEC_ERR | \
+                                         AXIDMA_SR_SG_INT_ERR | AXIDMA_SR_SG_SLV_ERR | AXIDMA_SR_SG_DEC_ERR)
+#define AXIDMA_SR_IRQ_MASK              (AXIDMA_SR_IOC_IRQ | AXIDMA_SR_DLY_IRQ | AXIDMA_SR_ERR_IRQ)
+
+/*********************************************************************/
+/*     AXI DMA buffer descriptor: same words as the MCDMA one but    */
+/*     control at 0x18 with SOF/EOF at bits 27/26                    */
+/*********************************************************************/
+#define AXIDMA_BD_SIZE                  0x40
+#define AXIDMA_BD_NXTDESC               0x00
+#define AXIDMA_BD_NXTDESC_MSB           0x04
+#define AXIDMA_BD_BUFADDR               0x08
+#define AXIDMA_BD_BUFADDR_MSB           0x0C
+#define AXIDMA_BD_CTRL                  0x18
+#define AXIDMA_BD_STATUS                0x1C
+#define AXIDMA_BD_APP(n)                (0x20 + 4 * (n))
+
+#define AXIDMA_BD_CTRL_SOF              BIT(27)
+#define AXIDMA_BD_CTRL_EOF              BIT(26)
+#define AXIDMA_BD_LEN_MASK              0x03FFFFFF
+#define AXIDMA_BD_NUM_APP               5
+
+struct axidma_bd {
+        uint32_t next;
+        uint32_t next_msb;
+        uint32_t buf;
+        uint32_t buf_msb;
+        uint32_t rsvd[2];
+        uint32_t ctrl;                  //SOF/EOF, buffer length
+        uint32_t status;
+        uint32_t app[AXIDMA_BD_NUM_APP];
+        uint32_t pad[3];
+} __attribute__((aligned(AXIDMA_BD_SIZE)));
+
+_Static_assert(offsetof(struct axidma_bd, next) == AXIDMA_BD_NXTDESC, "axidma_bd.next");
+_Static_assert(offsetof(struct axidma_bd, next_msb) == AXIDMA_BD_NXTDESC_MSB, "axidma_bd.next_msb");
+_Static_assert(offsetof(struct axidma_bd, buf) == AXIDMA_BD_BUFADDR, "axidma_bd.buf");
+_Static_assert(offsetof(struct axidma_bd, buf_msb) == AXIDMA_BD_BUFADDR_MSB, "axidma_bd.buf_msb");
+_Static_assert(offsetof(struct axidma_bd, ctrl) == AXIDMA_BD_CTRL, "axidma_bd.ctrl");
+_Static_assert(offsetof(struct axidma_bd, status) == AXIDMA_BD_STATUS, "axidma_bd.status");
+_Static_assert(offsetof(struct axidma_bd, app[AXIDMA_BD_NUM_APP - 1]) == AXIDMA_BD_APP(AXIDMA_BD_NUM_APP - 1),
+               "axidma_bd.app");
+_Static_assert(sizeof(struct axidma_bd) == AXIDMA_BD_SIZE, "struct axidma_bd is not one BD");
+
+#endif
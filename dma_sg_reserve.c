@@ -12,10 +12,15 @@
 #include <sys/eventfd.h>
 
 #include <time.h>
-     
+
+#include "axidma.h"
+#include "mcdma.h"
+#include "mcdma_engine.h"
+#include "mcdma_pattern.h"
+#include "mcdma_sim.h"
+
 //define mmap locations                    
 #define	AXI_DMA_REGISTER_LOCATION          0xB0000000		//AXI DMA Register Address Map
-#define	DESCRIPTOR_REGISTERS_SIZE          0xFFFF
 
 #define	SG_DMA_DESCRIPTORS_WIDTH           0xFFFF
 #define	MEMBLOCK_WIDTH                     0x3FFFFFF		//size of mem used by s2mm and mm2s
@@ -27,27 +32,64 @@
 #define	HP0_MM2S_DMA_DESCRIPTORS_ADDRESS   (HP0_MM2S_DMA_BASE_MEM_ADDRESS)
 #define	HP0_MM2S_SOURCE_MEM_ADDRESS        (HP0_MM2S_DMA_BASE_MEM_ADDRESS + SG_DMA_DESCRIPTORS_WIDTH + 1)
 
-/*********************************************************************/
-/*                   define all register locations                   */
-/*               based on "LogiCORE IP Product Guide"                */
-/*********************************************************************/
-// MM2S CONTROL
-#define MM2S_CONTROL_REGISTER       0x00    // MM2S_DMACR
-#define MM2S_STATUS_REGISTER        0x04    // MM2S_DMASR
-#define MM2S_CURDESC                0x08    // must align 0x40 addresses
-#define MM2S_CURDESC_MSB            0x0C    // unused with 32bit addresses
-#define MM2S_TAILDESC               0x10    // must align 0x40 addresses
-#define MM2S_TAILDESC_MSB           0x14    // unused with 32bit addresses
-#define SG_CTL                      0x2C    // CACHE CONTROL
+#define	PL_LOOP_MEM_ADDRESS                0x80000000		//datamover destination, APP2:APP1
+#define	WAIT_LOOPS                         100000000
+
+static void print_status(uint32_t mm2s_status)
+{
+	printf("Memory-mapped to stream status (0x%08x@0x%02x):\n", mm2s_status, AXIDMA_MM2S_DMASR);
+	printf("MM2S_STATUS_REGISTER status register values:\n");
+	if (mm2s_status & AXIDMA_SR_HALTED) printf(" halted"); else printf(" running");
+	if (mm2s_status & AXIDMA_SR_IDLE) printf(" idle");
+	if (mm2s_status & AXIDMA_SR_SGINCLD) printf(" SGIncld");
+	if (mm2s_status & AXIDMA_SR_DMA_INT_ERR) printf(" DMAIntErr");
+	if (mm2s_status & AXIDMA_SR_DMA_SLV_ERR) printf(" DMASlvErr");
+	if (mm2s_status & AXIDMA_SR_DMA_DEC_ERR) printf(" DMADecErr");
+	if (mm2s_status & AXIDMA_SR_SG_INT_ERR) printf(" SGIntErr");
+	if (mm2s_status & AXIDMA_SR_SG_SLV_ERR) printf(" SGSlvErr");
+	if (mm2s_status & AXIDMA_SR_SG_DEC_ERR) printf(" SGDecErr");
+	if (mm2s_status & AXIDMA_SR_IOC_IRQ) printf(" IOC_Irq");
+	if (mm2s_status & AXIDMA_SR_DLY_IRQ) printf(" Dly_Irq");
+	if (mm2s_status & AXIDMA_SR_ERR_IRQ) printf(" Err_Irq");
+	printf("\n");
+	printf("\n");
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-s] [-S sim params] [-m] [-D device tree node]\n", prog);
+	printf("  -s  run against the software model instead of /dev/mem (or MCDMA_BACKEND=sim)\n");
+	printf("  -S  model parameters, e.g. lat_ns=2000,err_every=1,err=dec\n");
+	printf("  -m  the model puts an MCDMA at the address instead of an AXI DMA\n");
+	printf("  -D  take the engine type from this node's compatible instead of DMASR\n");
+}
 
 int main(int argc, char **argv)
 {
-    unsigned int* axi_dma_register_mmap;
+	struct mcdma_platform *plat;
+	struct mcdma_dev dma;
+	struct mcdma_engine eng;
+	struct mcdma_chan ch;
+	struct mcdma_cpl cpl;
 	unsigned int* mm2s_descriptor_register_mmap;
 	unsigned int* source_mem_map;
-	int controlregister_ok = 0,mm2s_status;
-	uint32_t mm2s_current_descriptor_address;
-	uint32_t mm2s_tail_descriptor_address;
+	unsigned int* dest_mem_map;
+	uint32_t mm2s_status = 0;
+	uint32_t app[MCDMA_BD_NUM_APP];
+	const char *sim_spec = NULL, *dt_node = NULL;
+	enum mcdma_sim_engine sim_type = MCDMA_SIM_AXIDMA;
+	int simulate = mcdma_sim_selected(), opt, fail = 0;
+	long loops;
+
+	while ((opt = getopt(argc, argv, "sS:mD:h")) != -1) {
+		switch (opt) {
+		case 's': simulate = 1; break;
+		case 'S': simulate = 1; sim_spec = optarg; break;
+		case 'm': sim_type = MCDMA_SIM_MCDMA; break;
+		case 'D': dt_node = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
 
 	/*********************************************************************/
 	/*               mmap the AXI DMA Register Address Map               */
@@ -56,29 +98,59 @@ int main(int argc, char **argv)
 	/*            address editor tab ("open block diagramm")             */
 	/*********************************************************************/
 
-	int dh = open("/dev/mem", O_RDWR | O_SYNC); 
-	axi_dma_register_mmap = mmap(NULL, DESCRIPTOR_REGISTERS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, dh, AXI_DMA_REGISTER_LOCATION);
+	if (simulate) {
+		struct mcdma_sim_params params;
+
+		if (sim_spec && mcdma_sim_parse_params(sim_spec, &params)) {
+			usage(argv[0]);
+			return 1;
+		}
+		plat = mcdma_sim_open();
+		if (plat) {
+			if (sim_spec)
+				mcdma_sim_set_params(plat, 0, &params);
+			mcdma_sim_add_engine(plat, AXI_DMA_REGISTER_LOCATION, sim_type);
+		}
+	} else {
+		plat = mcdma_devmem_open();
+	}
+	if (!plat) {
+		perror("platform");
+		return 1;
+	}
+	if (mcdma_dev_open(&dma, plat, AXI_DMA_REGISTER_LOCATION)) {
+		printf("AXI_DMA_REGISTER_LOCATION failed \n");
+		return 1;
+	}
 	printf("AXI_DMA_REGISTER_LOCATION ok \n");
+	if (mcdma_engine_open(&eng, &dma, dt_node)) {
+		printf("unknown engine at AXI_DMA_REGISTER_LOCATION \n");
+		return 1;
+	}
+	printf("engine: %s \n", eng.t->name);
 
-	mm2s_descriptor_register_mmap = mmap(NULL, DESCRIPTOR_REGISTERS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, dh, HP0_MM2S_DMA_DESCRIPTORS_ADDRESS);
+	mm2s_descriptor_register_mmap = plat->map(plat, HP0_MM2S_DMA_DESCRIPTORS_ADDRESS, SG_DMA_DESCRIPTORS_WIDTH + 1);
 	printf("HP0_MM2S_DMA_DESCRIPTORS_ADDRESS ok \n");
 	
-	source_mem_map = mmap(NULL, BUFFER_BLOCK_WIDTH * NUM_OF_DESCRIPTORS, PROT_READ | PROT_WRITE, MAP_SHARED, dh, (off_t)(HP0_MM2S_SOURCE_MEM_ADDRESS));
+	source_mem_map = plat->map(plat, HP0_MM2S_SOURCE_MEM_ADDRESS, BUFFER_BLOCK_WIDTH * NUM_OF_DESCRIPTORS);
 	printf("HP0_MM2S_SOURCE_MEM_ADDRESS ok \n");
 
+	dest_mem_map = plat->map(plat, PL_LOOP_MEM_ADDRESS, BUFFER_BLOCK_WIDTH * NUM_OF_DESCRIPTORS);
+	if (!mm2s_descriptor_register_mmap || !source_mem_map || !dest_mem_map) {
+		printf("mmap failed \n");
+		return 1;
+	}
+
 	int i;
 	
-	// fill mm2s-register memory with zeros
-	for (i = 0; i < DESCRIPTOR_REGISTERS_SIZE; i++) {
-		char *p = (char *)mm2s_descriptor_register_mmap;
-		p[i] = 0x00000000;
-	}
+	// fill mm2s-register memory with zeros, vector stores instead of one byte at a time
+	mcdma_mem_zero(mm2s_descriptor_register_mmap, SG_DMA_DESCRIPTORS_WIDTH + 1);
 	printf("fill mm2s-register memory with zeros ok!\n");
 
-	// fill source memory with a counter value
+	// fill source memory with a counter value, clear the destination
 	for (i = 0; i < (BUFFER_BLOCK_WIDTH / 4) * NUM_OF_DESCRIPTORS; i++) {
-		unsigned int *p = source_mem_map;
-		p[i] = 0x00000000 + i; 
+		source_mem_map[i] = 0x00000000 + i; 
+		dest_mem_map[i] = 0xFFFFFFFF;
 	}
 	printf("fill source memory with a counter value ok!\n");
 
@@ -86,72 +158,75 @@ int main(int argc, char **argv)
 	/*                 reset and halt all dma operations                 */
 	/*********************************************************************/
 
-	axi_dma_register_mmap[MM2S_CONTROL_REGISTER >> 2] =  0x4;
-	axi_dma_register_mmap[MM2S_CONTROL_REGISTER >> 2] =  0x0;
+	if (mcdma_engine_reset(&eng)) {
+		printf("reset failed \n");
+		return 1;
+	}
 
 	/*********************************************************************/
-	/*           build mm2s and s2mm stream and control stream           */
-	/* chains will be filled with next desc, buffer width and registers  */
-	/*                         [0]: next descr                           */
-	/*                         [1]: reserved                             */
-	/*                         [2]: buffer addr                          */
+	/*      one BD per descriptor plus the one a ring keeps free,        */
+	/*      chained in the descriptor block; the engine layer puts       */
+	/*      SOF/EOF and the length where this IP expects them            */
 	/*********************************************************************/
 
-	mm2s_current_descriptor_address = HP0_MM2S_DMA_DESCRIPTORS_ADDRESS;                     // save current descriptor address
-
-	mm2s_descriptor_register_mmap[0x0 >> 2] = HP0_MM2S_DMA_DESCRIPTORS_ADDRESS + 0x40;      // set next descriptor address
-	mm2s_descriptor_register_mmap[0x8 >> 2] = HP0_MM2S_SOURCE_MEM_ADDRESS + 0x0;            // set target buffer address
-	mm2s_descriptor_register_mmap[0x18 >> 2] = 0xC000010;                                   // set mm2s/s2mm buffer length to control register,16Byte
-
-    mm2s_descriptor_register_mmap[0x20 >> 2] = 0x40800010;                                  //EOF=1,Type=1,BTT=0x10, APP0
-    mm2s_descriptor_register_mmap[0x24 >> 2] = 0x80000000;                                  //APP1
-    mm2s_descriptor_register_mmap[0x28 >> 2] = 0x00000000;                                  //写地址为0x80000000,2GB位置, APP2
-    mm2s_descriptor_register_mmap[0x2C >> 2] = 0xFFFFFF00;                                  //高8位, APP3
-    mm2s_descriptor_register_mmap[0x30 >> 2] = 0x11111111;                                  //APP4,没有用上
-
-	mm2s_tail_descriptor_address = HP0_MM2S_DMA_DESCRIPTORS_ADDRESS;                        // save tail descriptor address, 只有一个描述符
-
+	if (mcdma_engine_chan_open(&eng, &ch, 1, mm2s_descriptor_register_mmap, HP0_MM2S_DMA_DESCRIPTORS_ADDRESS,
+				   NUM_OF_DESCRIPTORS + 1)) {
+		printf("channel open failed \n");
+		return 1;
+	}
 
 	/*********************************************************************/
-	/*                 set current descriptor addresses                  */
-	/*           and start dma operations (S2MM_DMACR.RS = 1)            */
+	/*     set current descriptor address (the ring head), start the     */
+	/*     channel, then queue the BD and hand it over with TAILDESC     */
 	/*********************************************************************/
 
-	axi_dma_register_mmap[MM2S_CURDESC>>2] =  mm2s_current_descriptor_address;
-	axi_dma_register_mmap[MM2S_CONTROL_REGISTER >> 2] =  0x1;
+	if (mcdma_engine_chan_start(&eng, &ch) || mcdma_engine_run(&eng)) {
+		printf("start failed \n");
+		return 1;
+	}
 
-	/*********************************************************************/
-	/*                          start transfer                           */
-	/*                 (by setting the taildescriptors)                  */
-	/*********************************************************************/
-	axi_dma_register_mmap[MM2S_TAILDESC>>2] =  mm2s_tail_descriptor_address;
+	app[0] = DM_CMD_EOF | DM_CMD_TYPE_INCR | BUFFER_BLOCK_WIDTH;             //EOF=1,Type=1,BTT=0x10, APP0
+	app[1] = PL_LOOP_MEM_ADDRESS;                                            //APP1
+	app[2] = 0x00000000;                                                     //写地址为0x80000000,2GB位置, APP2
+	app[3] = 0xFFFFFF00;                                                     //高8位, APP3
+	app[4] = 0x11111111;                                                     //APP4,没有用上
+	mcdma_engine_queue(&eng, &ch.ring, HP0_MM2S_SOURCE_MEM_ADDRESS, BUFFER_BLOCK_WIDTH,
+			   MCDMA_BD_CTRL_SOF | MCDMA_BD_CTRL_EOF, app, NULL);
+	mcdma_ring_kick(&ch.ring);
 
 	/*********************************************************************/
-	/*                 wait until all transfers finished                 */
+	/*          wait until all transfers finished or the engine          */
+	/*           reports an error, print the status only once            */
 	/*********************************************************************/
 
-	while (!controlregister_ok)
-    {
-		mm2s_status = axi_dma_register_mmap[MM2S_STATUS_REGISTER >> 2];
-		controlregister_ok = (mm2s_status & 0x00001000);
-		printf("Memory-mapped to stream status (0x%08x@0x%02x):\n", mm2s_status, MM2S_STATUS_REGISTER);
-		printf("MM2S_STATUS_REGISTER status register values:\n");
-		if (mm2s_status & 0x00000001) printf(" halted"); else printf(" running");
-		if (mm2s_status & 0x00000002) printf(" idle");
-		if (mm2s_status & 0x00000008) printf(" SGIncld");
-		if (mm2s_status & 0x00000010) printf(" DMAIntErr");
-		if (mm2s_status & 0x00000020) printf(" DMASlvErr");
-		if (mm2s_status & 0x00000040) printf(" DMADecErr");
-		if (mm2s_status & 0x00000100) printf(" SGIntErr");
-		if (mm2s_status & 0x00000200) printf(" SGSlvErr");
-		if (mm2s_status & 0x00000400) printf(" SGDecErr");
-		if (mm2s_status & 0x00001000) printf(" IOC_Irq");
-		if (mm2s_status & 0x00002000) printf(" Dly_Irq");
-		if (mm2s_status & 0x00004000) printf(" Err_Irq");
-		printf("\n");
-		printf("\n");
-    }
-
-	return 0;
-}
+	for (loops = 0; loops < WAIT_LOOPS; loops++) {
+		if (mcdma_chan_reclaim(&ch, &cpl, 1) || mcdma_engine_failed(&eng, &ch))
+			break;
+	}
+	mm2s_status = mcdma_engine_ack(&eng, &ch);
+	if (eng.type == MCDMA_ENGINE_AXIDMA)
+		print_status(mm2s_status);
+	else
+		mcdma_print_status(mm2s_status);
+	if (loops == WAIT_LOOPS || ch.errors || (mm2s_status & eng.t->sr_err)) {
+		printf("transfer failed \n");
+		fail = 1;
+	} else {
+		mcdma_rmb();
+		for (i = 0; i < (BUFFER_BLOCK_WIDTH / 4) * NUM_OF_DESCRIPTORS; i++) {
+			if (dest_mem_map[i] != source_mem_map[i]) {
+				printf("loopback mismatch at word %d: 0x%08x != 0x%08x \n", i, dest_mem_map[i], source_mem_map[i]);
+				fail = 1;
+				break;
+			}
+		}
+		if (!fail)
+			printf("test success!\n");
+	}
 
+	mcdma_engine_chan_stop(&eng, &ch);
+	mcdma_chan_close(&ch);
+	mcdma_dev_close(&dma);
+	plat->close(plat);
+	return fail;
+}
@@ -0,0 +1,627 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+
+#include "mcdma.h"
+
+#define RESET_POLL_LOOPS                1000000
+
+/*********************************************************************/
+/*                 /dev/mem platform (on the board)                  */
+/*********************************************************************/
+struct devmem_platform {
+        struct mcdma_platform plat;
+        int fd;
+        int fd_cached;                  //without O_SYNC, opened on first use
+};
+
+static void *devmem_mmap(int fd, uint64_t phys, size_t size)
+{
+        uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+        uint64_t base = phys & ~(page - 1);
+        uint8_t *p;
+
+        p = mmap(NULL, size + (phys - base), PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)base);
+        if (p == MAP_FAILED)
+                return NULL;
+        return p + (phys - base);
+}
+
+static void *devmem_map(struct mcdma_platform *plat, uint64_t phys, size_t size)
+{
+        return devmem_mmap(((struct devmem_platform *)plat)->fd, phys, size);
+}
+
+// /dev/mem picks the attributes from O_SYNC alone, there is no write-combined variant
+static void *devmem_map_mem(struct mcdma_platform *plat, uint64_t phys, size_t size, enum mcdma_cache cache)
+{
+        struct devmem_platform *dm = (struct devmem_platform *)plat;
+
+        switch (cache) {
+        case MCDMA_CACHE_UNCACHED:
+                return devmem_mmap(dm->fd, phys, size);
+        case MCDMA_CACHE_CACHED:
+                if (dm->fd_cached < 0)
+                        dm->fd_cached = open("/dev/mem", O_RDWR);
+                return dm->fd_cached < 0 ? NULL : devmem_mmap(dm->fd_cached, phys, size);
+        default:
+                errno = EOPNOTSUPP;
+                return NULL;
+        }
+}
+
+static void devmem_unmap(struct mcdma_platform *plat, void *virt, size_t size)
+{
+        uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+        uintptr_t base = (uintptr_t)virt & ~(page - 1);
+
+        (void)plat;
+        munmap((void *)base, size + ((uintptr_t)virt - base));
+}
+
+static void devmem_close(struct mcdma_platform *plat)
+{
+        struct devmem_platform *dm = (struct devmem_platform *)plat;
+
+        close(dm->fd);
+        if (dm->fd_cached >= 0)
+                close(dm->fd_cached);
+        free(dm);
+}
+
+struct mcdma_platform *mcdma_devmem_open(void)
+{
+        struct devmem_platform *dm = calloc(1, sizeof(*dm));
+
+        if (!dm)
+                return NULL;
+        dm->fd = open("/dev/mem", O_RDWR | O_SYNC);
+        if (dm->fd < 0) {
+                free(dm);
+                return NULL;
+        }
+        dm->fd_cached = -1;
+        dm->plat.name = "devmem";
+        dm->plat.map = devmem_map;
+        dm->plat.map_mem = devmem_map_mem;
+        dm->plat.unmap = devmem_unmap;
+        dm->plat.close = devmem_close;
+        return &dm->plat;
+}
+
+static const char *const cache_names[] = {
+        [MCDMA_CACHE_UNCACHED] = "uncached",
+        [MCDMA_CACHE_WC] = "wc",
+        [MCDMA_CACHE_CACHED] = "cached",
+};
+
+int mcdma_cache_parse(const char *s, enum mcdma_cache *cache)
+{
+        unsigned int i;
+
+        for (i = 0; i < sizeof(cache_names) / sizeof(cache_names[0]); i++) {
+                if (!strcmp(s, cache_names[i])) {
+                        *cache = i;
+                        return 0;
+                }
+        }
+        return -EINVAL;
+}
+
+const char *mcdma_cache_name(enum mcdma_cache cache)
+{
+        return cache_names[cache];
+}
+
+/*********************************************************************/
+/*                         engine control                            */
+/*********************************************************************/
+int mcdma_dev_open(struct mcdma_dev *dev, struct mcdma_platform *plat, uint64_t phys)
+{
+        memset(dev, 0, sizeof(*dev));
+        dev->regs = plat->map(plat, phys, MCDMA_REG_SPACE);
+        if (!dev->regs)
+                return -ENOMEM;
+        dev->phys = phys;
+        dev->plat = plat;
+        if (plat->attach)
+                plat->attach(plat, dev);
+        return 0;
+}
+
+void mcdma_dev_close(struct mcdma_dev *dev)
+{
+        if (dev->regs)
+                dev->plat->unmap(dev->plat, (void *)dev->regs, MCDMA_REG_SPACE);
+        dev->regs = NULL;
+}
+
+// reset and halt all dma operations, waits for the self clearing reset bit
+int mcdma_dev_reset(struct mcdma_dev *dev)
+{
+        int i;
+
+        mcdma_write(dev, MM2S_DMACR, MM2S_DMACR_RESET);
+        for (i = 0; i < RESET_POLL_LOOPS; i++) {
+                if (!(mcdma_read(dev, MM2S_DMACR) & MM2S_DMACR_RESET))
+                        break;
+        }
+        if (i == RESET_POLL_LOOPS)
+                return -ETIMEDOUT;
+        mcdma_write(dev, MM2S_DMACR, 0x0);
+        return 0;
+}
+
+// run both directions, a core built without S2MM reads its status as 0 (not halted)
+int mcdma_dev_run(struct mcdma_dev *dev)
+{
+        int i;
+
+        mcdma_write(dev, MM2S_DMACR, mcdma_read(dev, MM2S_DMACR) | MM2S_DMACR_RUNSTOP);
+        mcdma_write(dev, S2MM_DMACR, mcdma_read(dev, S2MM_DMACR) | MM2S_DMACR_RUNSTOP);
+        for (i = 0; i < RESET_POLL_LOOPS; i++) {
+                if (!((mcdma_read(dev, MM2S_DMASR) | mcdma_read(dev, S2MM_DMASR)) & MM2S_DMASR_HALTED))
+                        return 0;
+        }
+        return -ETIMEDOUT;
+}
+
+void mcdma_print_status(uint32_t chsr)
+{
+        printf("MM2S channel status register values (0x%08x):", chsr);
+        if (chsr & MCDMA_CHSR_IDLE) printf(" idle");
+        if (chsr & MCDMA_CHSR_ERR_OTHER_IRQ) printf(" Err_on_other_Irq");
+        if (chsr & MCDMA_CHSR_IOC_IRQ) printf(" IOC_Irq");
+        if (chsr & MCDMA_CHSR_DLY_IRQ) printf(" Dly_Irq");
+        if (chsr & MCDMA_CHSR_ERR_IRQ) printf(" Err_Irq");
+        printf("\n");
+}
+
+/*********************************************************************/
+/*                       circular BD ring                            */
+/*********************************************************************/
+int mcdma_ring_init(struct mcdma_ring *ring, struct mcdma_dev *dev, uint32_t regs,
+                    void *bd_virt, uint64_t bd_phys, unsigned int depth)
+{
+        unsigned int i;
+
+        if (depth < 2 || (bd_phys & (MCDMA_BD_SIZE - 1)))
+                return -EINVAL;
+
+        memset(ring, 0, sizeof(*ring));
+        ring->cookie = calloc(depth, sizeof(*ring->cookie));
+        if (!ring->cookie)
+                return -ENOMEM;
+        ring->dev = dev;
+        ring->regs = regs;
+        ring->bd = bd_virt;
+        ring->bd_phys = bd_phys;
+        ring->depth = depth;
+        ring->tail_msb = ~0u;           //first kick writes it
+        ring->max_len = MCDMA_BD_LEN_MASK;
+        ring->bd_ctrl = MCDMA_BD_CTRL;
+        ring->bd_eof = MCDMA_BD_CTRL_EOF;
+
+        // chain the BDs into a closed loop
+        for (i = 0; i < depth; i++) {
+                static const struct mcdma_bd zero;
+                volatile struct mcdma_bd *bd = &ring->bd[i];
+                uint64_t next = mcdma_ring_bd_phys(ring, (i + 1) % depth);
+
+                mcdma_bd_copy(bd, &zero);
+                bd->next = (uint32_t)next;
+                bd->next_msb = (uint32_t)(next >> 32);
+        }
+        return 0;
+}
+
+void mcdma_ring_free(struct mcdma_ring *ring)
+{
+        free(ring->cookie);
+        ring->cookie = NULL;
+}
+
+/*********************************************************************/
+/*   fill the BD at head, the engine does not see it until           */
+/*   mcdma_ring_kick().  The BD is built in normal memory and        */
+/*   published with MCDMA_BD_STORES wide stores, which also clears   */
+/*   the status word, so reclaim never has to write the ring.        */
+/*********************************************************************/
+int mcdma_ring_queue(struct mcdma_ring *ring, uint64_t buf, uint32_t len, uint32_t flags,
+                     const uint32_t *app, void *cookie)
+{
+        struct mcdma_bd bd = { 0 };
+        int i;
+
+        if (!mcdma_ring_space(ring))
+                return -EBUSY;
+        if (!len || len > MCDMA_BD_LEN_MASK)
+                return -EINVAL;
+
+        bd.buf = (uint32_t)buf;
+        bd.buf_msb = (uint32_t)(buf >> 32);
+        bd.ctrl = (flags & (MCDMA_BD_CTRL_SOF | MCDMA_BD_CTRL_EOF)) | len;
+        for (i = 0; app && i < MCDMA_BD_NUM_APP; i++)
+                bd.app[i] = app[i];
+        mcdma_bd_copy(&ring->bd[ring->head], &bd);
+
+        ring->cookie[ring->head] = cookie;
+        ring->head = (ring->head + 1) % ring->depth;
+        ring->pending++;
+        return 0;
+}
+
+/*********************************************************************/
+/*   hand all queued BDs to the engine with a single TAILDESC write, */
+/*   TAILDESC_MSB only when the ring crosses a 4 GB boundary         */
+/*********************************************************************/
+void mcdma_ring_kick(struct mcdma_ring *ring)
+{
+        uint64_t tail;
+
+        if (!ring->pending)
+                return;
+
+        tail = mcdma_ring_bd_phys(ring, (ring->head + ring->depth - 1) % ring->depth);
+        ring->inflight += ring->pending;
+        ring->pending = 0;
+
+        mcdma_wmb();
+        if ((uint32_t)(tail >> 32) != ring->tail_msb) {
+                ring->tail_msb = (uint32_t)(tail >> 32);
+                mcdma_write(ring->dev, ring->regs + MCDMA_CH_TAILDESC_MSB, ring->tail_msb);
+        }
+        mcdma_write(ring->dev, ring->regs + MCDMA_CH_TAILDESC, (uint32_t)tail);
+}
+
+// collect finished BDs in order by their completion bit, the ring is only read
+int mcdma_ring_reclaim(struct mcdma_ring *ring, struct mcdma_cpl *cpl, int max)
+{
+        int n = 0;
+
+        while (n < max && ring->inflight) {
+                uint32_t status = ring->bd[ring->tail].status;
+
+                if (!(status & MCDMA_BD_STS_CMPLT))
+                        break;
+                mcdma_rmb();
+
+                cpl[n].cookie = ring->cookie[ring->tail];
+                cpl[n].status = status;
+                cpl[n].len = status & MCDMA_BD_LEN_MASK;
+                n++;
+
+                ring->tail = (ring->tail + 1) % ring->depth;
+                ring->inflight--;
+        }
+        return n;
+}
+
+/*********************************************************************/
+/*                    scatter-gather submission                      */
+/*********************************************************************/
+static uint32_t split_len(uint32_t max_len)
+{
+        return max_len & ~(uint32_t)(MCDMA_SPLIT_ALIGN - 1);
+}
+
+unsigned int mcdma_iov_bds(const struct mcdma_iov *iov, unsigned int n, uint32_t max_len)
+{
+        uint32_t max = split_len(max_len);
+        unsigned int i, bds = 0;
+
+        for (i = 0; max && i < n; i++)
+                bds += (iov[i].len + max - 1) / max;
+        return bds;
+}
+
+int mcdma_ring_queue_iov(struct mcdma_ring *ring, const struct mcdma_iov *iov, unsigned int n,
+                         const uint32_t *app, void *cookie)
+{
+        uint32_t max = split_len(ring->max_len);
+        unsigned int need = mcdma_iov_bds(iov, n, ring->max_len), i, k = 0;
+
+        if (!need)
+                return -EINVAL;
+        if (need > ring->depth - 1)
+                return -E2BIG;
+        if (need > mcdma_ring_space(ring))
+                return -EBUSY;
+
+        for (i = 0; i < n; i++) {
+                uint64_t buf = iov[i].phys;
+                size_t left = iov[i].len;
+
+                while (left) {
+                        struct mcdma_bd bd = { 0 };
+                        uint32_t len = left < max ? (uint32_t)left : max;
+                        int a;
+
+                        bd.buf = (uint32_t)buf;
+                        bd.buf_msb = (uint32_t)(buf >> 32);
+                        bd.ctrl = len | (k ? 0 : MCDMA_BD_CTRL_SOF) | (k == need - 1 ? MCDMA_BD_CTRL_EOF : 0);
+                        for (a = 0; !k && app && a < MCDMA_BD_NUM_APP; a++)
+                                bd.app[a] = app[a];
+                        mcdma_bd_copy(&ring->bd[ring->head], &bd);
+
+                        ring->cookie[ring->head] = k == need - 1 ? cookie : NULL;
+                        ring->head = (ring->head + 1) % ring->depth;
+                        buf += len;
+                        left -= len;
+                        k++;
+                }
+        }
+        ring->pending += need;
+        return 0;
+}
+
+/*********************************************************************/
+/*                       chain templates                             */
+/*********************************************************************/
+int mcdma_chain_init(struct mcdma_chain *chain, unsigned int count, unsigned int flags)
+{
+        memset(chain, 0, sizeof(*chain));
+        if (!count)
+                return -EINVAL;
+        chain->bd = aligned_alloc(MCDMA_BD_SIZE, (size_t)count * sizeof(*chain->bd));
+        if (!chain->bd)
+                return -ENOMEM;
+        memset(chain->bd, 0, (size_t)count * sizeof(*chain->bd));
+        chain->count = count;
+        chain->flags = flags;
+        return 0;
+}
+
+void mcdma_chain_free(struct mcdma_chain *chain)
+{
+        free(chain->bd);
+        chain->bd = NULL;
+}
+
+// BD i of the template, off is relative to the source base given at queue time
+int mcdma_chain_set(struct mcdma_chain *chain, unsigned int i, uint64_t off, uint32_t len, uint32_t flags,
+                    const uint32_t *app)
+{
+        struct mcdma_bd *bd;
+        int k;
+
+        if (i >= chain->count || !len || len > MCDMA_BD_LEN_MASK)
+                return -EINVAL;
+        bd = &chain->bd[i];
+        memset(bd, 0, sizeof(*bd));
+        bd->buf = (uint32_t)off;
+        bd->buf_msb = (uint32_t)(off >> 32);
+        bd->ctrl = (flags & (MCDMA_BD_CTRL_SOF | MCDMA_BD_CTRL_EOF)) | len;
+        for (k = 0; app && k < MCDMA_BD_NUM_APP; k++)
+                bd->app[k] = app[k];
+        return 0;
+}
+
+int mcdma_ring_queue_chain(struct mcdma_ring *ring, const struct mcdma_chain *chain, uint64_t src, uint64_t dst,
+                           void *cookie)
+{
+        unsigned int i;
+
+        if (mcdma_ring_space(ring) < chain->count)
+                return -EBUSY;
+
+        for (i = 0; i < chain->count; i++) {
+                struct mcdma_bd bd = chain->bd[i];
+                uint64_t buf = (bd.buf | (uint64_t)bd.buf_msb << 32) + src;
+
+                bd.buf = (uint32_t)buf;
+                bd.buf_msb = (uint32_t)(buf >> 32);
+                if ((chain->flags & MCDMA_CHAIN_APP_ADDR) && (bd.ctrl & MCDMA_BD_CTRL_SOF)) {
+                        uint64_t sink = (bd.app[1] | (uint64_t)bd.app[2] << 32) + dst;
+
+                        bd.app[1] = (uint32_t)sink;
+                        bd.app[2] = (uint32_t)(sink >> 32);
+                }
+                mcdma_bd_copy(&ring->bd[ring->head], &bd);
+
+                ring->cookie[ring->head] = i == chain->count - 1 ? cookie : NULL;
+                ring->head = (ring->head + 1) % ring->depth;
+        }
+        ring->pending += chain->count;
+        return 0;
+}
+
+/*********************************************************************/
+/*                         channel API                               */
+/*********************************************************************/
+int mcdma_chan_open(struct mcdma_chan *ch, struct mcdma_dev *dev, unsigned int id,
+                    void *bd_virt, uint64_t bd_phys, unsigned int depth)
+{
+        if (id < 1 || id > MCDMA_MAX_CHANNELS)
+                return -EINVAL;
+
+        memset(ch, 0, sizeof(*ch));
+        ch->dev = dev;
+        ch->id = id;
+        ch->base = MM2S_CH_BASE(id);
+        ch->retry_bd = -1;
+        return mcdma_ring_init(&ch->ring, dev, ch->base, bd_virt, bd_phys, depth);
+}
+
+int mcdma_chan_open_s2mm(struct mcdma_chan *ch, struct mcdma_dev *dev, unsigned int id,
+                         void *bd_virt, uint64_t bd_phys, unsigned int depth)
+{
+        int ret = mcdma_chan_open(ch, dev, id, bd_virt, bd_phys, depth);
+
+        if (ret)
+                return ret;
+        ch->common = S2MM_OFFSET;
+        ch->base = S2MM_CH_BASE(id);
+        ch->ring.regs = ch->base;
+        return 0;
+}
+
+void mcdma_chan_close(struct mcdma_chan *ch)
+{
+        mcdma_ring_free(&ch->ring);
+}
+
+// enable the channel, point CURDESC at the ring head and start fetching, IOC and Err interrupts, threshold 1
+int mcdma_chan_start(struct mcdma_chan *ch)
+{
+        struct mcdma_dev *dev = ch->dev;
+        uint64_t cur = mcdma_ring_bd_phys(&ch->ring, ch->ring.head);
+        uint32_t chen = ch->common + MM2S_CHEN_OFFSET, cr;
+
+        mcdma_write(dev, chen, mcdma_read(dev, chen) | BIT(ch->id - 1));
+        mcdma_chan_write(ch, MCDMA_CH_CURDESC, (uint32_t)cur);
+        mcdma_chan_write(ch, MCDMA_CH_CURDESC_MSB, (uint32_t)(cur >> 32));
+
+        cr = mcdma_chan_read(ch, MCDMA_CH_CR) & ~MCDMA_CHCR_IRQTHRESH_MASK;
+        cr |= MCDMA_CHCR_FETCH | MCDMA_CHCR_IOC_IRQEN | MCDMA_CHCR_ERR_IRQEN | (1u << MCDMA_CHCR_IRQTHRESH_SHIFT);
+        mcdma_chan_write(ch, MCDMA_CH_CR, cr);
+        return 0;
+}
+
+void mcdma_chan_stop(struct mcdma_chan *ch)
+{
+        struct mcdma_dev *dev = ch->dev;
+        uint32_t chen = ch->common + MM2S_CHEN_OFFSET;
+
+        mcdma_chan_write(ch, MCDMA_CH_CR, mcdma_chan_read(ch, MCDMA_CH_CR) & ~MCDMA_CHCR_FETCH);
+        mcdma_write(dev, chen, mcdma_read(dev, chen) & ~BIT(ch->id - 1));
+}
+
+// a packet is counted on its EOF BD, however many BDs it was split into
+int mcdma_chan_reclaim(struct mcdma_chan *ch, struct mcdma_cpl *cpl, int max)
+{
+        struct mcdma_ring *ring = &ch->ring;
+        unsigned int idx = ring->tail;
+        int n = mcdma_ring_reclaim(ring, cpl, max);
+        int i;
+
+        for (i = 0; i < n; i++) {
+                uint32_t ctrl = *(volatile uint32_t *)((volatile uint8_t *)&ring->bd[idx] + ring->bd_ctrl);
+
+                mcdma_chan_count_err(ch, cpl[i].status);
+                ch->bytes += cpl[i].len;
+                ch->packets += !!(ctrl & ring->bd_eof);
+                // a retried BD that came back frees its slot for the next retry
+                if ((int)idx == ch->retry_bd)
+                        ch->retry_bd = -1;
+                idx = (idx + 1) % ring->depth;
+        }
+        return n;
+}
+
+/*********************************************************************/
+/*   IOC after thresh completed BDs (1..255), Dly_Irq delay ticks    */
+/*   of MCDMA_CHCR_IRQDELAY_UNIT_NS after the last completion when   */
+/*   fewer are pending (0 disables the timer).  Safe while running.  */
+/*********************************************************************/
+int mcdma_chan_set_coalesce(struct mcdma_chan *ch, unsigned int thresh, unsigned int delay)
+{
+        uint32_t cr;
+
+        if (thresh < 1 || thresh > MCDMA_CHCR_IRQ_MAX || delay > MCDMA_CHCR_IRQ_MAX)
+                return -EINVAL;
+
+        cr = mcdma_chan_read(ch, MCDMA_CH_CR) & ~(MCDMA_CHCR_IRQTHRESH_MASK | MCDMA_CHCR_IRQDELAY_MASK |
+                                                   MCDMA_CHCR_DLY_IRQEN);
+        cr |= thresh << MCDMA_CHCR_IRQTHRESH_SHIFT | delay << MCDMA_CHCR_IRQDELAY_SHIFT;
+        if (delay)
+                cr |= MCDMA_CHCR_DLY_IRQEN;
+        mcdma_chan_write(ch, MCDMA_CH_CR, cr);
+        return 0;
+}
+
+/*********************************************************************/
+/*                     per channel error recovery                    */
+/*********************************************************************/
+// what a BD that never ran reports, from the direction's error register
+static uint32_t err_to_sts(uint32_t err)
+{
+        if (err & (MCDMA_ERR_DMA_DEC | MCDMA_ERR_SG_DEC))
+                return MCDMA_BD_STS_DECERR;
+        if (err & (MCDMA_ERR_DMA_SLV | MCDMA_ERR_SG_SLV))
+                return MCDMA_BD_STS_SLVERR;
+        return MCDMA_BD_STS_INTERR;
+}
+
+/*********************************************************************/
+/*   Err_Irq in SR, or an error written back into the oldest BD in   */
+/*   flight for when an interrupt handler already acked SR.  The BD  */
+/*   at CURDESC has to be one the ring still owns.                   */
+/*********************************************************************/
+int mcdma_chan_fault(const struct mcdma_chan *ch, struct mcdma_fault *f)
+{
+        const struct mcdma_ring *ring = &ch->ring;
+        uint64_t cur;
+
+        if (ch->common || !ring->inflight)
+                return 0;
+        f->sr = mcdma_chan_read(ch, MCDMA_CH_SR);
+        if (!(f->sr & MCDMA_CHSR_ERR_IRQ) && !(ring->bd[ring->tail].status & MCDMA_BD_STS_ERR_MASK))
+                return 0;
+
+        cur = mcdma_chan_read(ch, MCDMA_CH_CURDESC) | (uint64_t)mcdma_chan_read(ch, MCDMA_CH_CURDESC_MSB) << 32;
+        if (cur < ring->bd_phys || (cur - ring->bd_phys) & (MCDMA_BD_SIZE - 1) ||
+            (cur - ring->bd_phys) / MCDMA_BD_SIZE >= ring->depth)
+                return -EIO;
+        f->bd = (cur - ring->bd_phys) / MCDMA_BD_SIZE;
+        if ((f->bd + ring->depth - ring->tail) % ring->depth >= ring->inflight)
+                return -EIO;
+        f->status = ring->bd[f->bd].status;
+        f->err = mcdma_read(ch->dev, ch->common + MM2S_ERR);
+        return 1;
+}
+
+/*********************************************************************/
+/*   Fetch off makes CURDESC writable again without touching CHEN,   */
+/*   DMACR or any other channel.  The restart needs a TAILDESC write */
+/*   to fetch again, so the last BD in flight is rewritten as tail.  */
+/*********************************************************************/
+int mcdma_chan_recover(struct mcdma_chan *ch, const struct mcdma_fault *f, unsigned int flags)
+{
+        struct mcdma_ring *ring = &ch->ring;
+        unsigned int i = f->bd, end = (ring->tail + ring->inflight) % ring->depth;
+        uint32_t cr = mcdma_chan_read(ch, MCDMA_CH_CR), sts;
+        int retry = (flags & MCDMA_RECOVER_RETRY) && (ring->bd[i].ctrl & MCDMA_BD_CTRL_SOF) &&
+                    ch->retry_bd != (int)i;
+        uint64_t cur;
+
+        if (ch->common)
+                return -EINVAL;
+        mcdma_chan_write(ch, MCDMA_CH_CR, cr & ~MCDMA_CHCR_FETCH);
+        mcdma_chan_write(ch, MCDMA_CH_SR, f->sr & MCDMA_CHSR_IRQ_MASK);
+
+        if (retry) {
+                ring->bd[i].status = 0;
+                ch->retry_bd = i;
+                ch->retried++;
+        } else {
+                sts = f->status & MCDMA_BD_STS_ERR_MASK ? f->status & MCDMA_BD_STS_ERR_MASK : err_to_sts(f->err);
+                do {
+                        uint32_t ctrl = ring->bd[i].ctrl;
+
+                        ring->bd[i].status = MCDMA_BD_STS_CMPLT | sts;
+                        ch->skipped++;
+                        i = (i + 1) % ring->depth;
+                        if (ctrl & MCDMA_BD_CTRL_EOF)
+                                break;
+                } while (i != end);
+                ch->retry_bd = -1;
+        }
+        mcdma_wmb();
+
+        cur = mcdma_ring_bd_phys(ring, i);
+        mcdma_chan_write(ch, MCDMA_CH_CURDESC, (uint32_t)cur);
+        mcdma_chan_write(ch, MCDMA_CH_CURDESC_MSB, (uint32_t)(cur >> 32));
+        mcdma_chan_write(ch, MCDMA_CH_CR, cr | MCDMA_CHCR_FETCH);
+        if (i != end)
+                mcdma_write(ch->dev, ring->regs + MCDMA_CH_TAILDESC,
+                            (uint32_t)mcdma_ring_bd_phys(ring, (end + ring->depth - 1) % ring->depth));
+        ch->recovered++;
+        return retry;
+}
@@ -0,0 +1,459 @@
+#ifndef MCDMA_H
+#define MCDMA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef BIT
+#define BIT(n)                          (1u << (n))
+#endif
+
+/*********************************************************************/
+/*                   define all register locations                   */
+/*               based on "LogiCORE IP Product Guide"                */
+/*********************************************************************/
+// MM2S CONTROL
+#define MM2S_DMACR                      0x0000                  //MM2S common control register
+#define MM2S_DMACR_RESET                BIT(2)                  //soft reset, self clearing
+#define MM2S_DMACR_RUNSTOP              BIT(0)                  //run / stop
+
+#define MM2S_DMASR                      0x0004                  //MM2S common status register
+#define MM2S_DMASR_HALTED               BIT(0)
+#define MM2S_DMASR_IDLE                 BIT(1)
+
+#define MM2S_CHEN_OFFSET                0x0008                  //per channel enable mask
+#define MM2S_CHSER                      0x000C                  //channels in service
+#define MM2S_ERR                        0x0010                  //error register
+
+// S2MM CONTROL, the same layout 0x500 higher
+#define S2MM_OFFSET                     0x0500
+#define S2MM_DMACR                      (S2MM_OFFSET + MM2S_DMACR)
+#define S2MM_DMASR                      (S2MM_OFFSET + MM2S_DMASR)
+#define S2MM_CHEN_OFFSET                (S2MM_OFFSET + MM2S_CHEN_OFFSET)
+#define S2MM_CHSER                      (S2MM_OFFSET + MM2S_CHSER)
+#define S2MM_ERR                        (S2MM_OFFSET + MM2S_ERR)
+
+// per channel register block, channel n = 1..16 at 0x040 + (n - 1) * 0x040
+#define MCDMA_MAX_CHANNELS              16
+#define MM2S_CH_BASE(n)                 (0x040 + ((n) - 1) * 0x040)
+#define S2MM_CH_BASE(n)                 (S2MM_OFFSET + MM2S_CH_BASE(n))
+#define MCDMA_CH_CR                     0x00
+#define MCDMA_CH_SR                     0x04
+#define MCDMA_CH_CURDESC                0x08                    // must align 0x40 addresses
+#define MCDMA_CH_CURDESC_MSB            0x0C                    // unused with 32bit addresses
+#define MCDMA_CH_TAILDESC               0x10                    // must align 0x40 addresses
+#define MCDMA_CH_TAILDESC_MSB           0x14                    // unused with 32bit addresses
+#define MCDMA_CH_PKTCNT_STAT            0x18
+
+// CHx_CR bits
+#define MCDMA_CHCR_FETCH                BIT(0)                  //start fetching BDs for this channel
+#define MCDMA_CHCR_IOC_IRQEN            BIT(5)
+#define MCDMA_CHCR_DLY_IRQEN            BIT(6)
+#define MCDMA_CHCR_ERR_IRQEN            BIT(7)
+#define MCDMA_CHCR_IRQTHRESH_SHIFT      16
+#define MCDMA_CHCR_IRQTHRESH_MASK       (0xFFu << MCDMA_CHCR_IRQTHRESH_SHIFT)
+#define MCDMA_CHCR_IRQDELAY_SHIFT       24
+#define MCDMA_CHCR_IRQDELAY_MASK        (0xFFu << MCDMA_CHCR_IRQDELAY_SHIFT)
+#define MCDMA_CHCR_IRQDELAY_UNIT_NS     1000                    //one tick is 125 SG clocks, 1 us at 125 MHz
+#define MCDMA_CHCR_IRQ_MAX              0xFF                    //largest threshold / delay
+
+// CHx_SR bits, the irq bits are write-one-to-clear
+#define MCDMA_CHSR_IDLE                 BIT(0)
+#define MCDMA_CHSR_ERR_OTHER_IRQ        BIT(3)
+#define MCDMA_CHSR_IOC_IRQ              BIT(5)
+#define MCDMA_CHSR_DLY_IRQ              BIT(6)
+#define MCDMA_CHSR_ERR_IRQ              BIT(7)
+#define MCDMA_CHSR_IRQ_MASK             (MCDMA_CHSR_ERR_OTHER_IRQ | MCDMA_CHSR_IOC_IRQ | \
+                                         MCDMA_CHSR_DLY_IRQ | MCDMA_CHSR_ERR_IRQ)
+
+// MM2S_ERR bits
+#define MCDMA_ERR_DMA_INT               BIT(0)
+#define MCDMA_ERR_DMA_SLV               BIT(1)
+#define MCDMA_ERR_DMA_DEC               BIT(2)
+#define MCDMA_ERR_SG_INT                BIT(4)
+#define MCDMA_ERR_SG_SLV                BIT(5)
+#define MCDMA_ERR_SG_DEC                BIT(6)
+
+/*********************************************************************/
+/*                 MM2S buffer descriptor, 0x40 aligned              */
+/*********************************************************************/
+#define MCDMA_BD_SIZE                   0x40
+#define MCDMA_BD_NXTDESC                0x00
+#define MCDMA_BD_NXTDESC_MSB            0x04
+#define MCDMA_BD_BUFADDR                0x08
+#define MCDMA_BD_BUFADDR_MSB            0x0C
+#define MCDMA_BD_CTRL                   0x14
+#define MCDMA_BD_CTRL_SIDEBAND          0x18
+#define MCDMA_BD_STATUS                 0x1C
+#define MCDMA_BD_APP(n)                 (0x20 + 4 * (n))
+#define MCDMA_BD_NUM_APP                5
+
+#define MCDMA_BD_CTRL_SOF               BIT(31)
+#define MCDMA_BD_CTRL_EOF               BIT(30)
+#define MCDMA_BD_LEN_MASK               0x03FFFFFF
+
+#define MCDMA_BD_STS_CMPLT              BIT(31)
+#define MCDMA_BD_STS_DECERR             BIT(30)
+#define MCDMA_BD_STS_SLVERR             BIT(29)
+#define MCDMA_BD_STS_INTERR             BIT(28)
+#define MCDMA_BD_STS_ERR_MASK           (MCDMA_BD_STS_DECERR | MCDMA_BD_STS_SLVERR | MCDMA_BD_STS_INTERR)
+
+/*********************************************************************/
+/*   the same BD as a struct, every field checked against the        */
+/*   offsets above at compile time.  Rings are arrays of these and   */
+/*   are only touched through volatile pointers.                     */
+/*********************************************************************/
+struct mcdma_bd {
+        uint32_t next;
+        uint32_t next_msb;
+        uint32_t buf;
+        uint32_t buf_msb;
+        uint32_t rsvd;
+        uint32_t ctrl;                  //SOF/EOF, buffer length
+        uint32_t ctrl_sideband;         //TID/TDEST/TUSER
+        uint32_t status;
+        uint32_t app[MCDMA_BD_NUM_APP];
+        uint32_t pad[3];
+} __attribute__((aligned(MCDMA_BD_SIZE)));
+
+#define MCDMA_BD_CHECK(type, field, off) \
+        _Static_assert(offsetof(struct type, field) == (off), #type "." #field " is not at " #off)
+
+MCDMA_BD_CHECK(mcdma_bd, next, MCDMA_BD_NXTDESC);
+MCDMA_BD_CHECK(mcdma_bd, next_msb, MCDMA_BD_NXTDESC_MSB);
+MCDMA_BD_CHECK(mcdma_bd, buf, MCDMA_BD_BUFADDR);
+MCDMA_BD_CHECK(mcdma_bd, buf_msb, MCDMA_BD_BUFADDR_MSB);
+MCDMA_BD_CHECK(mcdma_bd, ctrl, MCDMA_BD_CTRL);
+MCDMA_BD_CHECK(mcdma_bd, ctrl_sideband, MCDMA_BD_CTRL_SIDEBAND);
+MCDMA_BD_CHECK(mcdma_bd, status, MCDMA_BD_STATUS);
+MCDMA_BD_CHECK(mcdma_bd, app[MCDMA_BD_NUM_APP - 1], MCDMA_BD_APP(MCDMA_BD_NUM_APP - 1));
+_Static_assert(sizeof(struct mcdma_bd) == MCDMA_BD_SIZE, "struct mcdma_bd is not one BD");
+
+/*********************************************************************/
+/*   S2MM buffer descriptor: control carries only the buffer length, */
+/*   status (at the MM2S sideband offset) the received length and    */
+/*   RXSOF/RXEOF, the word after it the TID/TDEST/TUSER of the       */
+/*   stream, the APP words the status stream of the packet.          */
+/*********************************************************************/
+#define MCDMA_S2MM_BD_STATUS            0x18
+#define MCDMA_S2MM_BD_SIDEBAND          0x1C
+
+#define MCDMA_BD_STS_RXSOF              BIT(27)
+#define MCDMA_BD_STS_RXEOF              BIT(26)
+
+#define MCDMA_BD_SB_TID(sb)             (((sb) >> 24) & 0xFF)
+#define MCDMA_BD_SB_TDEST(sb)           (((sb) >> 16) & 0x1F)
+#define MCDMA_BD_SB_TUSER(sb)           ((sb) & 0xFFFF)
+#define MCDMA_BD_SB(tid, tdest, tuser)  (((uint32_t)(tid) & 0xFF) << 24 | ((uint32_t)(tdest) & 0x1F) << 16 | \
+                                         ((uint32_t)(tuser) & 0xFFFF))
+
+struct mcdma_s2mm_bd {
+        uint32_t next;
+        uint32_t next_msb;
+        uint32_t buf;
+        uint32_t buf_msb;
+        uint32_t rsvd;
+        uint32_t ctrl;                  //buffer length
+        uint32_t status;                //Cmplt, errors, RXSOF/RXEOF, bytes received
+        uint32_t sideband;              //TID/TDEST/TUSER
+        uint32_t app[MCDMA_BD_NUM_APP];
+        uint32_t pad[3];
+} __attribute__((aligned(MCDMA_BD_SIZE)));
+
+MCDMA_BD_CHECK(mcdma_s2mm_bd, ctrl, MCDMA_BD_CTRL);
+MCDMA_BD_CHECK(mcdma_s2mm_bd, status, MCDMA_S2MM_BD_STATUS);
+MCDMA_BD_CHECK(mcdma_s2mm_bd, sideband, MCDMA_S2MM_BD_SIDEBAND);
+MCDMA_BD_CHECK(mcdma_s2mm_bd, app[MCDMA_BD_NUM_APP - 1], MCDMA_BD_APP(MCDMA_BD_NUM_APP - 1));
+_Static_assert(sizeof(struct mcdma_s2mm_bd) == MCDMA_BD_SIZE, "struct mcdma_s2mm_bd is not one BD");
+
+/*********************************************************************/
+/*   publish a BD prepared in normal memory: BUFADDR through APP4    */
+/*   as 64 bit stores, NXTDESC stays as chained.  This is the only   */
+/*   way BDs are written while a ring runs.                          */
+/*********************************************************************/
+#define MCDMA_BD_COPY_FIRST             MCDMA_BD_BUFADDR
+#define MCDMA_BD_COPY_END               (MCDMA_BD_APP(MCDMA_BD_NUM_APP - 1) + 4 + 4)   //+ first pad word
+#define MCDMA_BD_STORES                 ((MCDMA_BD_COPY_END - MCDMA_BD_COPY_FIRST) / 8)
+
+typedef uint64_t __attribute__((may_alias)) mcdma_bd_dword;
+
+static inline void mcdma_bd_copy(volatile struct mcdma_bd *dst, const struct mcdma_bd *src)
+{
+        volatile mcdma_bd_dword *d = (volatile mcdma_bd_dword *)((volatile uint8_t *)dst + MCDMA_BD_COPY_FIRST);
+        const mcdma_bd_dword *s = (const mcdma_bd_dword *)((const uint8_t *)src + MCDMA_BD_COPY_FIRST);
+        unsigned int i;
+
+        for (i = 0; i < MCDMA_BD_STORES; i++)
+                d[i] = s[i];
+}
+
+/*********************************************************************/
+/*      datamover command carried in APP0..APP2 of the SOF BD,       */
+/*       the PL writes the stream payload to APP2:APP1 address       */
+/*********************************************************************/
+#define DM_CMD_EOF                      BIT(30)
+#define DM_CMD_TYPE_INCR                BIT(23)
+#define DM_CMD_BTT_MASK                 0x007FFFFF
+
+/*********************************************************************/
+/*                           barriers                                */
+/*   BD stores must be visible to the engine before TAILDESC write   */
+/*********************************************************************/
+#if defined(__aarch64__) || defined(__arm__)
+#define mcdma_wmb()                     __asm__ __volatile__("dsb st" ::: "memory")
+#define mcdma_rmb()                     __asm__ __volatile__("dsb sy" ::: "memory")
+#else
+#define mcdma_wmb()                     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define mcdma_rmb()                     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+struct mcdma_dev;
+
+/*********************************************************************/
+/*   CPU mapping of DMA memory.  UNCACHED is what O_SYNC gives       */
+/*   (strongly ordered on ARM), WC buffers stores and needs only a   */
+/*   barrier, CACHED needs a clean before the engine reads and an    */
+/*   invalidate before the CPU reads what the engine wrote.          */
+/*********************************************************************/
+enum mcdma_cache {
+        MCDMA_CACHE_UNCACHED,
+        MCDMA_CACHE_WC,
+        MCDMA_CACHE_CACHED,
+};
+
+int mcdma_cache_parse(const char *s, enum mcdma_cache *cache);
+const char *mcdma_cache_name(enum mcdma_cache cache);
+
+/*********************************************************************/
+/*   platform: where register windows and DMA memory come from.      */
+/*   /dev/mem on the board, a software model everywhere else.        */
+/*   map is for register windows and uncached memory, map_mem for    */
+/*   DMA memory in the other modes (NULL, errno set, if unsupported) */
+/*********************************************************************/
+struct mcdma_platform {
+        const char *name;
+        void *(*map)(struct mcdma_platform *plat, uint64_t phys, size_t size);
+        void *(*map_mem)(struct mcdma_platform *plat, uint64_t phys, size_t size, enum mcdma_cache cache);
+        void (*unmap)(struct mcdma_platform *plat, void *virt, size_t size);
+        void (*attach)(struct mcdma_platform *plat, struct mcdma_dev *dev);    //optional, installs reg_hook
+        void (*close)(struct mcdma_platform *plat);
+};
+
+struct mcdma_dev {
+        volatile uint32_t *regs;
+        uint64_t phys;
+        struct mcdma_platform *plat;
+        void (*reg_hook)(void *ctx, uint32_t off, uint32_t val);               //register side effects of a model
+        void *hook_ctx;
+};
+
+#define MCDMA_REG_SPACE                 0x1000
+
+static inline uint32_t mcdma_read(const struct mcdma_dev *dev, uint32_t off)
+{
+        return dev->regs[off >> 2];
+}
+
+static inline void mcdma_write(const struct mcdma_dev *dev, uint32_t off, uint32_t val)
+{
+        if (dev->reg_hook)
+                dev->reg_hook(dev->hook_ctx, off, val);
+        else
+                dev->regs[off >> 2] = val;
+}
+
+static inline uint32_t bd_read(const void *bd, uint32_t off)
+{
+        return ((const volatile uint32_t *)bd)[off >> 2];
+}
+
+static inline void bd_write(void *bd, uint32_t off, uint32_t val)
+{
+        ((volatile uint32_t *)bd)[off >> 2] = val;
+}
+
+struct mcdma_platform *mcdma_devmem_open(void);
+
+int mcdma_dev_open(struct mcdma_dev *dev, struct mcdma_platform *plat, uint64_t phys);
+void mcdma_dev_close(struct mcdma_dev *dev);
+int mcdma_dev_reset(struct mcdma_dev *dev);
+int mcdma_dev_run(struct mcdma_dev *dev);
+void mcdma_print_status(uint32_t chsr);
+
+/*********************************************************************/
+/*                       circular BD ring                            */
+/*   BDs are chained NXTDESC -> NXTDESC in a closed loop, software   */
+/*   fills at head, hardware completes from tail.  One BD is always  */
+/*   kept free so head never catches up with the engine.             */
+/*********************************************************************/
+struct mcdma_cpl {
+        void *cookie;
+        uint32_t status;                //BD status word, MCDMA_BD_STS_*
+        uint32_t len;                   //bytes transferred
+};
+
+struct mcdma_ring {
+        struct mcdma_dev *dev;
+        uint32_t regs;                  //register block of the owning channel
+        volatile struct mcdma_bd *bd;   //virtual base of the ring
+        uint64_t bd_phys;               //physical base, 0x40 aligned
+        unsigned int depth;
+        unsigned int head;              //next BD to fill
+        unsigned int tail;              //oldest BD owned by hardware
+        unsigned int pending;           //filled, not yet handed over by kick
+        unsigned int inflight;          //handed over, not yet reclaimed
+        uint32_t tail_msb;              //last TAILDESC_MSB written, only rewritten when it changes
+        uint32_t max_len;               //largest BD iov pieces are split to, the core's buffer length width
+        uint32_t bd_ctrl;               //offset of the BD word with EOF, MCDMA_BD_CTRL unless the engine differs
+        uint32_t bd_eof;
+        void **cookie;
+};
+
+int mcdma_ring_init(struct mcdma_ring *ring, struct mcdma_dev *dev, uint32_t regs,
+                    void *bd_virt, uint64_t bd_phys, unsigned int depth);
+void mcdma_ring_free(struct mcdma_ring *ring);
+int mcdma_ring_queue(struct mcdma_ring *ring, uint64_t buf, uint32_t len, uint32_t flags,
+                     const uint32_t *app, void *cookie);
+void mcdma_ring_kick(struct mcdma_ring *ring);
+int mcdma_ring_reclaim(struct mcdma_ring *ring, struct mcdma_cpl *cpl, int max);
+
+static inline unsigned int mcdma_ring_space(const struct mcdma_ring *ring)
+{
+        return ring->depth - 1 - ring->pending - ring->inflight;
+}
+
+// oldest in-flight BD has its Cmplt bit set
+static inline int mcdma_ring_peek(const struct mcdma_ring *ring)
+{
+        return ring->inflight && (ring->bd[ring->tail].status & MCDMA_BD_STS_CMPLT);
+}
+
+static inline uint64_t mcdma_ring_bd_phys(const struct mcdma_ring *ring, unsigned int idx)
+{
+        return ring->bd_phys + (uint64_t)idx * MCDMA_BD_SIZE;
+}
+
+/*********************************************************************/
+/*   zero-copy scatter-gather: one packet from a list of DMA-capable */
+/*   pieces of any size.  Every piece is split into BDs of at most   */
+/*   max_len (kept 64 byte aligned), SOF goes on the first BD with   */
+/*   the APP words, EOF and the cookie on the last.  All or nothing: */
+/*   -EBUSY if the ring has no room now, -E2BIG if it never will.    */
+/*********************************************************************/
+#define MCDMA_SPLIT_ALIGN               64
+
+struct mcdma_iov {
+        uint64_t phys;                  //DMA address of the piece
+        size_t len;
+};
+
+unsigned int mcdma_iov_bds(const struct mcdma_iov *iov, unsigned int n, uint32_t max_len);
+int mcdma_ring_queue_iov(struct mcdma_ring *ring, const struct mcdma_iov *iov, unsigned int n,
+                         const uint32_t *app, void *cookie);
+
+/*********************************************************************/
+/*   chain template: the BDs of one transfer prebuilt once in normal */
+/*   memory, buffer addresses relative to 0.  Queueing it copies     */
+/*   every BD onto the ring and adds the source base to BUFADDR and, */
+/*   with MCDMA_CHAIN_APP_ADDR, the target base to the APP2:APP1     */
+/*   datamover address of the SOF BD.  The cookie goes with the last */
+/*   BD, the others complete with a NULL cookie.                     */
+/*********************************************************************/
+#define MCDMA_CHAIN_APP_ADDR            BIT(0)
+
+struct mcdma_chain {
+        struct mcdma_bd *bd;
+        unsigned int count;
+        unsigned int flags;
+};
+
+int mcdma_chain_init(struct mcdma_chain *chain, unsigned int count, unsigned int flags);
+void mcdma_chain_free(struct mcdma_chain *chain);
+int mcdma_chain_set(struct mcdma_chain *chain, unsigned int i, uint64_t off, uint32_t len, uint32_t flags,
+                    const uint32_t *app);
+int mcdma_ring_queue_chain(struct mcdma_ring *ring, const struct mcdma_chain *chain, uint64_t src, uint64_t dst,
+                           void *cookie);
+
+/*********************************************************************/
+/*                         channel API                               */
+/*   every channel owns its register block, its BD ring and its      */
+/*   completion counters; the CHEN mask of its direction is kept by  */
+/*   start/stop.  S2MM channels are opened with mcdma_chan_open_s2mm */
+/*   and received from through mcdma_rx.h.                           */
+/*********************************************************************/
+struct mcdma_chan {
+        struct mcdma_dev *dev;
+        unsigned int id;                //1..MCDMA_MAX_CHANNELS
+        uint32_t base;                  //MM2S_CH_BASE(id) or S2MM_CH_BASE(id)
+        uint32_t common;                //0 or S2MM_OFFSET, the direction's common registers
+        struct mcdma_ring ring;
+        uint64_t bytes;                 //completion tracking
+        uint64_t packets;               //MM2S: EOF BDs, S2MM: RXEOF buffers
+        uint64_t errors;                //BDs with any error bit, then by bit
+        uint64_t err_int;
+        uint64_t err_slv;
+        uint64_t err_dec;
+        uint64_t recovered;             //faults mcdma_chan_recover() restarted the channel from
+        uint64_t retried;               //BDs rerun after a fault
+        uint64_t skipped;               //BDs completed with an error instead of run
+        int retry_bd;                   //ring index of a retried BD not reclaimed yet, -1 for none
+};
+
+static inline void mcdma_chan_count_err(struct mcdma_chan *ch, uint32_t status)
+{
+        if (!(status & MCDMA_BD_STS_ERR_MASK))
+                return;
+        ch->errors++;
+        ch->err_int += !!(status & MCDMA_BD_STS_INTERR);
+        ch->err_slv += !!(status & MCDMA_BD_STS_SLVERR);
+        ch->err_dec += !!(status & MCDMA_BD_STS_DECERR);
+}
+
+static inline uint32_t mcdma_chan_read(const struct mcdma_chan *ch, uint32_t reg)
+{
+        return mcdma_read(ch->dev, ch->base + reg);
+}
+
+static inline void mcdma_chan_write(const struct mcdma_chan *ch, uint32_t reg, uint32_t val)
+{
+        mcdma_write(ch->dev, ch->base + reg, val);
+}
+
+int mcdma_chan_open(struct mcdma_chan *ch, struct mcdma_dev *dev, unsigned int id,
+                    void *bd_virt, uint64_t bd_phys, unsigned int depth);
+int mcdma_chan_open_s2mm(struct mcdma_chan *ch, struct mcdma_dev *dev, unsigned int id,
+                         void *bd_virt, uint64_t bd_phys, unsigned int depth);
+void mcdma_chan_close(struct mcdma_chan *ch);
+int mcdma_chan_start(struct mcdma_chan *ch);
+void mcdma_chan_stop(struct mcdma_chan *ch);
+int mcdma_chan_reclaim(struct mcdma_chan *ch, struct mcdma_cpl *cpl, int max);
+int mcdma_chan_set_coalesce(struct mcdma_chan *ch, unsigned int thresh, unsigned int delay);
+
+/*********************************************************************/
+/*   per channel error recovery (MM2S), no soft reset: the engine    */
+/*   halts only the channel that failed, raises Err_Irq in its SR    */
+/*   and Err_Other_Irq in the others, which keep streaming.          */
+/*   mcdma_chan_fault() finds the BD it stopped on from CURDESC.     */
+/*   mcdma_chan_recover() clears Fetch and the irq bits of that      */
+/*   channel only, then either reruns the BD (MCDMA_RECOVER_RETRY,   */
+/*   once per BD and only for a BD that starts a packet) or skips    */
+/*   it and the rest of its packet, and restarts fetching behind it. */
+/*   Skipped BDs are marked Cmplt with their error bits and a length */
+/*   of 0, so the caller's next reclaim returns them as failed       */
+/*   completions and packet accounting carries on unchanged.         */
+/*********************************************************************/
+#define MCDMA_RECOVER_RETRY             BIT(0)
+
+struct mcdma_fault {
+        unsigned int bd;                //ring index of the BD the channel stopped on
+        uint32_t status;                //its status word
+        uint32_t sr;                    //CHx_SR
+        uint32_t err;                   //MM2S_ERR, sticky over all channels until a reset
+};
+
+// 1 and f filled in when the channel is halted on its own error, 0 if not, -EIO if CURDESC is off the ring
+int mcdma_chan_fault(const struct mcdma_chan *ch, struct mcdma_fault *f);
+// returns 1 when the BD is retried, 0 when skipped
+int mcdma_chan_recover(struct mcdma_chan *ch, const struct mcdma_fault *f, unsigned int flags);
+
+#endif
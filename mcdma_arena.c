@@ -0,0 +1,461 @@
+#define _GNU_SOURCE                     //memfd_create
+
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "mcdma_arena.h"
+#include "mcdma_pattern.h"
+
+#define ARENA_NONE                      0xFFFFFFFFu             //end of a free list
+
+/*********************************************************************/
+/*                          region sources                           */
+/*********************************************************************/
+static int region_mmap(struct mcdma_region *r, size_t size)
+{
+        void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+
+        if (p == MAP_FAILED) {
+                int ret = -errno;
+
+                close(r->fd);
+                return ret;
+        }
+        r->virt = p;
+        r->size = size;
+        return 0;
+}
+
+int mcdma_region_open_platform(struct mcdma_region *r, struct mcdma_platform *plat, uint64_t phys, size_t size,
+                               enum mcdma_cache cache)
+{
+        memset(r, 0, sizeof(*r));
+        errno = ENOMEM;
+        if (cache == MCDMA_CACHE_UNCACHED || !plat->map_mem)
+                r->virt = cache == MCDMA_CACHE_UNCACHED ? plat->map(plat, phys, size) : NULL;
+        else
+                r->virt = plat->map_mem(plat, phys, size, cache);
+        if (!r->virt)
+                return -errno;
+        r->kind = MCDMA_REGION_PLATFORM;
+        r->cache = cache;
+        r->phys = phys;
+        r->size = size;
+        r->fd = -1;
+        r->plat = plat;
+        return 0;
+}
+
+static int sysfs_read_u64(const char *name, const char *attr, uint64_t *val)
+{
+        char path[128];
+        FILE *f;
+        int ok;
+
+        snprintf(path, sizeof(path), "/sys/class/u-dma-buf/%s/%s", name, attr);
+        f = fopen(path, "r");
+        if (!f)
+                return -errno;
+        ok = fscanf(f, "%" SCNi64, val) == 1;           //phys_addr is 0x.., size decimal
+        fclose(f);
+        return ok ? 0 : -EINVAL;
+}
+
+static int sysfs_write(const char *name, const char *attr, unsigned long long val)
+{
+        char path[128];
+        FILE *f;
+        int ok;
+
+        snprintf(path, sizeof(path), "/sys/class/u-dma-buf/%s/%s", name, attr);
+        f = fopen(path, "w");
+        if (!f)
+                return -errno;
+        ok = fprintf(f, "%llu", val) > 0;
+        return fclose(f) || !ok ? -EIO : 0;
+}
+
+/*********************************************************************/
+/*   u-dma-buf driver: /dev/<name>, the buffer is contiguous and its */
+/*   address is in sysfs.  Without O_SYNC the mapping is cached, with */
+/*   it sync_mode 1 makes it uncached and 2 write-combined            */
+/*********************************************************************/
+#define UDMABUF_SYNC_NONCACHED          1
+#define UDMABUF_SYNC_WRITECOMBINE       2
+
+int mcdma_region_open_udmabuf(struct mcdma_region *r, const char *name, enum mcdma_cache cache)
+{
+        char path[64];
+        uint64_t size;
+        int ret;
+
+        memset(r, 0, sizeof(*r));
+        snprintf(r->name, sizeof(r->name), "%s", name);
+        ret = sysfs_read_u64(name, "phys_addr", &r->phys);
+        if (!ret)
+                ret = sysfs_read_u64(name, "size", &size);
+        if (!ret && cache != MCDMA_CACHE_CACHED)
+                ret = sysfs_write(name, "sync_mode",
+                                  cache == MCDMA_CACHE_WC ? UDMABUF_SYNC_WRITECOMBINE : UDMABUF_SYNC_NONCACHED);
+        if (ret)
+                return ret;
+
+        snprintf(path, sizeof(path), "/dev/%s", name);
+        r->fd = open(path, O_RDWR | O_CLOEXEC | (cache == MCDMA_CACHE_CACHED ? 0 : O_SYNC));
+        if (r->fd < 0)
+                return -errno;
+        r->kind = MCDMA_REGION_UDMABUF;
+        r->cache = cache;
+        return region_mmap(r, size);
+}
+
+int mcdma_region_open_dmaheap(struct mcdma_region *r, const char *heap, size_t size, uint64_t phys)
+{
+        struct dma_heap_allocation_data alloc = {
+                .len = size,
+                .fd_flags = O_RDWR | O_CLOEXEC,
+        };
+        char path[64];
+        int hfd, ret;
+
+        memset(r, 0, sizeof(*r));
+        snprintf(path, sizeof(path), "/dev/dma_heap/%s", heap);
+        hfd = open(path, O_RDONLY | O_CLOEXEC);
+        if (hfd < 0)
+                return -errno;
+        ret = ioctl(hfd, DMA_HEAP_IOCTL_ALLOC, &alloc) ? -errno : 0;
+        close(hfd);
+        if (ret)
+                return ret;
+
+        // the heap decides the attributes, treat it as cached and sync through the dma-buf
+        r->kind = MCDMA_REGION_DMAHEAP;
+        r->cache = MCDMA_CACHE_CACHED;
+        r->fd = alloc.fd;
+        r->phys = phys;
+        return region_mmap(r, size);
+}
+
+int mcdma_region_open_memfd(struct mcdma_region *r, size_t size, uint64_t phys)
+{
+        memset(r, 0, sizeof(*r));
+        r->fd = memfd_create("mcdma_region", MFD_CLOEXEC);
+        if (r->fd < 0)
+                return -errno;
+        if (ftruncate(r->fd, size)) {
+                close(r->fd);
+                return -errno;
+        }
+        r->kind = MCDMA_REGION_MEMFD;
+        r->cache = MCDMA_CACHE_CACHED;
+        r->phys = phys;
+        return region_mmap(r, size);
+}
+
+/*********************************************************************/
+/*   "mem" (default), "udmabuf:<name>", "heap:<name>[@phys]" or      */
+/*   "memfd"; phys, size and cache apply where the source does not   */
+/*   decide them itself                                              */
+/*********************************************************************/
+int mcdma_region_open_spec(struct mcdma_region *r, const char *spec, struct mcdma_platform *plat,
+                           uint64_t phys, size_t size, enum mcdma_cache cache)
+{
+        char name[64], *at;
+
+        if (!spec || !strcmp(spec, "mem"))
+                return mcdma_region_open_platform(r, plat, phys, size, cache);
+        if (!strcmp(spec, "memfd"))
+                return mcdma_region_open_memfd(r, size, phys);
+        if (!strncmp(spec, "udmabuf:", 8))
+                return mcdma_region_open_udmabuf(r, spec + 8, cache);
+        if (!strncmp(spec, "heap:", 5)) {
+                snprintf(name, sizeof(name), "%s", spec + 5);
+                at = strchr(name, '@');
+                if (at) {
+                        *at++ = 0;
+                        phys = strtoull(at, NULL, 0);
+                }
+                return mcdma_region_open_dmaheap(r, name, size, phys);
+        }
+        return -EINVAL;
+}
+
+void mcdma_region_close(struct mcdma_region *r)
+{
+        if (r->kind == MCDMA_REGION_PLATFORM) {
+                if (r->virt)
+                        r->plat->unmap(r->plat, r->virt, r->size);
+        } else {
+                munmap(r->virt, r->size);
+                close(r->fd);
+        }
+        r->virt = NULL;
+}
+
+/*********************************************************************/
+/*   CPU cache maintenance by line.  AArch64 lets EL0 clean and      */
+/*   clean+invalidate to the point of coherency (SCTLR_EL1.UCI),     */
+/*   x86 DMA snoops the caches, 32 bit ARM has no EL0 instruction    */
+/*   so cached /dev/mem mappings are refused there.                  */
+/*********************************************************************/
+#if defined(__aarch64__)
+static size_t dcache_line(void)
+{
+        uint64_t ctr;
+
+        __asm__ __volatile__("mrs %0, ctr_el0" : "=r"(ctr));
+        return (size_t)4 << ((ctr >> 16) & 0xF);
+}
+
+// clean for the device, clean+invalidate for the cpu (dc ivac is EL1 only)
+static int cpu_cache_sync(const void *virt, size_t len, int for_cpu)
+{
+        size_t line = dcache_line();
+        uintptr_t p = (uintptr_t)virt & ~(line - 1), end = (uintptr_t)virt + len;
+
+        for (; p < end; p += line) {
+                if (for_cpu)
+                        __asm__ __volatile__("dc civac, %0" :: "r"(p) : "memory");
+                else
+                        __asm__ __volatile__("dc cvac, %0" :: "r"(p) : "memory");
+        }
+        __asm__ __volatile__("dsb sy" ::: "memory");
+        return 0;
+}
+#elif defined(__arm__)
+static int cpu_cache_sync(const void *virt, size_t len, int for_cpu)
+{
+        (void)virt;
+        (void)len;
+        (void)for_cpu;
+        return -EOPNOTSUPP;
+}
+#else
+static int cpu_cache_sync(const void *virt, size_t len, int for_cpu)
+{
+        (void)virt;
+        (void)len;
+        (void)for_cpu;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        return 0;
+}
+#endif
+
+static int udmabuf_sync(struct mcdma_region *r, const void *virt, size_t len, int for_cpu)
+{
+        int ret;
+
+        // DMA_TO_DEVICE = 1, DMA_FROM_DEVICE = 2
+        ret = sysfs_write(r->name, "sync_offset", (const uint8_t *)virt - r->virt);
+        if (!ret)
+                ret = sysfs_write(r->name, "sync_size", len);
+        if (!ret)
+                ret = sysfs_write(r->name, "sync_direction", for_cpu ? 2 : 1);
+        if (!ret)
+                ret = sysfs_write(r->name, for_cpu ? "sync_for_cpu" : "sync_for_device", 1);
+        return ret;
+}
+
+// dma-buf brackets CPU access instead: START before the CPU touches it, END after
+static int dmabuf_sync(struct mcdma_region *r, int for_cpu)
+{
+        struct dma_buf_sync sync = {
+                .flags = (for_cpu ? DMA_BUF_SYNC_START : DMA_BUF_SYNC_END) | DMA_BUF_SYNC_RW,
+        };
+
+        return ioctl(r->fd, DMA_BUF_IOCTL_SYNC, &sync) ? -errno : 0;
+}
+
+static int region_sync(struct mcdma_region *r, const void *virt, size_t len, int for_cpu)
+{
+        if (r->cache != MCDMA_CACHE_CACHED) {
+                // drains write-combine buffers, orders uncached accesses
+                if (for_cpu)
+                        mcdma_rmb();
+                else
+                        mcdma_wmb();
+                return 0;
+        }
+        switch (r->kind) {
+        case MCDMA_REGION_UDMABUF:
+                return udmabuf_sync(r, virt, len, for_cpu);
+        case MCDMA_REGION_DMAHEAP:
+                return dmabuf_sync(r, for_cpu);
+        case MCDMA_REGION_MEMFD:
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                return 0;
+        default:
+                return cpu_cache_sync(virt, len, for_cpu);
+        }
+}
+
+int mcdma_region_sync_for_device(struct mcdma_region *r, const void *virt, size_t len)
+{
+        return region_sync(r, virt, len, 0);
+}
+
+int mcdma_region_sync_for_cpu(struct mcdma_region *r, const void *virt, size_t len)
+{
+        return region_sync(r, virt, len, 1);
+}
+
+/*********************************************************************/
+/*   size classes in granules: 1, 2, 3, then 4..7 << g for g = 0..   */
+/*********************************************************************/
+static unsigned int class_of(size_t n)
+{
+        unsigned int g;
+        size_t q;
+
+        if (n <= 3)
+                return n - 1;
+        g = 63 - __builtin_clzll(n) - 2;
+        q = (n + ((size_t)1 << g) - 1) >> g;
+        if (q == 8) {
+                g++;
+                q = 4;
+        }
+        return 3 + 4 * g + (q - 4);
+}
+
+static size_t class_granules(unsigned int c)
+{
+        if (c < 3)
+                return c + 1;
+        return (size_t)(4 + (c - 3) % 4) << ((c - 3) / 4);
+}
+
+int mcdma_arena_init(struct mcdma_arena *a, struct mcdma_region *region)
+{
+        size_t granules = region->size / MCDMA_ARENA_GRANULE;
+        unsigned int c;
+
+        memset(a, 0, sizeof(*a));
+        if (region->phys & (MCDMA_ARENA_GRANULE - 1))
+                return -EINVAL;
+        a->region = region;
+        // calloc'd tables only get pages where blocks actually start
+        a->cls = calloc(granules, sizeof(*a->cls));
+        a->next = calloc(granules, sizeof(*a->next));
+        if (!a->cls || !a->next) {
+                mcdma_arena_destroy(a);
+                return -ENOMEM;
+        }
+        for (c = 0; c < MCDMA_ARENA_CLASSES; c++)
+                a->head[c] = ARENA_NONE;
+        return 0;
+}
+
+void mcdma_arena_destroy(struct mcdma_arena *a)
+{
+        free(a->cls);
+        free(a->next);
+        a->cls = NULL;
+        a->next = NULL;
+}
+
+void *mcdma_arena_alloc(struct mcdma_arena *a, size_t size, uint64_t *phys)
+{
+        size_t n = (size + MCDMA_ARENA_GRANULE - 1) / MCDMA_ARENA_GRANULE, bytes;
+        unsigned int c;
+        uint32_t g;
+
+        if (!n)
+                n = 1;
+        c = class_of(n);
+        if (c >= MCDMA_ARENA_CLASSES)
+                return NULL;
+        bytes = class_granules(c) * MCDMA_ARENA_GRANULE;
+
+        if (a->head[c] != ARENA_NONE) {
+                g = a->head[c];
+                a->head[c] = a->next[g];
+        } else {
+                if (bytes > a->region->size - a->bump)
+                        return NULL;
+                g = a->bump / MCDMA_ARENA_GRANULE;
+                a->bump += bytes;
+        }
+        a->cls[g] = c + 1;
+        a->used += bytes;
+        if (a->used > a->peak)
+                a->peak = a->used;
+        if (phys)
+                *phys = a->region->phys + (uint64_t)g * MCDMA_ARENA_GRANULE;
+        return a->region->virt + (size_t)g * MCDMA_ARENA_GRANULE;
+}
+
+void mcdma_arena_free(struct mcdma_arena *a, void *virt)
+{
+        uint32_t g;
+        unsigned int c;
+
+        if (!virt)
+                return;
+        g = ((uint8_t *)virt - a->region->virt) / MCDMA_ARENA_GRANULE;
+        if (!a->cls[g]) {
+                fprintf(stderr, "mcdma_arena_free: %p is not a block\n", virt);
+                return;
+        }
+        c = a->cls[g] - 1;
+        a->cls[g] = 0;
+        a->next[g] = a->head[c];
+        a->head[c] = g;
+        a->used -= class_granules(c) * MCDMA_ARENA_GRANULE;
+}
+
+// zeroed slab of count BDs, BD aligned
+void *mcdma_arena_alloc_bds(struct mcdma_arena *a, unsigned int count, uint64_t *phys)
+{
+        void *bd = mcdma_arena_alloc(a, (size_t)count * MCDMA_BD_SIZE, phys);
+
+        if (bd)
+                mcdma_mem_zero(bd, (size_t)count * MCDMA_BD_SIZE);
+        return bd;
+}
+
+/*********************************************************************/
+/*                           buffer pools                            */
+/*********************************************************************/
+int mcdma_pool_init(struct mcdma_pool *p, struct mcdma_arena *a, size_t obj_size, unsigned int count)
+{
+        unsigned int i;
+
+        memset(p, 0, sizeof(*p));
+        p->arena = a;
+        p->obj_size = (obj_size + MCDMA_ARENA_GRANULE - 1) & ~(size_t)(MCDMA_ARENA_GRANULE - 1);
+        p->count = count;
+        p->stack = malloc(count * sizeof(*p->stack));
+        p->base = p->stack ? mcdma_arena_alloc(a, p->obj_size * count, &p->phys) : NULL;
+        if (!p->base) {
+                free(p->stack);
+                p->stack = NULL;
+                return -ENOMEM;
+        }
+        // hand out the lowest addresses first
+        for (i = 0; i < count; i++)
+                p->stack[i] = count - 1 - i;
+        p->top = count;
+        return 0;
+}
+
+void mcdma_pool_destroy(struct mcdma_pool *p)
+{
+        if (p->base)
+                mcdma_arena_free(p->arena, p->base);
+        free(p->stack);
+        p->base = NULL;
+        p->stack = NULL;
+}
@@ -0,0 +1,127 @@
+#ifndef MCDMA_ARENA_H
+#define MCDMA_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mcdma.h"
+
+/*********************************************************************/
+/*   physically contiguous memory the DMA can reach, from one of     */
+/*   PLATFORM  a window of the platform (/dev/mem or the model)      */
+/*   UDMABUF   a u-dma-buf device, phys_addr/size from sysfs         */
+/*   DMAHEAP   a dma-buf from /dev/dma_heap/<name>, the physical     */
+/*             address must be known (dedicated CMA/reserved heap)   */
+/*   MEMFD     anonymous memory with a made up physical address,     */
+/*             only meaningful with the software model               */
+/*********************************************************************/
+enum mcdma_region_kind {
+        MCDMA_REGION_PLATFORM,
+        MCDMA_REGION_UDMABUF,
+        MCDMA_REGION_DMAHEAP,
+        MCDMA_REGION_MEMFD,
+};
+
+struct mcdma_region {
+        enum mcdma_region_kind kind;
+        enum mcdma_cache cache;
+        uint8_t *virt;
+        uint64_t phys;
+        size_t size;
+        int fd;                         //device, dma-buf or memfd, -1 for PLATFORM
+        struct mcdma_platform *plat;    //PLATFORM only
+        char name[32];                  //UDMABUF only, for the sysfs sync attributes
+};
+
+int mcdma_region_open_platform(struct mcdma_region *r, struct mcdma_platform *plat, uint64_t phys, size_t size,
+                               enum mcdma_cache cache);
+int mcdma_region_open_udmabuf(struct mcdma_region *r, const char *name, enum mcdma_cache cache);
+int mcdma_region_open_dmaheap(struct mcdma_region *r, const char *heap, size_t size, uint64_t phys);
+int mcdma_region_open_memfd(struct mcdma_region *r, size_t size, uint64_t phys);
+int mcdma_region_open_spec(struct mcdma_region *r, const char *spec, struct mcdma_platform *plat,
+                           uint64_t phys, size_t size, enum mcdma_cache cache);
+void mcdma_region_close(struct mcdma_region *r);
+
+/*********************************************************************/
+/*   ownership transfers of [virt, virt + len): for_device after     */
+/*   the CPU wrote and before the engine reads, for_cpu after the    */
+/*   engine wrote and before the CPU reads.  A barrier for UNCACHED  */
+/*   and WC, cache maintenance (by line, u-dma-buf sysfs or dma-buf  */
+/*   ioctl) for CACHED.  Never call it per BD.                       */
+/*********************************************************************/
+int mcdma_region_sync_for_device(struct mcdma_region *r, const void *virt, size_t len);
+int mcdma_region_sync_for_cpu(struct mcdma_region *r, const void *virt, size_t len);
+
+/*********************************************************************/
+/*   allocator over a region, for setup time only.  Sizes are        */
+/*   rounded up to a size class (64 byte granules, four classes per  */
+/*   power of two), every block is 64 byte aligned, alloc and free   */
+/*   are O(1): a free block goes back on its class's list and is     */
+/*   only reused by that class, fresh blocks come off a bump         */
+/*   pointer.  The bookkeeping lives outside the region so it never  */
+/*   touches (possibly uncached) DMA memory.                         */
+/*********************************************************************/
+#define MCDMA_ARENA_GRANULE             64
+#define MCDMA_ARENA_CLASSES             128
+
+struct mcdma_arena {
+        struct mcdma_region *region;
+        size_t bump;                    //first never allocated byte
+        size_t used;                    //bytes in live blocks, class rounded
+        size_t peak;
+        uint8_t *cls;                   //per granule: class + 1 of the block starting there, 0 if none
+        uint32_t *next;                 //per granule: next free block of the same class
+        uint32_t head[MCDMA_ARENA_CLASSES];
+};
+
+int mcdma_arena_init(struct mcdma_arena *a, struct mcdma_region *region);
+void mcdma_arena_destroy(struct mcdma_arena *a);
+void *mcdma_arena_alloc(struct mcdma_arena *a, size_t size, uint64_t *phys);
+void mcdma_arena_free(struct mcdma_arena *a, void *virt);
+void *mcdma_arena_alloc_bds(struct mcdma_arena *a, unsigned int count, uint64_t *phys);
+
+static inline uint64_t mcdma_arena_phys(const struct mcdma_arena *a, const void *virt)
+{
+        return a->region->phys + (uint64_t)((const uint8_t *)virt - a->region->virt);
+}
+
+static inline void *mcdma_arena_virt(const struct mcdma_arena *a, uint64_t phys)
+{
+        return a->region->virt + (phys - a->region->phys);
+}
+
+/*********************************************************************/
+/*   pool of count equal buffers carved out of one arena block,      */
+/*   get/put pop and push an index stack                             */
+/*********************************************************************/
+struct mcdma_pool {
+        struct mcdma_arena *arena;
+        uint8_t *base;
+        uint64_t phys;
+        size_t obj_size;                //rounded up to the granule
+        unsigned int count;
+        unsigned int top;               //free entries on the stack
+        uint32_t *stack;
+};
+
+int mcdma_pool_init(struct mcdma_pool *p, struct mcdma_arena *a, size_t obj_size, unsigned int count);
+void mcdma_pool_destroy(struct mcdma_pool *p);
+
+static inline void *mcdma_pool_get(struct mcdma_pool *p, uint64_t *phys)
+{
+        size_t off;
+
+        if (!p->top)
+                return NULL;
+        off = (size_t)p->stack[--p->top] * p->obj_size;
+        if (phys)
+                *phys = p->phys + off;
+        return p->base + off;
+}
+
+static inline void mcdma_pool_put(struct mcdma_pool *p, void *virt)
+{
+        p->stack[p->top++] = (uint32_t)(((uint8_t *)virt - p->base) / p->obj_size);
+}
+
+#endif
@@ -0,0 +1,2210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "mcdma.h"
+#include "mcdma_arena.h"
+#include "mcdma_engine.h"
+#include "mcdma_irq.h"
+#include "mcdma_pattern.h"
+#include "mcdma_queue.h"
+#include "mcdma_rx.h"
+#include "mcdma_sim.h"
+#include "mcdma_stats.h"
+#include "mcdma_stripe.h"
+
+//define mmap locations, same layout as mcdma_sg_reserve
+#define AXI_DMA_REGISTER_LOCATION          0xB0000000
+#define AXI_DMA1_REGISTER_LOCATION         0xB0001000
+#define MEMBLOCK_WIDTH                     0x3FFFFFF
+#define HP0_DMA_BUFFER_MEM_ADDRESS         0x40000000
+#define HP0_DMA_BUFFER_MEM_WIDTH           (MEMBLOCK_WIDTH + 1)
+#define SOURCE_MEM_WIDTH                   (HP0_DMA_BUFFER_MEM_WIDTH / 4 * 3)   //48MB, the rest is left for BD rings
+#define PL_LOOP_MEM_ADDRESS                0x80000000
+#define MAP_MEM_ADDRESS                    (HP0_DMA_BUFFER_MEM_ADDRESS + HP0_DMA_BUFFER_MEM_WIDTH)  //second HP0 block
+#define AXIDMA_SIM_LOCATION                0xB0010000           //the model's AXI DMA next to the MCDMA
+
+#define RECLAIM_BATCH                      32
+
+struct bench_ctx {
+        struct mcdma_platform *plat;
+        struct mcdma_dev dev;
+        struct mcdma_region region;
+        struct mcdma_arena arena;
+        uint8_t *src;
+        uint64_t src_phys;
+        int simulate;
+        struct mcdma_sim_params sim_params;     //from -S, benches that drive the model start from these
+        int uio_first;                  //channel n interrupt on /dev/uio<uio_first + n - 1>, -1 for none
+        enum mcdma_wait_mode mode;
+        unsigned long spin_ns;
+        uint64_t *lat;                  //submit to completion latencies in ns, NULL to skip
+        size_t nlat;
+        struct mcdma_stats stats;       //-m, page NULL when not publishing
+};
+
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static double now_sec(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// cpu time of the submitting thread only, the simulated engine runs elsewhere
+static double cpu_sec(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int chan_irq_open(struct bench_ctx *ctx, struct mcdma_irq *irq, unsigned int id)
+{
+        char path[32];
+
+        if (ctx->simulate)
+                return mcdma_irq_open_eventfd(irq, mcdma_sim_irq_fd(ctx->plat, AXI_DMA_REGISTER_LOCATION, id));
+        if (ctx->uio_first < 0) {
+                memset(irq, 0, sizeof(*irq));
+                return ctx->mode == MCDMA_WAIT_POLL ? 0 : -ENODEV;
+        }
+        snprintf(path, sizeof(path), "/dev/uio%d", ctx->uio_first + (int)id - 1);
+        return mcdma_irq_open_uio(irq, path);
+}
+
+/*********************************************************************/
+/*     one MM2S stream per channel, cycling through a buffer of      */
+/*     depth blocks and writing into its own slice of PL memory      */
+/*********************************************************************/
+struct bench_stream {
+        struct mcdma_chan ch;
+        struct mcdma_irq irq;
+        struct mcdma_arena *arena;
+        void *bd;                       //ring slab
+        uint64_t src;
+        uint64_t dst;
+        unsigned long queued;
+        unsigned long done;
+        uint64_t *ts;                   //submit time per ring slot
+};
+
+// also takes the stream streams_open() failed on, whose channel may never have been opened
+static void streams_close(struct bench_stream *st, unsigned int nch)
+{
+        unsigned int k;
+
+        for (k = 0; k < nch; k++) {
+                if (st[k].ch.dev) {
+                        mcdma_chan_stop(&st[k].ch);
+                        mcdma_chan_close(&st[k].ch);
+                }
+                mcdma_irq_close(&st[k].irq);
+                mcdma_arena_free(st[k].arena, st[k].bd);
+                free(st[k].ts);
+        }
+}
+
+// reset the engine and start nch channels, everything opened is closed again on failure
+static int streams_open(struct bench_ctx *ctx, struct bench_stream *st, unsigned int nch,
+                        unsigned int depth, uint32_t block)
+{
+        uint64_t span = (uint64_t)depth * block, bd_phys;
+        unsigned int k;
+        int ret = 0;
+
+        if (span * nch > SOURCE_MEM_WIDTH)
+                return -EINVAL;
+        if (mcdma_dev_reset(&ctx->dev))
+                return -EIO;
+
+        for (k = 0; k < nch && !ret; k++) {
+                struct bench_stream *s = &st[k];
+
+                memset(s, 0, sizeof(*s));
+                s->arena = &ctx->arena;
+                s->bd = mcdma_arena_alloc_bds(&ctx->arena, depth, &bd_phys);
+                ret = s->bd ? mcdma_chan_open(&s->ch, &ctx->dev, k + 1, s->bd, bd_phys, depth) : -ENOMEM;
+                if (!ret)
+                        ret = chan_irq_open(ctx, &s->irq, k + 1);
+                if (!ret) {
+                        s->ts = calloc(depth, sizeof(*s->ts));
+                        ret = s->ts ? 0 : -ENOMEM;
+                }
+                s->src = ctx->src_phys + k * span;
+                s->dst = PL_LOOP_MEM_ADDRESS + k * span;
+        }
+        if (ret) {
+                streams_close(st, k);
+                return ret;
+        }
+
+        for (k = 0; k < nch; k++)
+                mcdma_chan_start(&st[k].ch);
+        return mcdma_dev_run(&ctx->dev);
+}
+
+// push count blocks on every channel, returns -EIO on the first BD error
+static int streams_run(struct bench_ctx *ctx, struct bench_stream *st, unsigned int nch,
+                       unsigned int depth, uint32_t block, unsigned long count)
+{
+        struct mcdma_cpl cpl[RECLAIM_BATCH];
+        uint32_t app[MCDMA_BD_NUM_APP] = { 0, 0, 0, 0xFFFFFF00, 0x11111111 };
+        unsigned int k, busy = nch, got = 1;
+        int i, n, ret;
+
+        while (busy) {
+                // nothing came back last pass: wait on the first channel with work in flight
+                for (k = 0; !got && k < nch; k++) {
+                        if (st[k].ch.ring.inflight) {
+                                // Err_Irq is acked by the wait, so -EIO has to end the run here
+                                ret = mcdma_chan_wait(&st[k].ch, &st[k].irq, ctx->mode, ctx->spin_ns, 1000);
+                                if (ret == -ETIMEDOUT || ret == -EIO)
+                                        return ret;
+                                break;
+                        }
+                }
+                busy = 0;
+                got = 0;
+                for (k = 0; k < nch; k++) {
+                        struct bench_stream *s = &st[k];
+
+                        while (s->queued < count && mcdma_ring_space(&s->ch.ring)) {
+                                uint64_t off = (s->queued % depth) * (uint64_t)block;
+
+                                app[0] = DM_CMD_EOF | DM_CMD_TYPE_INCR | block;
+                                app[1] = (uint32_t)(s->dst + off);
+                                app[2] = (uint32_t)((s->dst + off) >> 32);
+                                if (ctx->lat)
+                                        s->ts[s->queued % depth] = now_ns();
+                                mcdma_ring_queue(&s->ch.ring, s->src + off, block,
+                                                 MCDMA_BD_CTRL_SOF | MCDMA_BD_CTRL_EOF, app, NULL);
+                                s->queued++;
+                        }
+                        mcdma_ring_kick(&s->ch.ring);
+                }
+                for (k = 0; k < nch; k++) {
+                        struct bench_stream *s = &st[k];
+
+                        n = mcdma_chan_reclaim(&s->ch, cpl, RECLAIM_BATCH);
+                        if (n && ctx->lat) {
+                                uint64_t t_done = now_ns();
+
+                                // BDs complete in submission order, slot of the i-th one is (done + i) % depth
+                                for (i = 0; i < n; i++)
+                                        ctx->lat[ctx->nlat++] = t_done - s->ts[(s->done + i) % depth];
+                        }
+                        for (i = 0; i < n; i++) {
+                                if (cpl[i].status & MCDMA_BD_STS_ERR_MASK)
+                                        return -EIO;
+                        }
+                        s->done += n;
+                        got += n;
+                        if (!n && (mcdma_chan_read(&s->ch, MCDMA_CH_SR) & MCDMA_CHSR_ERR_IRQ))
+                                return -EIO;
+                        if (s->done < count)
+                                busy = 1;
+                }
+        }
+        return 0;
+}
+
+/*********************************************************************/
+/*      chan: aggregate throughput as channel count scales 1..16     */
+/*********************************************************************/
+static int bench_chan(struct bench_ctx *ctx, int argc, char **argv)
+{
+        struct bench_stream st[MCDMA_MAX_CHANNELS];
+        unsigned int depth = 16, max_ch = MCDMA_MAX_CHANNELS, nch;
+        uint32_t block = 0x4000;
+        unsigned long count = 1024;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "b:d:n:c:")) != -1) {
+                switch (opt) {
+                case 'b': block = strtoul(optarg, NULL, 0); break;
+                case 'd': depth = strtoul(optarg, NULL, 0); break;
+                case 'n': count = strtoul(optarg, NULL, 0); break;
+                case 'c': max_ch = strtoul(optarg, NULL, 0); break;
+                default: return -EINVAL;
+                }
+        }
+        if (!block || block > DM_CMD_BTT_MASK || max_ch < 1 || max_ch > MCDMA_MAX_CHANNELS)
+                return -EINVAL;
+
+        printf("%8s %12s %12s %14s\n", "channels", "MB", "seconds", "aggregate MB/s");
+        for (nch = 1; nch <= max_ch; nch++) {
+                double t0, t1, mb;
+
+                if (streams_open(ctx, st, nch, depth, block)) {
+                        printf("%8u setup failed (depth %u too deep for %u channels?)\n", nch, depth, nch);
+                        return -EINVAL;
+                }
+                t0 = now_sec();
+                if (streams_run(ctx, st, nch, depth, block, count)) {
+                        printf("%8u transfer failed\n", nch);
+                        streams_close(st, nch);
+                        return -EIO;
+                }
+                t1 = now_sec();
+                streams_close(st, nch);
+
+                mb = (double)nch * count * block / 1e6;
+                printf("%8u %12.1f %12.4f %14.1f\n", nch, mb, t1 - t0, mb / (t1 - t0));
+        }
+        return 0;
+}
+
+/*********************************************************************/
+/*   irq: cpu time per transferred GB for poll, irq and hybrid       */
+/*   completion on the same workload                                 */
+/*********************************************************************/
+static int bench_irq(struct bench_ctx *ctx, int argc, char **argv)
+{
+        struct bench_stream st[MCDMA_MAX_CHANNELS];
+        static const enum mcdma_wait_mode modes[] = { MCDMA_WAIT_POLL, MCDMA_WAIT_IRQ, MCDMA_WAIT_HYBRID };
+        unsigned int depth = 16, nch = 1, m, k;
+        uint32_t block = 0x4000;
+        unsigned long count = 4096;
+        int opt, ret;
+
+        while ((opt = getopt(argc, argv, "b:d:n:c:")) != -1) {
+                switch (opt) {
+                case 'b': block = strtoul(optarg, NULL, 0); break;
+                case 'd': depth = strtoul(optarg, NULL, 0); break;
+                case 'n': count = strtoul(optarg, NULL, 0); break;
+                case 'c': nch = strtoul(optarg, NULL, 0); break;
+                default: return -EINVAL;
+                }
+        }
+        if (!block || block > DM_CMD_BTT_MASK || nch < 1 || nch > MCDMA_MAX_CHANNELS)
+                return -EINVAL;
+
+        printf("%8s %10s %12s %12s %14s %10s\n", "mode", "MB/s", "wall s", "cpu s", "cpu ms per GB", "irqs");
+        for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+                double t0, t1, c0, c1, gb;
+                uint64_t irqs = 0;
+
+                ctx->mode = modes[m];
+                if (streams_open(ctx, st, nch, depth, block)) {
+                        printf("%8s setup failed (no interrupt source? use -s or -u)\n", mcdma_wait_mode_name(modes[m]));
+                        continue;
+                }
+                t0 = now_sec();
+                c0 = cpu_sec();
+                ret = streams_run(ctx, st, nch, depth, block, count);
+                c1 = cpu_sec();
+                t1 = now_sec();
+                for (k = 0; k < nch; k++)
+                        irqs += st[k].irq.events;
+                streams_close(st, nch);
+                if (ret) {
+                        printf("%8s transfer failed\n", mcdma_wait_mode_name(modes[m]));
+                        return ret;
+                }
+
+                gb = (double)nch * count * block / 1e9;
+                printf("%8s %10.1f %12.4f %12.4f %14.2f %10llu\n", mcdma_wait_mode_name(modes[m]),
+                       gb * 1e3 / (t1 - t0), t1 - t0, c1 - c0, (c1 - c0) * 1e3 / gb, (unsigned long long)irqs);
+        }
+        return 0;
+}
+
+/*********************************************************************/
+/*   sweep: block size x ring depth x channels x completion mode,    */
+/*   sustained MB/s and submit-to-completion latency percentiles,    */
+/*   one CSV row per point                                           */
+/*********************************************************************/
+#define SWEEP_MAX_POINTS                   16
+
+static int parse_list(const char *s, unsigned long *v, int max)
+{
+        char *end;
+        int n = 0;
+
+        while (*s && n < max) {
+                v[n++] = strtoul(s, &end, 0);
+                if (end == s)
+                        return -EINVAL;
+                s = *end == ',' ? end + 1 : end;
+        }
+        return n ? n : -EINVAL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+        return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const uint64_t *sorted, size_t n, double p)
+{
+        size_t i = (size_t)(p / 100.0 * (n - 1) + 0.5);
+
+        return n ? sorted[i] / 1e3 : 0.0;
+}
+
+static int bench_sweep(struct bench_ctx *ctx, int argc, char **argv)
+{
+        struct bench_stream st[MCDMA_MAX_CHANNELS];
+        unsigned long blocks[SWEEP_MAX_POINTS] = { 0x1000, 0x4000, 0x10000 };
+        unsigned long depths[SWEEP_MAX_POINTS] = { 4, 16, 32 };
+        unsigned long chans[SWEEP_MAX_POINTS] = { 1, 4, 16 };
+        enum mcdma_wait_mode modes[3] = { MCDMA_WAIT_POLL, MCDMA_WAIT_IRQ };
+        int nb = 3, nd = 3, nc = 3, nm = 2;
+        unsigned long count = 1024;
+        const char *csv_path = "mcdma_sweep.csv";
+        int opt, b, d, c, m, ret = 0;
+        FILE *csv;
+
+        while ((opt = getopt(argc, argv, "b:d:c:w:n:o:")) != -1) {
+                switch (opt) {
+                case 'b': nb = parse_list(optarg, blocks, SWEEP_MAX_POINTS); break;
+                case 'd': nd = parse_list(optarg, depths, SWEEP_MAX_POINTS); break;
+                case 'c': nc = parse_list(optarg, chans, SWEEP_MAX_POINTS); break;
+                case 'n': count = strtoul(optarg, NULL, 0); break;
+                case 'o': csv_path = optarg; break;
+                case 'w': {
+                        char *s = optarg, *tok;
+
+                        for (nm = 0; nm < 3 && (tok = strtok(s, ",")); s = NULL) {
+                                if (mcdma_wait_mode_parse(tok, &modes[nm++]))
+                                        return -EINVAL;
+                        }
+                        break;
+                }
+                default: return -EINVAL;
+                }
+        }
+        if (nb < 0 || nd < 0 || nc < 0 || !nm || !count)
+                return -EINVAL;
+
+        csv = strcmp(csv_path, "-") ? fopen(csv_path, "w") : stdout;
+        if (!csv) {
+                perror(csv_path);
+                return -EIO;
+        }
+        fprintf(csv, "backend,block,depth,channels,mode,bytes,seconds,mbps,"
+                     "lat_p50_us,lat_p90_us,lat_p99_us,lat_p999_us,lat_max_us,cpu_ms_per_gb\n");
+
+        for (b = 0; b < nb; b++)
+        for (d = 0; d < nd; d++)
+        for (c = 0; c < nc; c++)
+        for (m = 0; m < nm; m++) {
+                unsigned int nch = chans[c], depth = depths[d];
+                uint32_t block = blocks[b];
+                double t0, t1, c0, c1, bytes;
+
+                if (!block || block > DM_CMD_BTT_MASK || nch < 1 || nch > MCDMA_MAX_CHANNELS)
+                        continue;
+                ctx->mode = modes[m];
+                ctx->nlat = 0;
+                ctx->lat = malloc(sizeof(*ctx->lat) * nch * count);
+                if (!ctx->lat) {
+                        ret = -ENOMEM;
+                        goto out;
+                }
+                ret = streams_open(ctx, st, nch, depth, block);
+                if (ret) {
+                        free(ctx->lat);
+                        ctx->lat = NULL;
+                        // point does not fit the descriptor / source region, skip it
+                        if (ret == -EINVAL || ret == -ENOMEM) {
+                                ret = 0;
+                                continue;
+                        }
+                        printf("block %u depth %u channels %u %s: start failed\n",
+                               block, depth, nch, mcdma_wait_mode_name(modes[m]));
+                        goto out;
+                }
+                t0 = now_sec();
+                c0 = cpu_sec();
+                ret = streams_run(ctx, st, nch, depth, block, count);
+                c1 = cpu_sec();
+                t1 = now_sec();
+                streams_close(st, nch);
+                if (ret) {
+                        printf("block %u depth %u channels %u %s: transfer failed\n",
+                               block, depth, nch, mcdma_wait_mode_name(modes[m]));
+                        free(ctx->lat);
+                        ctx->lat = NULL;
+                        goto out;
+                }
+
+                qsort(ctx->lat, ctx->nlat, sizeof(*ctx->lat), cmp_u64);
+                bytes = (double)nch * count * block;
+                fprintf(csv, "%s,%u,%u,%u,%s,%.0f,%.6f,%.1f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+                        ctx->plat->name, block, depth, nch, mcdma_wait_mode_name(modes[m]),
+                        bytes, t1 - t0, bytes / 1e6 / (t1 - t0),
+                        percentile_us(ctx->lat, ctx->nlat, 50), percentile_us(ctx->lat, ctx->nlat, 90),
+                        percentile_us(ctx->lat, ctx->nlat, 99), percentile_us(ctx->lat, ctx->nlat, 99.9),
+                        percentile_us(ctx->lat, ctx->nlat, 100), (c1 - c0) * 1e3 / (bytes / 1e9));
+                fflush(csv);
+                free(ctx->lat);
+                ctx->lat = NULL;
+        }
+
+out:
+        // the first failure ends the sweep and is the exit status, rows written so far are kept
+        if (csv != stdout) {
+                fclose(csv);
+                printf("wrote %s\n", csv_path);
+        }
+        return ret;
+}
+
+/*********************************************************************/
+/*   coalesce: one channel driven open loop at each offered load,    */
+/*   completions taken on the interrupt only.  Fixed runs keep the   */
+/*   threshold at -T (1 by default, an interrupt per packet),        */
+/*   adaptive runs let mcdma_coalesce retune it for a -t us budget.  */
+/*   Latency is submit to reap, so it includes the wakeup.           */
+/*********************************************************************/
+#define COALESCE_MAX_LOADS                 16
+#define COALESCE_STUCK_NS                  1000000000ll         //no interrupt for this long with BDs in flight
+
+struct coalesce_result {
+        double pps;
+        double p50_us;
+        double p99_us;
+        uint64_t irqs;
+        unsigned int thresh;
+        uint64_t writes;
+};
+
+static int coalesce_run(struct bench_ctx *ctx, unsigned int depth, uint32_t block, unsigned long count,
+                        unsigned long rate, struct mcdma_coalesce *co, unsigned int fixed, struct coalesce_result *res)
+{
+        struct bench_stream st;
+        struct mcdma_cpl cpl[RECLAIM_BATCH];
+        uint32_t app[MCDMA_BD_NUM_APP] = { 0, 0, 0, 0xFFFFFF00, 0x11111111 };
+        uint64_t period = rate ? 1000000000ull / rate : 0, t0, next, now;
+        size_t nlat = 0;
+        int ret = 0, i, n;
+
+        if (streams_open(ctx, &st, 1, depth, block))
+                return -EINVAL;
+        t0 = next = now_ns();
+        if (co)
+                mcdma_coalesce_start(co, &st.ch, t0);
+        else
+                mcdma_chan_set_coalesce(&st.ch, fixed, 0);
+
+        while (!ret && st.done < count) {
+                int64_t timeout;
+
+                now = now_ns();
+                while (st.queued < count && mcdma_ring_space(&st.ch.ring) && (!period || next <= now)) {
+                        uint64_t off = (st.queued % depth) * (uint64_t)block;
+
+                        app[0] = DM_CMD_EOF | DM_CMD_TYPE_INCR | block;
+                        app[1] = (uint32_t)(st.dst + off);
+                        app[2] = (uint32_t)((st.dst + off) >> 32);
+                        st.ts[st.queued % depth] = now;
+                        mcdma_ring_queue(&st.ch.ring, st.src + off, block, MCDMA_BD_CTRL_SOF | MCDMA_BD_CTRL_EOF,
+                                         app, NULL);
+                        st.queued++;
+                        next += period;
+                }
+                mcdma_ring_kick(&st.ch.ring);
+
+                n = mcdma_chan_reclaim(&st.ch, cpl, RECLAIM_BATCH);
+                if (n) {
+                        now = now_ns();
+                        for (i = 0; i < n; i++)
+                                ctx->lat[nlat++] = now - st.ts[(st.done + i) % depth];
+                        st.done += n;
+                        if (co)
+                                mcdma_coalesce_update(co, &st.ch, n, now);
+                        continue;
+                }
+
+                // ack before looking at the ring again, a completion racing with us raises a new event
+                if (mcdma_chan_ack(&st.ch, &st.irq) & MCDMA_CHSR_ERR_IRQ) {
+                        ret = -EIO;
+                        break;
+                }
+                if (mcdma_ring_peek(&st.ch.ring))
+                        continue;
+                now = now_ns();
+                timeout = st.queued < count && period ? (int64_t)(next - now) : -1;
+                if (timeout < 0 && !st.ch.ring.inflight)
+                        continue;
+                if (timeout < 0 || timeout > COALESCE_STUCK_NS)
+                        timeout = COALESCE_STUCK_NS;
+                if (!mcdma_irq_wait_ns(&st.irq, timeout) && timeout == COALESCE_STUCK_NS)
+                        ret = -ETIMEDOUT;
+        }
+        now = now_ns();
+
+        qsort(ctx->lat, nlat, sizeof(*ctx->lat), cmp_u64);
+        res->pps = st.done * 1e9 / (now - t0);
+        res->p50_us = percentile_us(ctx->lat, nlat, 50);
+        res->p99_us = percentile_us(ctx->lat, nlat, 99);
+        res->irqs = st.irq.events;
+        res->thresh = co ? co->thresh : fixed;
+        res->writes = co ? co->writes : 1;
+        streams_close(&st, 1);
+        return ret;
+}
+
+static int bench_coalesce(struct bench_ctx *ctx, int argc, char **argv)
+{
+        unsigned long loads[COALESCE_MAX_LOADS] = { 10000, 50000, 100000, 200000, 0 };
+        unsigned int depth = 64, fixed = 1, l, m;
+        unsigned long count = 20000, target_us = 50;
+        uint32_t block = 0x400;
+        int nl = 5, opt, ret = 0;
+
+        while ((opt = getopt(argc, argv, "b:d:n:r:t:T:")) != -1) {
+                switch (opt) {
+                case 'b': block = strtoul(optarg, NULL, 0); break;
+                case 'd': depth = strtoul(optarg, NULL, 0); break;
+                case 'n': count = strtoul(optarg, NULL, 0); break;
+                case 'r': nl = parse_list(optarg, loads, COALESCE_MAX_LOADS); break;
+                case 't': target_us = strtoul(optarg, NULL, 0); break;
+                case 'T': fixed = strtoul(optarg, NULL, 0); break;
+                default: return -EINVAL;
+                }
+        }
+        if (!block || block > DM_CMD_BTT_MASK || depth < 4 || !count || nl < 0 || !fixed || fixed > depth / 2 ||
+            fixed > MCDMA_CHCR_IRQ_MAX)
+                return -EINVAL;
+        ctx->lat = malloc(sizeof(*ctx->lat) * count);
+        if (!ctx->lat)
+                return -ENOMEM;
+
+        printf("%10s %9s %11s %9s %9s %9s %7s %9s\n", "offered/s", "mode", "packets/s", "p50 us", "p99 us",
+               "irq/pkt", "thresh", "CR writes");
+        for (l = 0; l < (unsigned int)nl && !ret; l++) {
+                for (m = 0; m < 2 && !ret; m++) {
+                        struct mcdma_coalesce co;
+                        struct coalesce_result res;
+                        char offered[16];
+
+                        mcdma_coalesce_init(&co, target_us * 1000, depth / 2);
+                        ret = coalesce_run(ctx, depth, block, count, loads[l], m ? &co : NULL, fixed, &res);
+                        if (ret) {
+                                printf("load %lu: transfer failed (no interrupt source? use -s or -u)\n", loads[l]);
+                                break;
+                        }
+                        snprintf(offered, sizeof(offered), loads[l] ? "%lu" : "max", loads[l]);
+                        printf("%10s %9s %11.0f %9.1f %9.1f %9.3f %7u %9llu\n", offered, m ? "adaptive" : "fixed",
+                               res.pps, res.p50_us, res.p99_us, (double)res.irqs / count, res.thresh,
+                               (unsigned long long)res.writes);
+                }
+        }
+        free(ctx->lat);
+        ctx->lat = NULL;
+        return ret;
+}
+
+/*********************************************************************/
+/*   bd: submit cost of one transfer of segs BDs, queued BD by BD    */
+/*   or instantiated from a chain template.  Register writes are     */
+/*   counted by a hook in front of the device, BD stores are         */
+/*   MCDMA_BD_STORES per BD on both paths.                           */
+/*********************************************************************/
+struct mmio_count {
+        struct mcdma_dev *dev;
+        void (*hook)(void *ctx, uint32_t off, uint32_t val);
+        void *hook_ctx;
+        unsigned long writes;
+};
+
+static void mmio_count_write(void *ctx, uint32_t off, uint32_t val)
+{
+        struct mmio_count *c = ctx;
+
+        c->writes++;
+        if (c->hook)
+                c->hook(c->hook_ctx, off, val);
+        else
+                c->dev->regs[off >> 2] = val;
+}
+
+static int bd_submit(struct bench_stream *s, const struct mcdma_chain *chain, uint32_t block, unsigned int segs,
+                     uint64_t src, uint64_t dst)
+{
+        uint32_t app[MCDMA_BD_NUM_APP] = { 0, 0, 0, 0xFFFFFF00, 0x11111111 };
+        uint32_t seg = block / segs;
+        unsigned int i;
+        int ret = 0;
+
+        if (chain)
+                return mcdma_ring_queue_chain(&s->ch.ring, chain, src, dst, NULL);
+        for (i = 0; i < segs && !ret; i++) {
+                app[0] = DM_CMD_EOF | DM_CMD_TYPE_INCR | block;
+                app[1] = (uint32_t)dst;
+                app[2] = (uint32_t)(dst >> 32);
+                ret = mcdma_ring_queue(&s->ch.ring, src + (uint64_t)i * seg, seg,
+                                       (i ? 0 : MCDMA_BD_CTRL_SOF) | (i == segs - 1 ? MCDMA_BD_CTRL_EOF : 0),
+                                       i ? NULL : app, NULL);
+        }
+        return ret;
+}
+
+static int bench_bd(struct bench_ctx *ctx, int argc, char **argv)
+{
+        static const char *const paths[] = { "queue", "chain" };
+        struct bench_stream st;
+        struct mcdma_chain chain;
+        struct mcdma_cpl cpl[RECLAIM_BATCH];
+        unsigned int depth = 64, segs = 4, p, i;
+        uint32_t block = 0x4000;
+        unsigned long count = 16384;
+        int opt, n, ret = 0;
+
+        while ((opt = getopt(argc, argv, "b:d:n:g:")) != -1) {
+                switch (opt) {
+                case 'b': block = strtoul(optarg, NULL, 0); break;
+                case 'd': depth = strtoul(optarg, NULL, 0); break;
+                case 'n': count = strtoul(optarg, NULL, 0); break;
+                case 'g': segs = strtoul(optarg, NULL, 0); break;
+                default: return -EINVAL;
+                }
+        }
+        if (!block || block > DM_CMD_BTT_MASK || !segs || block % segs || segs >= depth)
+                return -EINVAL;
+
+        // the template: same BDs bd_submit() builds, addresses relative to the bases
+        if (mcdma_chain_init(&chain, segs, MCDMA_CHAIN_APP_ADDR))
+                return -ENOMEM;
+        for (i = 0; i < segs; i++) {
+                uint32_t app[MCDMA_BD_NUM_APP] = { DM_CMD_EOF | DM_CMD_TYPE_INCR | block, 0, 0, 0xFFFFFF00, 0x11111111 };
+
+                mcdma_chain_set(&chain, i, (uint64_t)i * (block / segs), block / segs,
+                                (i ? 0 : MCDMA_BD_CTRL_SOF) | (i == segs - 1 ? MCDMA_BD_CTRL_EOF : 0),
+                                i ? NULL : app);
+        }
+
+        printf("%6s %5s %14s %16s %16s %10s\n", "path", "BDs", "submit ns/xfer", "MMIO writes/xfer",
+               "BD stores/xfer", "MB/s");
+        for (p = 0; p < sizeof(paths) / sizeof(paths[0]) && !ret; p++) {
+                struct mmio_count mc = { .dev = &ctx->dev, .hook = ctx->dev.reg_hook, .hook_ctx = ctx->dev.hook_ctx };
+                uint64_t t_submit = 0, t0;
+                unsigned long queued = 0, done = 0, slots = depth / segs;
+                double w0, w1;
+
+                if (streams_open(ctx, &st, 1, slots, block)) {
+                        ret = -EINVAL;
+                        break;
+                }
+                ctx->dev.reg_hook = mmio_count_write;
+                ctx->dev.hook_ctx = &mc;
+
+                w0 = now_sec();
+                while (done < count * segs) {
+                        t0 = now_ns();
+                        while (queued < count && mcdma_ring_space(&st.ch.ring) >= segs) {
+                                uint64_t off = (queued % slots) * (uint64_t)block;
+
+                                bd_submit(&st, p ? &chain : NULL, block, segs, st.src + off, st.dst + off);
+                                queued++;
+                        }
+                        mcdma_ring_kick(&st.ch.ring);
+                        t_submit += now_ns() - t0;
+
+                        n = mcdma_chan_reclaim(&st.ch, cpl, RECLAIM_BATCH);
+                        for (i = 0; i < (unsigned int)n; i++) {
+                                if (cpl[i].status & MCDMA_BD_STS_ERR_MASK)
+                                        ret = -EIO;
+                        }
+                        if (ret)
+                                break;
+                        done += n;
+                        if (!n)
+                                ret = mcdma_chan_wait(&st.ch, &st.irq, ctx->mode, ctx->spin_ns, 1000);
+                        if (ret == -ETIMEDOUT || ret == -EIO)
+                                break;
+                        ret = 0;
+                }
+                w1 = now_sec();
+
+                ctx->dev.reg_hook = mc.hook;
+                ctx->dev.hook_ctx = mc.hook_ctx;
+                streams_close(&st, 1);
+                if (ret) {
+                        printf("%6s transfer failed\n", paths[p]);
+                        break;
+                }
+                printf("%6s %5u %14.1f %16.3f %16u %10.1f\n", paths[p], segs, (double)t_submit / count,
+                       (double)mc.writes / count, segs * MCDMA_BD_STORES, (double)count * block / (w1 - w0) / 1e6);
+        }
+        mcdma_chain_free(&chain);
+        return ret;
+}
+
+/*********************************************************************/
+/*   sg: packets of 1 KB .. 64 MB spread over iov pieces in the      */
+/*   second reserved block, sent zero-copy with one BD list per      */
+/*   packet, against copying them block by block into the source     */
+/*   region first (the mcdma_sg_reserve way).  BTT is 23 bits, a     */
+/*   packet above it goes out as several datamover commands, each    */
+/*   its own SOF..EOF BD list for the next part of the PL buffer.    */
+/*********************************************************************/
+#define SG_MIN_PAYLOAD                     0x400
+#define SG_MAX_PAYLOAD                     HP0_DMA_BUFFER_MEM_WIDTH
+#define SG_MAX_PIECES                      64
+#define SG_DM_MAX                          (DM_CMD_BTT_MASK & ~(MCDMA_SPLIT_ALIGN - 1))
+#define SG_MAX_DM                          (SG_MAX_PAYLOAD / SG_DM_MAX + 1)
+
+// one datamover command: SOF..EOF over iov[first..first + n) with its own APP words
+struct sg_dm {
+        unsigned int first, n;
+        uint32_t app[MCDMA_BD_NUM_APP];
+};
+
+// a packet of the bench cut into datamover commands of at most SG_DM_MAX bytes, BTT being 23 bits
+struct sg_packet {
+        struct mcdma_iov iov[SG_MAX_PIECES + SG_MAX_DM];
+        struct sg_dm dm[SG_MAX_DM];
+        unsigned int ndm;
+};
+
+// each command writes its bytes to dst + offset, the sink sees the pieces back to back
+static void sg_packet_build(struct sg_packet *pkt, const struct mcdma_iov *iov, unsigned int n, uint64_t dst)
+{
+        struct sg_dm *dm = NULL;
+        unsigned int i, k = 0;
+        size_t left = 0, off;
+
+        pkt->ndm = 0;
+        for (i = 0; i < n; i++) {
+                for (off = 0; off < iov[i].len;) {
+                        size_t len;
+
+                        if (!left) {
+                                dm = &pkt->dm[pkt->ndm++];
+                                memset(dm, 0, sizeof(*dm));
+                                dm->first = k;
+                                dm->app[1] = (uint32_t)dst;
+                                dm->app[2] = (uint32_t)(dst >> 32);
+                                dm->app[3] = 0xFFFFFF00;
+                                dm->app[4] = 0x11111111;        //unused
+                                left = SG_DM_MAX;
+                        }
+                        len = iov[i].len - off < left ? iov[i].len - off : left;
+                        pkt->iov[k].phys = iov[i].phys + off;
+                        pkt->iov[k++].len = len;
+                        dm->n++;
+                        dm->app[0] += len;
+                        dst += len;
+                        off += len;
+                        left -= len;
+                }
+        }
+        for (i = 0; i < pkt->ndm; i++)
+                pkt->dm[i].app[0] |= DM_CMD_EOF | DM_CMD_TYPE_INCR;
+}
+
+static unsigned int sg_packet_bds(const struct sg_packet *pkt, uint32_t max_len)
+{
+        unsigned int i, bds = 0;
+
+        for (i = 0; i < pkt->ndm; i++)
+                bds += mcdma_iov_bds(&pkt->iov[pkt->dm[i].first], pkt->dm[i].n, max_len);
+        return bds;
+}
+
+// wait for and reclaim at least one BD, -EIO on a BD error
+static int sg_reclaim(struct bench_ctx *ctx, struct bench_stream *s)
+{
+        struct mcdma_cpl cpl[RECLAIM_BATCH];
+        int i, n;
+
+        while (!(n = mcdma_chan_reclaim(&s->ch, cpl, RECLAIM_BATCH))) {
+                if (mcdma_chan_read(&s->ch, MCDMA_CH_SR) & MCDMA_CHSR_ERR_IRQ)
+                        return -EIO;
+                n = mcdma_chan_wait(&s->ch, &s->irq, ctx->mode, ctx->spin_ns, 1000);
+                if (n == -ETIMEDOUT || n == -EIO)
+                        return n;
+        }
+        for (i = 0; i < n; i++) {
+                if (cpl[i].status & MCDMA_BD_STS_ERR_MASK)
+                        return -EIO;
+        }
+        s->done += n;
+        return n;
+}
+
+static int sg_drain(struct bench_ctx *ctx, struct bench_stream *s)
+{
+        int n = 0;
+
+        mcdma_ring_kick(&s->ch.ring);
+        while (s->ch.ring.inflight && (n = sg_reclaim(ctx, s)) > 0)
+                ;
+        return n < 0 ? n : 0;
+}
+
+static int sg_zero_copy(struct bench_ctx *ctx, struct bench_stream *s, const struct sg_packet *pkt,
+                        unsigned long packets)
+{
+        unsigned long p;
+        unsigned int d;
+        int ret;
+
+        for (p = 0; p < packets; p++) {
+                for (d = 0; d < pkt->ndm; d++) {
+                        const struct sg_dm *dm = &pkt->dm[d];
+
+                        while ((ret = mcdma_ring_queue_iov(&s->ch.ring, &pkt->iov[dm->first], dm->n, dm->app,
+                                                           NULL)) == -EBUSY) {
+                                mcdma_ring_kick(&s->ch.ring);
+                                if ((ret = sg_reclaim(ctx, s)) < 0)
+                                        return ret;
+                        }
+                        if (ret)
+                                return ret;
+                }
+        }
+        return sg_drain(ctx, s);
+}
+
+// gather block after block of the packet into the staging slots and send those
+static int sg_copy(struct bench_ctx *ctx, struct bench_stream *s, const struct sg_packet *pkt,
+                   const uint8_t *base, uint64_t base_phys, unsigned long packets, uint32_t block,
+                   unsigned int depth)
+{
+        unsigned long p;
+        unsigned int d, i, slot = 0;
+        int ret;
+
+        for (p = 0; p < packets; p++) {
+                for (d = 0; d < pkt->ndm; d++) {
+                        const struct sg_dm *dm = &pkt->dm[d];
+                        const struct mcdma_iov *iov = &pkt->iov[dm->first];
+                        size_t total = dm->app[0] & DM_CMD_BTT_MASK, sent = 0;
+
+                        for (i = 0; i < dm->n; i++) {
+                                size_t off = 0;
+
+                                while (off < iov[i].len) {
+                                        size_t len = iov[i].len - off < block ? iov[i].len - off : block;
+                                        uint64_t stage = s->src + (uint64_t)slot * block;
+
+                                        while (!mcdma_ring_space(&s->ch.ring)) {
+                                                mcdma_ring_kick(&s->ch.ring);
+                                                if ((ret = sg_reclaim(ctx, s)) < 0)
+                                                        return ret;
+                                        }
+                                        memcpy(ctx->src + (stage - ctx->src_phys),
+                                               base + (iov[i].phys - base_phys) + off, len);
+                                        mcdma_ring_queue(&s->ch.ring, stage, len,
+                                                         (sent ? 0 : MCDMA_BD_CTRL_SOF) |
+                                                         (sent + len == total ? MCDMA_BD_CTRL_EOF : 0),
+                                                         sent ? NULL : dm->app, NULL);
+                                        slot = (slot + 1) % depth;
+                                        off += len;
+                                        sent += len;
+                                }
+                        }
+                }
+                mcdma_ring_kick(&s->ch.ring);
+        }
+        return sg_drain(ctx, s);
+}
+
+static int bench_sg(struct bench_ctx *ctx, int argc, char **argv)
+{
+        struct mcdma_region app_region;
+        struct mcdma_iov iov[SG_MAX_PIECES];
+        struct sg_packet *pkt;
+        struct bench_stream st;
+        unsigned int depth = 256, pieces = 4, i, path;
+        uint32_t block = 0x4000, max_len = MCDMA_BD_LEN_MASK;
+        size_t size, piece;
+        int opt, ret = 0;
+
+        while ((opt = getopt(argc, argv, "b:d:i:l:")) != -1) {
+                switch (opt) {
+                case 'b': block = strtoul(optarg, NULL, 0); break;
+                case 'd': depth = strtoul(optarg, NULL, 0); break;
+                case 'i': pieces = strtoul(optarg, NULL, 0); break;
+                case 'l': max_len = strtoul(optarg, NULL, 0); break;
+                default: return -EINVAL;
+                }
+        }
+        if (!block || block > DM_CMD_BTT_MASK || depth < 2 || !pieces || pieces > SG_MAX_PIECES ||
+            max_len < MCDMA_SPLIT_ALIGN || max_len > MCDMA_BD_LEN_MASK)
+                return -EINVAL;
+
+        // the application buffers, filled once
+        if (mcdma_region_open_platform(&app_region, ctx->plat, MAP_MEM_ADDRESS, SG_MAX_PAYLOAD, MCDMA_CACHE_UNCACHED)) {
+                printf("application buffer block failed \n");
+                return -ENOMEM;
+        }
+        mcdma_pattern_fill(app_region.virt, SG_MAX_PAYLOAD / 4, MCDMA_PATTERN_PRBS, 1, 0);
+        pkt = malloc(sizeof(*pkt));
+        if (!pkt) {
+                mcdma_region_close(&app_region);
+                return -ENOMEM;
+        }
+
+        // one untimed pass so the first point does not pay for touching the PL memory
+        iov[0].phys = MAP_MEM_ADDRESS;
+        iov[0].len = SG_MAX_PAYLOAD;
+        sg_packet_build(pkt, iov, 1, PL_LOOP_MEM_ADDRESS);
+        if (streams_open(ctx, &st, 1, depth, block) == 0) {
+                ret = sg_zero_copy(ctx, &st, pkt, 1);
+                streams_close(&st, 1);
+        }
+
+        printf("%10s %6s %14s %12s %14s %12s\n", "payload", "BDs", "zero-copy MB/s", "cpu ms/GB", "copy MB/s",
+               "cpu ms/GB");
+        for (size = SG_MIN_PAYLOAD; size <= SG_MAX_PAYLOAD && !ret; size *= 4) {
+                // pieces in reverse order through the block, none adjacent to the next in the list
+                unsigned long packets = SG_MAX_PAYLOAD / size < 4096 ? SG_MAX_PAYLOAD / size : 4096;
+
+                if (packets < 4)
+                        packets = 4;
+                unsigned int n = size / MCDMA_SPLIT_ALIGN < pieces ? 1 : pieces;
+                double mbs[2], cpu[2];
+
+                piece = size / n;
+                for (i = 0; i < n; i++) {
+                        iov[i].phys = MAP_MEM_ADDRESS + (uint64_t)(n - 1 - i) * piece;
+                        iov[i].len = i == n - 1 ? size - piece * (n - 1) : piece;
+                }
+                sg_packet_build(pkt, iov, n, PL_LOOP_MEM_ADDRESS);
+
+                for (path = 0; path < 2 && !ret; path++) {
+                        double t0, c0;
+
+                        if (streams_open(ctx, &st, 1, depth, block)) {
+                                ret = -EINVAL;
+                                break;
+                        }
+                        st.ch.ring.max_len = max_len;
+                        t0 = now_sec();
+                        c0 = cpu_sec();
+                        ret = path ? sg_copy(ctx, &st, pkt, app_region.virt, app_region.phys, packets, block,
+                                             depth)
+                                   : sg_zero_copy(ctx, &st, pkt, packets);
+                        cpu[path] = (cpu_sec() - c0) * 1e3 / ((double)packets * size / 1e9);
+                        mbs[path] = (double)packets * size / (now_sec() - t0) / 1e6;
+                        streams_close(&st, 1);
+                }
+                if (ret == -E2BIG) {
+                        // nor will anything larger
+                        printf("%10zu does not fit a ring of %u BDs at %u bytes per BD\n", size, depth, max_len);
+                        ret = 0;
+                        break;
+                } else if (ret)
+                        printf("%10zu transfer failed\n", size);
+                else
+                        printf("%10zu %6u %14.1f %12.1f %14.1f %12.1f\n", size, sg_packet_bds(pkt, max_len),
+                               mbs[0], cpu[0], mbs[1], cpu[1]);
+        }
+        free(pkt);
+        mcdma_region_close(&app_region);
+        return ret;
+}
+
+/*********************************************************************/
+/*   queue: producer threads hammer the submission rings of all      */
+/*   channels and reap whatever completes on them, every cookie      */
+/*   must come back exactly once                                     */
+/*********************************************************************/
+struct queue_worker {
+        pthread_t thread;
+        struct mcdma_queue *q;
+        unsigned int id;
+        unsigned long count;            //packets this producer submits
+        uint32_t block;
+        uint64_t src;                   //first of count blocks in the source region
+        uint8_t *seen;                  //per cookie, shared by all workers
+        unsigned long *reaped;          //shared total
+        unsigned long total;
+        unsigned long full;             //submissions bounced off a full ring
+        unsigned long dups;
+        unsigned long errors;
+};
+
+// pop completions of every channel, 0 if none
+static unsigned int queue_worker_reap(struct queue_worker *w)
+{
+        struct mcdma_cpl cqe[MCDMA_QUEUE_REAP_BATCH];
+        unsigned int k, got = 0;
+        int i, n;
+
+        for (k = 0; k < w->q->nch; k++) {
+                n = mcdma_queue_reap(w->q, k, cqe, MCDMA_QUEUE_REAP_BATCH);
+                for (i = 0; i < n; i++) {
+                        uintptr_t c = (uintptr_t)cqe[i].cookie - 1;
+
+                        if (cqe[i].status & MCDMA_BD_STS_ERR_MASK)
+                                w->errors++;
+                        if (__atomic_exchange_n(&w->seen[c], 1, __ATOMIC_RELAXED))
+                                w->dups++;
+                }
+                got += n;
+        }
+        if (got)
+                __atomic_add_fetch(w->reaped, got, __ATOMIC_RELAXED);
+        return got;
+}
+
+static void *queue_worker_run(void *arg)
+{
+        struct queue_worker *w = arg;
+        unsigned int nch = w->q->nch;
+        unsigned long i;
+
+        for (i = 0; i < w->count; i++) {
+                uint64_t buf = w->src + (i % 64) * (uint64_t)w->block;
+                struct mcdma_sqe sqe = {
+                        .buf = buf,
+                        .len = w->block,
+                        .app = { DM_CMD_EOF | DM_CMD_TYPE_INCR | w->block, (uint32_t)PL_LOOP_MEM_ADDRESS,
+                                 0, 0xFFFFFF00, 0x11111111 },
+                        .cookie = (void *)(uintptr_t)((uint64_t)w->id * w->count + i + 1),
+                };
+
+                while (mcdma_queue_submit(w->q, (w->id + i) % nch, &sqe) == -EAGAIN) {
+                        w->full++;
+                        if (__atomic_load_n(&w->q->error, __ATOMIC_RELAXED))
+                                return NULL;
+                        if (!queue_worker_reap(w))
+                                sched_yield();
+                }
+        }
+        while (__atomic_load_n(w->reaped, __ATOMIC_RELAXED) < w->total) {
+                if (__atomic_load_n(&w->q->error, __ATOMIC_RELAXED))
+                        break;
+                if (!queue_worker_reap(w))
+                        sched_yield();
+        }
+        return NULL;
+}
+
+// doorbell to completion latency over all channels, from the published histograms
+static void stats_print(const struct mcdma_queue *q)
+{
+        uint64_t lat[MCDMA_STATS_LAT_BUCKETS] = { 0 }, count = 0, sum = 0, seen = 0;
+        unsigned int k, b;
+
+        for (k = 0; k < q->nch; k++) {
+                const struct mcdma_stats_chan *s = q->qc[k].stats;
+
+                for (b = 0; b < MCDMA_STATS_LAT_BUCKETS; b++)
+                        lat[b] += mcdma_stats_get(&s->lat[b]);
+                count += mcdma_stats_get(&s->lat_count);
+                sum += mcdma_stats_get(&s->lat_sum_ns);
+        }
+        for (b = 0; b < MCDMA_STATS_LAT_BUCKETS - 1 && (seen += lat[b]) * 100 < count * 99; b++)
+                ;
+        printf("published to /dev/shm%s: latency mean %.1f us, p99 below %.1f us\n", q->stats->path,
+               count ? sum / 1e3 / count : 0, (double)(1ull << (b + MCDMA_STATS_LAT_SHIFT)) / 1e3);
+}
+
+static int bench_queue(struct bench_ctx *ctx, int argc, char **argv)
+{
+        struct bench_stream st[MCDMA_MAX_CHANNELS];
+        struct mcdma_chan *chans[MCDMA_MAX_CHANNELS];
+        struct queue_worker *w;
+        struct mcdma_queue q;
+        unsigned int depth = 64, nch = 4, nthreads = 4, sq_depth = 256, k;
+        uint32_t block = 0x1000;
+        unsigned long count = 100000, reaped = 0, full = 0, dups = 0, errors = 0, missing = 0, total, i;
+        uint64_t doorbells = 0, recovered = 0, retried = 0, skipped = 0;
+        uint8_t *seen;
+        double t0, t1;
+        int opt, recover = -1, ret = 0;
+
+        while ((opt = getopt(argc, argv, "b:c:d:n:q:t:R:")) != -1) {
+                switch (opt) {
+                case 'R':
+                        if (!strcmp(optarg, "skip"))
+                                recover = 0;
+                        else if (!strcmp(optarg, "retry"))
+                                recover = MCDMA_RECOVER_RETRY;
+                        else
+                                return -EINVAL;
+                        break;
+                case 'b': block = strtoul(optarg, NULL, 0); break;
+                case 'c': nch = strtoul(optarg, NULL, 0); break;
+                case 'd': depth = strtoul(optarg, NULL, 0); break;
+                case 'n': count = strtoul(optarg, NULL, 0); break;
+                case 'q': sq_depth = strtoul(optarg, NULL, 0); break;
+                case 't': nthreads = strtoul(optarg, NULL, 0); break;
+                default: return -EINVAL;
+                }
+        }
+        if (!block || block > DM_CMD_BTT_MASK || nch < 1 || nch > MCDMA_MAX_CHANNELS || !nthreads || !count ||
+            (uint64_t)nthreads * 64 * block > SOURCE_MEM_WIDTH)
+                return -EINVAL;
+
+        total = nthreads * count;
+        seen = calloc(total, 1);
+        w = calloc(nthreads, sizeof(*w));
+        if (!seen || !w || streams_open(ctx, st, nch, depth, block)) {
+                free(seen);
+                free(w);
+                return -ENOMEM;
+        }
+        for (k = 0; k < nch; k++)
+                chans[k] = &st[k].ch;
+        if (mcdma_queue_init(&q, chans, nch, sq_depth, sq_depth) ||
+            (ctx->stats.page && mcdma_queue_attach_stats(&q, &ctx->stats)) ||
+            (recover >= 0 && mcdma_queue_set_recover(&q, recover)) || mcdma_queue_start(&q)) {
+                streams_close(st, nch);
+                free(seen);
+                free(w);
+                return -EINVAL;
+        }
+
+        t0 = now_sec();
+        for (k = 0; k < nthreads; k++) {
+                w[k] = (struct queue_worker){ .q = &q, .id = k, .count = count, .block = block,
+                                              .src = ctx->src_phys + (uint64_t)k * 64 * block, .seen = seen,
+                                              .reaped = &reaped, .total = total };
+                pthread_create(&w[k].thread, NULL, queue_worker_run, &w[k]);
+        }
+        for (k = 0; k < nthreads; k++) {
+                pthread_join(w[k].thread, NULL);
+                full += w[k].full;
+                dups += w[k].dups;
+                errors += w[k].errors;
+        }
+        t1 = now_sec();
+        mcdma_queue_stop(&q);
+
+        for (k = 0; k < nch; k++) {
+                doorbells += q.qc[k].doorbells;
+                recovered += st[k].ch.recovered;
+                retried += st[k].ch.retried;
+                skipped += st[k].ch.skipped;
+        }
+        for (i = 0; i < total; i++)
+                missing += !seen[i];
+        // with recovery the packets of skipped BDs are the only ones allowed to fail
+        if (q.error || errors != (recover >= 0 ? skipped : 0) || dups || missing)
+                ret = -EIO;
+
+        printf("%u producers, %u channels, %lu packets of %u bytes\n", nthreads, nch, total, block);
+        printf("%.3f s, %.0f packets/s, %.1f MB/s\n", t1 - t0, total / (t1 - t0), (double)total * block / (t1 - t0) / 1e6);
+        printf("TAILDESC writes %llu, %.2f packets per doorbell, %lu submissions bounced off a full ring\n",
+               (unsigned long long)doorbells, doorbells ? (double)total / doorbells : 0, full);
+        printf("errors %lu, duplicate completions %lu, missing completions %lu%s\n", errors, dups, missing,
+               ret ? " FAILED" : "");
+        if (recover >= 0)
+                printf("faults recovered %llu, BDs retried %llu, skipped %llu\n", (unsigned long long)recovered,
+                       (unsigned long long)retried, (unsigned long long)skipped);
+        if (q.stats)
+                stats_print(&q);
+
+        mcdma_queue_destroy(&q);
+        streams_close(st, nch);
+        free(seen);
+        free(w);
+        return ret;
+}
+
+/*********************************************************************/
+/*   S2MM receive: every channel's ring stays armed from a pool of   */
+/*   depth + extra buffers, the consumer checks and returns every    */
+/*   buffer and stalls for -s us every -e packets.  With the model   */
+/*   the source runs at -r packets/s per channel and holds -f        */
+/*   packets while starved, its stalls and drops are reported next   */
+/*   to the starvation the consumer saw.  On hardware the PL feeds   */
+/*   the channels and only the consumer side is reported.            */
+/*********************************************************************/
+#define RX_POLL_BATCH                      32
+#define RX_IDLE_TIMEOUT                    1.0                  //s without a packet that ends the run
+
+struct rx_stream {
+        struct mcdma_chan ch;
+        struct mcdma_pool pool;
+        struct mcdma_rx rx;
+        void *bd;
+        uint64_t next_seq;              //expected sequence number of the next SOF buffer
+        unsigned long gaps;             //packets missing from the sequence
+        unsigned long bad;              //TID/TUSER/payload not what the model sent
+};
+
+// the model's packet: sequence number, then its low byte, TUSER the low 16 bits, TID the channel
+static void rx_check(struct rx_stream *s, unsigned int id, const struct mcdma_rx_buf *b)
+{
+        const uint8_t *p = b->virt;
+        uint64_t seq;
+        uint32_t i;
+
+        if (!(b->status & MCDMA_BD_STS_RXSOF) || b->len < sizeof(seq))
+                return;
+        memcpy(&seq, p, sizeof(seq));
+        if (seq > s->next_seq)
+                s->gaps += seq - s->next_seq;
+        s->next_seq = seq + 1;
+        if (b->tid != id - 1 || b->tuser != (uint16_t)seq)
+                s->bad++;
+        for (i = sizeof(seq); i < b->len; i += 61) {
+                if (p[i] != (uint8_t)seq) {
+                        s->bad++;
+                        break;
+                }
+        }
+}
+
+static void rx_streams_close(struct bench_ctx *ctx, struct rx_stream *st, unsigned int nch)
+{
+        unsigned int k;
+
+        for (k = 0; k < nch; k++) {
+                if (st[k].rx.ch)
+                        mcdma_rx_stop(&st[k].rx);
+                mcdma_chan_close(&st[k].ch);
+                mcdma_pool_destroy(&st[k].pool);
+                mcdma_arena_free(&ctx->arena, st[k].bd);
+        }
+}
+
+static int bench_rx(struct bench_ctx *ctx, int argc, char **argv)
+{
+        struct rx_stream st[MCDMA_MAX_CHANNELS];
+        struct mcdma_rx_buf buf[RX_POLL_BATCH];
+        struct mcdma_stats_chan *slot[MCDMA_MAX_CHANNELS] = { NULL };
+        struct mcdma_sim_params params = ctx->sim_params;
+        unsigned int nch = 1, depth = 256, extra = 256, k;
+        uint32_t pkt_len = 1500, buf_len = 2048;
+        unsigned long count = 100000, stall_every = 0, stall_us = 0, since_stall = 0, rate = 0, fifo = 0;
+        uint64_t packets = 0, bytes = 0, starved = 0, no_buf = 0, doorbells = 0, errors = 0, gaps = 0, bad = 0;
+        uint64_t stalls = 0, stall_ns = 0, dropped = 0, bd_phys, publish = 0, now;
+        double t0, t1, last;
+        int opt, ret = 0, i, n;
+
+        while ((opt = getopt(argc, argv, "b:c:d:e:f:l:n:r:s:x:")) != -1) {
+                switch (opt) {
+                case 'b': buf_len = strtoul(optarg, NULL, 0); break;
+                case 'c': nch = strtoul(optarg, NULL, 0); break;
+                case 'd': depth = strtoul(optarg, NULL, 0); break;
+                case 'e': stall_every = strtoul(optarg, NULL, 0); break;
+                case 'f': fifo = strtoul(optarg, NULL, 0); break;
+                case 'l': pkt_len = strtoul(optarg, NULL, 0); break;
+                case 'n': count = strtoul(optarg, NULL, 0); break;
+                case 'r': rate = strtoul(optarg, NULL, 0); break;
+                case 's': stall_us = strtoul(optarg, NULL, 0); break;
+                case 'x': extra = strtoul(optarg, NULL, 0); break;
+                default: return -EINVAL;
+                }
+        }
+        if (nch < 1 || nch > MCDMA_MAX_CHANNELS || depth < 2 || !count || buf_len < 64 || !pkt_len ||
+            pkt_len > MCDMA_BD_LEN_MASK)
+                return -EINVAL;
+
+        if (ctx->simulate) {
+                params.rx_len = pkt_len;
+                params.rx_pps = rate;
+                params.rx_fifo = fifo;
+                params.rx_count = count;
+                mcdma_sim_set_params(ctx->plat, AXI_DMA_REGISTER_LOCATION, &params);
+        }
+        if (mcdma_dev_reset(&ctx->dev))
+                return -EIO;
+        memset(st, 0, sizeof(st));
+        for (k = 0; k < nch && !ret; k++) {
+                struct rx_stream *s = &st[k];
+
+                s->bd = mcdma_arena_alloc_bds(&ctx->arena, depth, &bd_phys);
+                ret = s->bd ? mcdma_chan_open_s2mm(&s->ch, &ctx->dev, k + 1, s->bd, bd_phys, depth) : -ENOMEM;
+                if (!ret)
+                        ret = mcdma_pool_init(&s->pool, &ctx->arena, buf_len, depth + extra);
+                if (!ret)
+                        ret = mcdma_rx_init(&s->rx, &s->ch, &s->pool, 0);
+                if (!ret && ctx->stats.page && !(slot[k] = mcdma_stats_slot(&ctx->stats, &s->ch)))
+                        ret = -ENOSPC;
+        }
+        if (ret) {
+                // a stream that failed half way is closed with the rest, its pool and ring may be empty
+                rx_streams_close(ctx, st, k);
+                return ret == -EINVAL || ret == -ENOSPC ? ret : -ENOMEM;
+        }
+        ret = mcdma_dev_run(&ctx->dev);
+        for (k = 0; k < nch && !ret; k++)
+                ret = mcdma_rx_start(&st[k].rx);
+
+        t0 = last = now_sec();
+        while (!ret) {
+                uint64_t total = 0;
+                unsigned int got = 0;
+
+                for (k = 0; k < nch; k++) {
+                        struct rx_stream *s = &st[k];
+
+                        n = mcdma_rx_poll(&s->rx, buf, RX_POLL_BATCH);
+                        for (i = 0; i < n; i++) {
+                                if (ctx->simulate)
+                                        rx_check(s, k + 1, &buf[i]);
+                                since_stall += !!(buf[i].status & MCDMA_BD_STS_RXEOF);
+                                mcdma_rx_put(&s->rx, buf[i].virt);
+                        }
+                        got += n;
+                        total += s->ch.packets;
+                }
+                if (ctx->stats.page && (now = mcdma_stats_now()) >= publish) {
+                        publish = now + MCDMA_STATS_PERIOD_NS;
+                        for (k = 0; k < nch; k++)
+                                mcdma_stats_publish(slot[k], &st[k].ch, now);
+                }
+                if (got) {
+                        last = now_sec();
+                } else if (ctx->simulate) {
+                        struct mcdma_sim_rx_stats ss;
+
+                        for (k = 0, dropped = 0; k < nch; k++) {
+                                if (!mcdma_sim_rx_stats(ctx->plat, AXI_DMA_REGISTER_LOCATION, k + 1, &ss))
+                                        dropped += ss.dropped;
+                        }
+                }
+                if (total + dropped >= (uint64_t)count * nch)
+                        break;
+                if (!got && now_sec() - last > RX_IDLE_TIMEOUT) {
+                        printf("no packet for %.1f s, stopping\n", RX_IDLE_TIMEOUT);
+                        break;
+                }
+                if (!got)
+                        sched_yield();
+
+                // the briefly slow consumer, the ring and the spare buffers have to cover it
+                if (stall_every && since_stall >= stall_every) {
+                        struct timespec ts = { .tv_sec = stall_us / 1000000, .tv_nsec = stall_us % 1000000 * 1000 };
+
+                        since_stall = 0;
+                        nanosleep(&ts, NULL);
+                }
+        }
+        t1 = last;
+
+        for (k = 0, dropped = 0; k < nch; k++) {
+                struct mcdma_sim_rx_stats ss;
+
+                packets += st[k].ch.packets;
+                bytes += st[k].ch.bytes;
+                errors += st[k].ch.errors;
+                starved += st[k].rx.starved;
+                no_buf += st[k].rx.no_buf;
+                doorbells += st[k].rx.doorbells;
+                gaps += st[k].gaps;
+                bad += st[k].bad;
+                mcdma_stats_publish(slot[k], &st[k].ch, mcdma_stats_now());
+                if (ctx->simulate && !mcdma_sim_rx_stats(ctx->plat, AXI_DMA_REGISTER_LOCATION, k + 1, &ss)) {
+                        stalls += ss.stalls;
+                        stall_ns += ss.stall_ns;
+                        dropped += ss.dropped;
+                }
+        }
+        if (errors || bad || (ctx->simulate && gaps != dropped))
+                ret = -EIO;
+
+        printf("%u channels, %llu packets of %u bytes into %u byte buffers, ring %u + %u spare buffers\n", nch,
+               (unsigned long long)packets, pkt_len, st[0].rx.buf_len, depth, extra);
+        printf("%.3f s, %.0f packets/s, %.1f MB/s\n", t1 - t0, packets / (t1 - t0), bytes / (t1 - t0) / 1e6);
+        printf("ring ran dry %llu times, %llu refills found the pool empty, %.1f buffers per TAILDESC write\n",
+               (unsigned long long)starved, (unsigned long long)no_buf,
+               doorbells ? (double)(packets * ((pkt_len + st[0].rx.buf_len - 1) / st[0].rx.buf_len)) / doorbells : 0);
+        if (ctx->simulate) {
+                printf("source stalled %llu times for %.3f ms, dropped %llu packets\n", (unsigned long long)stalls,
+                       stall_ns / 1e6, (unsigned long long)dropped);
+                printf("sequence gaps %llu, bad packets %llu, BD errors %llu%s\n", (unsigned long long)gaps,
+                       (unsigned long long)bad, (unsigned long long)errors, ret ? " FAILED" : "");
+        }
+        rx_streams_close(ctx, st, nch);
+        return ret;
+}
+
+/*********************************************************************/
+/*   engines: the same MM2S workload on every engine given with -a,  */
+/*   each detected at run time (DMASR or the device tree node under  */
+/*   -D) and driven by a loop compiled for its traits.  The model    */
+/*   puts an AXI DMA next to the MCDMA.  One channel is the fair     */
+/*   comparison, the MCDMA is run again with -c channels.            */
+/*********************************************************************/
+#define ENGINE_MAX_ADDRS                   4
+
+struct engine_run {
+        struct mcdma_chan ch[MCDMA_MAX_CHANNELS];
+        void *bd[MCDMA_MAX_CHANNELS];
+        unsigned long queued[MCDMA_MAX_CHANNELS];
+        unsigned long done[MCDMA_MAX_CHANNELS];
+        unsigned int nch;
+};
+
+static inline __attribute__((always_inline)) int engine_loop(const struct mcdma_engine_traits *t,
+                                                             struct engine_run *r, uint64_t src, unsigned int depth,
+                                                             uint32_t block, unsigned long count)
+{
+        struct mcdma_cpl cpl[RECLAIM_BATCH];
+        uint32_t app[MCDMA_BD_NUM_APP] = { 0, 0, 0, 0xFFFFFF00, 0x11111111 };
+        uint64_t span = (uint64_t)depth * block;
+        unsigned int k, busy = 1;
+        int i, n;
+
+        while (busy) {
+                busy = 0;
+                for (k = 0; k < r->nch; k++) {
+                        struct mcdma_ring *ring = &r->ch[k].ring;
+                        uint64_t dst = PL_LOOP_MEM_ADDRESS + k * span;
+
+                        while (r->queued[k] < count && mcdma_ring_space(ring)) {
+                                uint64_t off = (r->queued[k] % depth) * (uint64_t)block;
+
+                                app[0] = DM_CMD_EOF | DM_CMD_TYPE_INCR | block;
+                                app[1] = (uint32_t)(dst + off);
+                                app[2] = (uint32_t)((dst + off) >> 32);
+                                mcdma_engine_queue_t(t, ring, src + k * span + off, block,
+                                                     MCDMA_BD_CTRL_SOF | MCDMA_BD_CTRL_EOF, app, NULL);
+                                r->queued[k]++;
+                        }
+                        mcdma_ring_kick(ring);
+                }
+                for (k = 0; k < r->nch; k++) {
+                        n = mcdma_chan_reclaim(&r->ch[k], cpl, RECLAIM_BATCH);
+                        for (i = 0; i < n; i++) {
+                                if (cpl[i].status & MCDMA_BD_STS_ERR_MASK)
+                                        return -EIO;
+                        }
+                        r->done[k] += n;
+                        if (!n && mcdma_engine_failed_t(t, &r->ch[k]))
+                                return -EIO;
+                        if (r->done[k] < count)
+                                busy = 1;
+                }
+                if (busy)
+                        sched_yield();          //the model may share the core
+        }
+        return 0;
+}
+
+static int engine_loop_mcdma(struct engine_run *r, uint64_t src, unsigned int depth, uint32_t block,
+                             unsigned long count)
+{
+        return engine_loop(&mcdma_traits_mcdma, r, src, depth, block, count);
+}
+
+static int engine_loop_axidma(struct engine_run *r, uint64_t src, unsigned int depth, uint32_t block,
+                              unsigned long count)
+{
+        return engine_loop(&mcdma_traits_axidma, r, src, depth, block, count);
+}
+
+static int engine_once(struct bench_ctx *ctx, struct mcdma_engine *eng, unsigned int nch, unsigned int depth,
+                       uint32_t block, unsigned long count)
+{
+        struct engine_run r;
+        double t0, t1, c0, c1;
+        uint64_t bd_phys;
+        unsigned int k;
+        int ret = 0;
+
+        memset(&r, 0, sizeof(r));
+        if ((uint64_t)depth * block * nch > SOURCE_MEM_WIDTH || mcdma_engine_reset(eng))
+                return -EINVAL;
+        for (k = 0; k < nch && !ret; k++) {
+                r.bd[k] = mcdma_arena_alloc_bds(&ctx->arena, depth, &bd_phys);
+                ret = r.bd[k] ? mcdma_engine_chan_open(eng, &r.ch[k], k + 1, r.bd[k], bd_phys, depth) : -ENOMEM;
+                r.nch += !ret;
+        }
+        for (k = 0; k < r.nch && !ret; k++)
+                ret = mcdma_engine_chan_start(eng, &r.ch[k]);
+        if (!ret)
+                ret = mcdma_engine_run(eng);
+
+        t0 = now_sec();
+        c0 = cpu_sec();
+        if (!ret)
+                ret = eng->type == MCDMA_ENGINE_AXIDMA ? engine_loop_axidma(&r, ctx->src_phys, depth, block, count)
+                                                       : engine_loop_mcdma(&r, ctx->src_phys, depth, block, count);
+        c1 = cpu_sec();
+        t1 = now_sec();
+
+        if (!ret)
+                printf("%-8s 0x%08llx %8u %12.1f %12.0f %14.0f\n", eng->t->name, (unsigned long long)eng->dev->phys,
+                       nch, (double)nch * count * block / (t1 - t0) / 1e6, nch * count / (t1 - t0),
+                       (c1 - c0) * 1e9 / ((double)nch * count));
+        else
+                printf("%-8s 0x%08llx %8u failed: %s\n", eng->t->name, (unsigned long long)eng->dev->phys, nch,
+                       strerror(-ret));
+        for (k = 0; k < r.nch; k++) {
+                mcdma_engine_chan_stop(eng, &r.ch[k]);
+                mcdma_chan_close(&r.ch[k]);
+        }
+        for (k = 0; k < nch; k++)
+                mcdma_arena_free(&ctx->arena, r.bd[k]);
+        return ret;
+}
+
+static int bench_engines(struct bench_ctx *ctx, int argc, char **argv)
+{
+        uint64_t addr[ENGINE_MAX_ADDRS] = { AXI_DMA_REGISTER_LOCATION, AXIDMA_SIM_LOCATION };
+        unsigned int naddr = ctx->simulate ? 2 : 1, depth = 64, nch = 4, a;
+        uint32_t block = 0x4000;
+        unsigned long count = 4096;
+        const char *dt_dir = NULL;
+        char *p, *end;
+        int opt, ret = 0;
+
+        while ((opt = getopt(argc, argv, "a:b:c:d:n:D:")) != -1) {
+                switch (opt) {
+                case 'a':
+                        for (naddr = 0, p = optarg; *p && naddr < ENGINE_MAX_ADDRS; p = *end ? end + 1 : end) {
+                                addr[naddr++] = strtoull(p, &end, 0);
+                                if (end == p)
+                                        return -EINVAL;
+                        }
+                        break;
+                case 'b': block = strtoul(optarg, NULL, 0); break;
+                case 'c': nch = strtoul(optarg, NULL, 0); break;
+                case 'd': depth = strtoul(optarg, NULL, 0); break;
+                case 'n': count = strtoul(optarg, NULL, 0); break;
+                case 'D': dt_dir = optarg; break;
+                default: return -EINVAL;
+                }
+        }
+        if (!block || block > DM_CMD_BTT_MASK || nch < 1 || nch > MCDMA_MAX_CHANNELS || depth < 2 || !count)
+                return -EINVAL;
+        if (ctx->simulate && mcdma_sim_add_engine(ctx->plat, AXIDMA_SIM_LOCATION, MCDMA_SIM_AXIDMA))
+                return -ENOMEM;
+
+        printf("%-8s %10s %8s %12s %12s %14s\n", "engine", "address", "channels", "MB/s", "packets/s", "cpu ns/packet");
+        for (a = 0; a < naddr; a++) {
+                struct mcdma_engine eng;
+                struct mcdma_dev dev;
+                char node[256];
+
+                if (mcdma_dev_open(&dev, ctx->plat, addr[a])) {
+                        printf("0x%08llx: cannot map\n", (unsigned long long)addr[a]);
+                        ret = -EIO;
+                        continue;
+                }
+                if (dt_dir)
+                        snprintf(node, sizeof(node), "%s/dma@%llx", dt_dir, (unsigned long long)addr[a]);
+                if (mcdma_engine_open(&eng, &dev, dt_dir ? node : NULL)) {
+                        printf("0x%08llx: unknown engine\n", (unsigned long long)addr[a]);
+                        mcdma_dev_close(&dev);
+                        ret = -EIO;
+                        continue;
+                }
+                if (engine_once(ctx, &eng, 1, depth, block, count))
+                        ret = -EIO;
+                if (eng.t->nchan > 1 && nch > 1 && engine_once(ctx, &eng, nch, depth, block, count))
+                        ret = -EIO;
+                mcdma_dev_close(&dev);
+        }
+        return ret;
+}
+
+/*********************************************************************/
+/*   stripe: 1..N engines driven as one logical MM2S device through  */
+/*   mcdma_stripe, channel 1 of each engine is a lane.  Every stream */
+/*   pushes -n transfers of -b bytes cut into -k byte pieces, the    */
+/*   run is repeated with one engine more each time.  The model puts */
+/*   the engines every 4 KB from DMA0 (DMA1 is the second one) and   */
+/*   caps each at its -B bandwidth, so MB/s should grow with the     */
+/*   engine count.  Completions have to come back in submission      */
+/*   order within each stream, any that do not are counted.          */
+/*********************************************************************/
+#define STRIPE_SIM_BW_MBPS                 400                  //per model engine when neither -B nor -S set one
+
+struct stripe_engine {
+        struct mcdma_dev dev;
+        struct mcdma_engine eng;
+        struct mcdma_chan ch;
+        void *bd;
+        int open;
+};
+
+struct stripe_result {
+        double mbps;
+        double tps;                     //transfers per second
+        double bds;                     //BDs per transfer
+        double lo, hi;                  //smallest and largest lane share of the bytes, %
+        unsigned long disorder;         //completions out of stream order
+};
+
+static int stripe_once(struct bench_ctx *ctx, struct stripe_engine *e, unsigned int neng, unsigned int nstreams,
+                       unsigned int depth, unsigned int ring, uint32_t block, uint32_t chunk, unsigned long count,
+                       struct stripe_result *res)
+{
+        struct mcdma_cpl cpl[RECLAIM_BATCH];
+        uint32_t app[MCDMA_BD_NUM_APP] = { 0, 0, 0, 0xFFFFFF00, 0x11111111 };
+        uint64_t span = (uint64_t)depth * block, bd_phys, bytes = 0, lo = ~0ull, hi = 0;
+        unsigned long *sent, *done, total = 0, disorder = 0;
+        struct mcdma_stripe s;
+        unsigned int k, opened = 0;
+        double t0, t1;
+        int i, n, ret;
+
+        ret = mcdma_stripe_init(&s, nstreams, depth, chunk);
+        if (ret)
+                return ret;
+        sent = calloc(nstreams, sizeof(*sent));
+        done = calloc(nstreams, sizeof(*done));
+        if (!sent || !done)
+                ret = -ENOMEM;
+
+        for (k = 0; k < neng && !ret; k++) {
+                ret = mcdma_engine_reset(&e[k].eng) ? -EIO : 0;
+                if (!ret) {
+                        e[k].bd = mcdma_arena_alloc_bds(&ctx->arena, ring, &bd_phys);
+                        ret = e[k].bd ? mcdma_engine_chan_open(&e[k].eng, &e[k].ch, 1, e[k].bd, bd_phys, ring)
+                                      : -ENOMEM;
+                }
+                opened += !ret;
+                if (!ret)
+                        ret = mcdma_engine_chan_start(&e[k].eng, &e[k].ch);
+                if (!ret)
+                        ret = mcdma_engine_run(&e[k].eng);
+                if (!ret)
+                        ret = mcdma_stripe_add(&s, &e[k].eng, &e[k].ch);
+        }
+
+        t0 = now_sec();
+        while (!ret && total < (unsigned long)nstreams * count) {
+                for (k = 0; k < nstreams && !ret; k++) {
+                        while (sent[k] < count) {
+                                uint64_t off = k * span + (sent[k] % depth) * (uint64_t)block;
+
+                                // the cookie is the transfer's sequence number interleaved with its stream
+                                ret = mcdma_stripe_submit(&s, k, ctx->src_phys + off, PL_LOOP_MEM_ADDRESS + off, block,
+                                                          app, (void *)(uintptr_t)(sent[k] * nstreams + k));
+                                if (ret) {
+                                        ret = ret == -EBUSY ? 0 : ret;
+                                        break;
+                                }
+                                sent[k]++;
+                        }
+                }
+                mcdma_stripe_kick(&s);
+
+                n = mcdma_stripe_reap(&s, cpl, RECLAIM_BATCH);
+                for (i = 0; i < n; i++) {
+                        uintptr_t id = (uintptr_t)cpl[i].cookie;
+
+                        if (cpl[i].status & MCDMA_BD_STS_ERR_MASK)
+                                ret = -EIO;
+                        disorder += id / nstreams != done[id % nstreams];
+                        done[id % nstreams]++;
+                }
+                total += n;
+                if (!n && !ret) {
+                        ret = mcdma_stripe_failed(&s);
+                        sched_yield();          //the model may share the core
+                }
+        }
+        t1 = now_sec();
+
+        for (k = 0; k < opened; k++) {
+                bytes += e[k].ch.bytes;
+                lo = e[k].ch.bytes < lo ? e[k].ch.bytes : lo;
+                hi = e[k].ch.bytes > hi ? e[k].ch.bytes : hi;
+        }
+        if (!ret) {
+                res->mbps = (double)bytes / (t1 - t0) / 1e6;
+                res->tps = total / (t1 - t0);
+                res->bds = (double)s.pieces / total;
+                res->lo = 100.0 * lo / bytes;
+                res->hi = 100.0 * hi / bytes;
+                res->disorder = disorder;
+        }
+
+        for (k = 0; k < opened; k++) {
+                mcdma_engine_chan_stop(&e[k].eng, &e[k].ch);
+                mcdma_chan_close(&e[k].ch);
+                mcdma_arena_free(&ctx->arena, e[k].bd);
+        }
+        mcdma_stripe_destroy(&s);
+        free(sent);
+        free(done);
+        return ret;
+}
+
+static int bench_stripe(struct bench_ctx *ctx, int argc, char **argv)
+{
+        uint64_t addr[MCDMA_STRIPE_MAX_LANES] = { AXI_DMA_REGISTER_LOCATION, AXI_DMA1_REGISTER_LOCATION };
+        unsigned long bw[MCDMA_STRIPE_MAX_LANES], count = 64;
+        unsigned int naddr = 2, neng = 0, nbw = 0, nstreams = 4, depth = 4, ring = 64, k;
+        uint32_t block = 0x100000, chunk = 0x10000;
+        struct stripe_engine e[MCDMA_STRIPE_MAX_LANES];
+        struct stripe_result res;
+        double base = 0;
+        char *p, *end;
+        int opt, ret = 0;
+
+        while ((opt = getopt(argc, argv, "a:e:B:b:k:t:q:d:n:")) != -1) {
+                switch (opt) {
+                case 'a':
+                        for (naddr = 0, p = optarg; *p && naddr < MCDMA_STRIPE_MAX_LANES; p = *end ? end + 1 : end) {
+                                addr[naddr++] = strtoull(p, &end, 0);
+                                if (end == p)
+                                        return -EINVAL;
+                        }
+                        break;
+                case 'B':
+                        ret = parse_list(optarg, bw, MCDMA_STRIPE_MAX_LANES);
+                        if (ret < 0)
+                                return ret;
+                        nbw = ret;
+                        ret = 0;
+                        break;
+                case 'e': neng = strtoul(optarg, NULL, 0); break;
+                case 'b': block = strtoul(optarg, NULL, 0); break;
+                case 'k': chunk = strtoul(optarg, NULL, 0); break;
+                case 't': nstreams = strtoul(optarg, NULL, 0); break;
+                case 'q': depth = strtoul(optarg, NULL, 0); break;
+                case 'd': ring = strtoul(optarg, NULL, 0); break;
+                case 'n': count = strtoul(optarg, NULL, 0); break;
+                default: return -EINVAL;
+                }
+        }
+        // the model has room for as many engines as asked for, they follow DMA0 every 4 KB
+        if (ctx->simulate) {
+                neng = neng ? neng : 4;
+                for (naddr = 0; naddr < neng && naddr < MCDMA_STRIPE_MAX_LANES; naddr++)
+                        addr[naddr] = AXI_DMA_REGISTER_LOCATION + naddr * MCDMA_REG_SPACE;
+        }
+        neng = neng && neng < naddr ? neng : naddr;
+        if (!block || !chunk || chunk > DM_CMD_BTT_MASK || !nstreams || !depth || ring < 2 || !count ||
+            (uint64_t)nstreams * depth * block > SOURCE_MEM_WIDTH || (block + chunk - 1) / chunk > ring)
+                return -EINVAL;
+        if (!nbw)
+                bw[nbw++] = ctx->sim_params.bandwidth_mbps ? ctx->sim_params.bandwidth_mbps : STRIPE_SIM_BW_MBPS;
+
+        memset(e, 0, sizeof(e));
+        for (k = 0; k < neng && !ret; k++) {
+                if (ctx->simulate) {
+                        struct mcdma_sim_params params = ctx->sim_params;
+
+                        params.bandwidth_mbps = bw[k < nbw ? k : nbw - 1];
+                        if (mcdma_sim_set_params(ctx->plat, addr[k], &params) == -ENOENT &&
+                            (mcdma_sim_add_engine(ctx->plat, addr[k], MCDMA_SIM_MCDMA) ||
+                             mcdma_sim_set_params(ctx->plat, addr[k], &params)))
+                                ret = -ENOMEM;
+                }
+                if (!ret && mcdma_dev_open(&e[k].dev, ctx->plat, addr[k])) {
+                        printf("0x%08llx: cannot map\n", (unsigned long long)addr[k]);
+                        ret = -EIO;
+                }
+                e[k].open = !ret;
+                if (!ret && mcdma_engine_open(&e[k].eng, &e[k].dev, NULL)) {
+                        printf("0x%08llx: unknown engine\n", (unsigned long long)addr[k]);
+                        ret = -EIO;
+                }
+        }
+
+        printf("%u streams, %u byte transfers in %u byte pieces\n", nstreams, block, chunk);
+        printf("%7s %12s %8s %12s %10s %13s %10s\n", "engines", "MB/s", "scaling", "transfers/s", "BDs/xfer",
+               "lane share %", "disorder");
+        for (k = 1; k <= neng && !ret; k++) {
+                memset(&res, 0, sizeof(res));
+                ret = stripe_once(ctx, e, k, nstreams, depth, ring, block, chunk, count, &res);
+                if (ret) {
+                        printf("%7u failed: %s\n", k, strerror(-ret));
+                        break;
+                }
+                base = base ? base : res.mbps;
+                printf("%7u %12.1f %8.2f %12.0f %10.1f %6.1f..%-5.1f %10lu\n", k, res.mbps, res.mbps / base, res.tps,
+                       res.bds, res.lo, res.hi, res.disorder);
+                if (res.disorder)
+                        ret = -EIO;
+        }
+
+        for (k = 0; k < neng; k++) {
+                if (e[k].open)
+                        mcdma_dev_close(&e[k].dev);
+        }
+        return ret;
+}
+
+/*********************************************************************/
+/*   fault: per channel recovery under load.  The model fails every  */
+/*   -e th BD of channel -f while all -c channels stream -n blocks,  */
+/*   once without faults and once per recovery policy.  Reported are */
+/*   the recover call (fault seen to fetching again), the gap in the */
+/*   faulty channel's good completions around each fault and the     */
+/*   MB/s of the healthy channels against the fault free run.        */
+/*********************************************************************/
+#define FAULT_SIM_BW_MBPS                  800                  //model engine when -S sets no bw_mbps
+
+struct fault_result {
+        double healthy_mbps;
+        unsigned long faults;
+        unsigned long failed;           //BDs that completed with an error
+        uint64_t retried;
+        uint64_t skipped;
+        uint64_t *rec_ns;               //recover call per fault
+        uint64_t *gap_ns;               //last completion before the fault to the first after
+        size_t nrec;
+        size_t ngap;
+};
+
+static int fault_run(struct bench_ctx *ctx, struct bench_stream *st, unsigned int nch, unsigned int depth,
+                     uint32_t block, unsigned long count, unsigned int bad, int policy, size_t max_faults,
+                     struct fault_result *r)
+{
+        struct mcdma_cpl cpl[RECLAIM_BATCH];
+        uint32_t app[MCDMA_BD_NUM_APP] = { 0, 0, 0, 0xFFFFFF00, 0x11111111 };
+        uint64_t t0, now, last;
+        unsigned int k, busy = 1, healthy;
+        int i, n, good, ret, gap = 0;
+
+        ret = streams_open(ctx, st, nch, depth, block);
+        if (ret)
+                return ret;
+
+        t0 = last = now_ns();
+        while (busy && !ret) {
+                busy = 0;
+                healthy = 0;
+                for (k = 0; k < nch; k++) {
+                        struct bench_stream *s = &st[k];
+
+                        while (s->queued < count && mcdma_ring_space(&s->ch.ring)) {
+                                uint64_t off = (s->queued % depth) * (uint64_t)block;
+
+                                app[0] = DM_CMD_EOF | DM_CMD_TYPE_INCR | block;
+                                app[1] = (uint32_t)(s->dst + off);
+                                app[2] = (uint32_t)((s->dst + off) >> 32);
+                                mcdma_ring_queue(&s->ch.ring, s->src + off, block,
+                                                 MCDMA_BD_CTRL_SOF | MCDMA_BD_CTRL_EOF, app, NULL);
+                                s->queued++;
+                        }
+                        mcdma_ring_kick(&s->ch.ring);
+                }
+                for (k = 0; k < nch && !ret; k++) {
+                        struct bench_stream *s = &st[k];
+                        struct mcdma_fault f;
+
+                        n = mcdma_chan_reclaim(&s->ch, cpl, RECLAIM_BATCH);
+                        for (i = 0, good = 0; i < n; i++) {
+                                r->failed += !!(cpl[i].status & MCDMA_BD_STS_ERR_MASK);
+                                good += !(cpl[i].status & MCDMA_BD_STS_ERR_MASK);
+                        }
+                        s->done += n;
+                        // a skipped BD comes back at once, the gap ends with the first one that ran
+                        if (good && k == bad - 1) {
+                                now = now_ns();
+                                if (gap && r->ngap < max_faults)
+                                        r->gap_ns[r->ngap++] = now - last;
+                                gap = 0;
+                                last = now;
+                        }
+                        if (!n && s->ch.ring.inflight) {
+                                ret = mcdma_chan_fault(&s->ch, &f);
+                                // no policy: a fault ends the run like it always did
+                                if (ret > 0 && policy >= 0) {
+                                        now = now_ns();
+                                        ret = mcdma_chan_recover(&s->ch, &f, policy);
+                                        if (r->nrec < max_faults)
+                                                r->rec_ns[r->nrec++] = now_ns() - now;
+                                        r->faults++;
+                                        gap = k == bad - 1;
+                                        ret = ret < 0 ? ret : 0;
+                                } else if (ret) {
+                                        ret = -EIO;
+                                }
+                        }
+                        if (s->done < count) {
+                                busy = 1;
+                                healthy += k != bad - 1;
+                        }
+                }
+                // the healthy channels are timed to the last of them
+                if (!healthy && !r->healthy_mbps)
+                        r->healthy_mbps = (double)(nch - 1) * count * block / ((now_ns() - t0) / 1e9) / 1e6;
+                if (busy)
+                        sched_yield();          //the model may share the core
+        }
+        r->retried = st[bad - 1].ch.retried;
+        r->skipped = st[bad - 1].ch.skipped;
+        streams_close(st, nch);
+        return ret;
+}
+
+static int bench_fault(struct bench_ctx *ctx, int argc, char **argv)
+{
+        static const struct {
+                const char *name;
+                int policy;                     //MCDMA_RECOVER_* flags, -1 for no faults
+        } runs[] = {
+                { "none", -1 },
+                { "skip", 0 },
+                { "retry", MCDMA_RECOVER_RETRY },
+        };
+        struct bench_stream st[MCDMA_MAX_CHANNELS];
+        struct mcdma_sim_params params = ctx->sim_params;
+        unsigned int nch = 4, depth = 64, bad = 1, m;
+        unsigned long count = 8192, every = 256;
+        uint32_t block = 0x4000;
+        size_t max_faults;
+        double base = 0;
+        int opt, ret = 0;
+
+        while ((opt = getopt(argc, argv, "c:d:b:n:e:f:")) != -1) {
+                switch (opt) {
+                case 'c': nch = strtoul(optarg, NULL, 0); break;
+                case 'd': depth = strtoul(optarg, NULL, 0); break;
+                case 'b': block = strtoul(optarg, NULL, 0); break;
+                case 'n': count = strtoul(optarg, NULL, 0); break;
+                case 'e': every = strtoul(optarg, NULL, 0); break;
+                case 'f': bad = strtoul(optarg, NULL, 0); break;
+                default: return -EINVAL;
+                }
+        }
+        if (nch < 2 || nch > MCDMA_MAX_CHANNELS || bad < 1 || bad > nch || depth < 2 || !count || every < 2 ||
+            !block || block > DM_CMD_BTT_MASK)
+                return -EINVAL;
+        if (!ctx->simulate) {
+                printf("fault: faults are injected by the model, run with -s\n");
+                return -EINVAL;
+        }
+        if (!params.bandwidth_mbps)
+                params.bandwidth_mbps = FAULT_SIM_BW_MBPS;
+        max_faults = count / every + 1;
+
+        printf("%u channels, every %lu th BD of channel %u fails, %u MB/s engine\n", nch, every, bad,
+               (unsigned int)params.bandwidth_mbps);
+        printf("%-6s %7s %8s %8s %11s %11s %11s %11s %13s %7s\n", "policy", "faults", "retried", "skipped",
+               "recover p50", "recover max", "gap us p50", "gap us max", "healthy MB/s", "loss %");
+        for (m = 0; m < sizeof(runs) / sizeof(runs[0]) && !ret; m++) {
+                struct fault_result r;
+
+                memset(&r, 0, sizeof(r));
+                r.rec_ns = calloc(max_faults, sizeof(*r.rec_ns));
+                r.gap_ns = calloc(max_faults, sizeof(*r.gap_ns));
+                params.error_every = runs[m].policy < 0 ? 0 : every;
+                params.error_chan = bad;
+                if (!r.rec_ns || !r.gap_ns || mcdma_sim_set_params(ctx->plat, AXI_DMA_REGISTER_LOCATION, &params))
+                        ret = -ENOMEM;
+                if (!ret)
+                        ret = fault_run(ctx, st, nch, depth, block, count, bad, runs[m].policy, max_faults, &r);
+                if (!ret) {
+                        qsort(r.rec_ns, r.nrec, sizeof(*r.rec_ns), cmp_u64);
+                        qsort(r.gap_ns, r.ngap, sizeof(*r.gap_ns), cmp_u64);
+                        base = base ? base : r.healthy_mbps;
+                        printf("%-6s %7lu %8llu %8llu %11.1f %11.1f %11.1f %11.1f %13.1f %7.1f\n", runs[m].name,
+                               r.faults, (unsigned long long)r.retried, (unsigned long long)r.skipped,
+                               percentile_us(r.rec_ns, r.nrec, 50), r.nrec ? r.rec_ns[r.nrec - 1] / 1e3 : 0.0,
+                               percentile_us(r.gap_ns, r.ngap, 50), r.ngap ? r.gap_ns[r.ngap - 1] / 1e3 : 0.0,
+                               r.healthy_mbps, 100.0 * (base - r.healthy_mbps) / base);
+                        // the model never fails the BD after a faulted one, so every retry has to succeed
+                        if (r.failed != r.skipped || (runs[m].policy > 0 && r.skipped))
+                                ret = -EIO;
+                } else {
+                        printf("%-6s failed: %s\n", runs[m].name, strerror(-ret));
+                }
+                free(r.rec_ns);
+                free(r.gap_ns);
+        }
+        mcdma_sim_set_params(ctx->plat, AXI_DMA_REGISTER_LOCATION, &ctx->sim_params);
+        return ret;
+}
+
+/*********************************************************************/
+/*   what each mapping mode costs the CPU: map plus wide-store       */
+/*   zeroing (startup), pattern fill, the two ownership transfers    */
+/*   and the verify pass, over the second reserved block             */
+/*********************************************************************/
+static int bench_map(struct bench_ctx *ctx, int argc, char **argv)
+{
+        static const enum mcdma_cache modes[] = { MCDMA_CACHE_UNCACHED, MCDMA_CACHE_WC, MCDMA_CACHE_CACHED };
+        size_t size = 16 << 20;
+        unsigned int m, nmis;
+        struct mcdma_mismatch mis;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "b:")) != -1) {
+                switch (opt) {
+                case 'b': size = strtoul(optarg, NULL, 0); break;
+                default: return -EINVAL;
+                }
+        }
+        size &= ~(size_t)(MCDMA_ARENA_GRANULE - 1);
+        if (!size || size > HP0_DMA_BUFFER_MEM_WIDTH)
+                return -EINVAL;
+
+        printf("%-9s %10s %10s %10s %10s %10s\n", "mode", "startup ms", "fill MB/s", "to dev us", "to cpu us",
+               "check MB/s");
+        for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+                struct mcdma_region r;
+                double t0, t1, t2, t3, t4, t5;
+                size_t bad;
+
+                t0 = now_sec();
+                if (mcdma_region_open_platform(&r, ctx->plat, MAP_MEM_ADDRESS, size, modes[m])) {
+                        printf("%-9s unsupported (%s)\n", mcdma_cache_name(modes[m]), strerror(errno));
+                        continue;
+                }
+                mcdma_mem_zero(r.virt, size);
+                t1 = now_sec();
+                mcdma_pattern_fill(r.virt, size / 4, MCDMA_PATTERN_PRBS, 1, 0);
+                t2 = now_sec();
+                mcdma_region_sync_for_device(&r, r.virt, size);
+                t3 = now_sec();
+                mcdma_region_sync_for_cpu(&r, r.virt, size);
+                t4 = now_sec();
+                bad = mcdma_pattern_check(r.virt, size / 4, MCDMA_PATTERN_PRBS, 1, 0, &mis, &nmis, 1);
+                t5 = now_sec();
+                mcdma_region_close(&r);
+
+                printf("%-9s %10.3f %10.1f %10.1f %10.1f %10.1f%s\n", mcdma_cache_name(modes[m]), (t1 - t0) * 1e3,
+                       size / (t2 - t1) / 1e6, (t3 - t2) * 1e6, (t4 - t3) * 1e6, size / (t5 - t4) / 1e6,
+                       bad ? " MISMATCH" : "");
+        }
+        return 0;
+}
+
+static const struct bench {
+        const char *name;
+        int (*run)(struct bench_ctx *ctx, int argc, char **argv);
+        const char *help;
+} benches[] = {
+        { "chan", bench_chan, "[-b block] [-d depth] [-n blocks per channel] [-c max channels]" },
+        { "irq", bench_irq, "[-b block] [-d depth] [-n blocks per channel] [-c channels]" },
+        { "sweep", bench_sweep, "[-b blocks,..] [-d depths,..] [-c channels,..] [-w modes,..] [-n blocks] [-o csv|-]" },
+        { "coalesce", bench_coalesce, "[-r loads/s,..|0 max] [-t latency budget us] [-T fixed threshold] [-b bytes] [-d depth]\n"
+                                      "             [-n packets], fixed vs adaptive interrupt coalescing" },
+        { "bd", bench_bd, "[-b block] [-g BDs per transfer] [-d depth] [-n transfers], queue vs chain template" },
+        { "sg", bench_sg, "[-i iov pieces] [-l max BD bytes] [-b copy block] [-d depth], zero-copy vs copy, 1 KB..64 MB" },
+        { "queue", bench_queue, "[-t producers] [-c channels] [-n packets per producer] [-b bytes] [-d depth] [-q sq depth]\n"
+                                "             [-R skip|retry] recover faulted channels" },
+        { "rx", bench_rx, "[-c channels] [-n packets per channel] [-l bytes] [-b buffer] [-d depth] [-x spare buffers]\n"
+                          "             [-r packets/s] [-f source fifo] [-s stall us] [-e packets between stalls]" },
+        { "engines", bench_engines, "[-a addr,..] [-D device tree dir] [-b block] [-d depth] [-n blocks] [-c MCDMA channels],\n"
+                                    "             the same workload on every engine, AXI DMA vs MCDMA" },
+        { "stripe", bench_stripe, "[-a addr,..|-e model engines] [-B MB/s per model engine,..] [-b transfer bytes] [-k piece bytes]\n"
+                                  "             [-t streams] [-q transfers per stream] [-d ring depth] [-n transfers per stream],\n"
+                                  "             MB/s of 1..N engines striped as one device" },
+        { "fault", bench_fault, "[-c channels] [-f faulty channel] [-e fail every Nth BD] [-b block] [-d depth] [-n blocks],\n"
+                                "             per channel recovery on the model, skip vs retry" },
+        { "map", bench_map, "[-b bytes], uncached vs wc vs cached mapping of the second reserved block" },
+};
+
+#define NUM_BENCHES                        (sizeof(benches) / sizeof(benches[0]))
+
+static void usage(const char *prog)
+{
+        unsigned int i;
+
+        printf("usage: %s [-s] [-S sim params] [-u uio] [-w poll|irq|hybrid] [-p spin ns] [-m name] <bench> [options]\n",
+               prog);
+        printf("  -s  run against the software model instead of /dev/mem (or MCDMA_BACKEND=sim)\n");
+        printf("  -S  model parameters, e.g. lat_ns=2000,bw_mbps=400\n");
+        printf("  -u  channel n interrupts on /dev/uio<uio + n - 1>\n");
+        printf("  -w  completion mode, -p spin time of hybrid mode\n");
+        printf("  -m  publish queue and rx channel telemetry to /dev/shm/mcdma-<name>, see mcdma_stats_dump\n");
+        for (i = 0; i < NUM_BENCHES; i++)
+                printf("  %-10s %s\n", benches[i].name, benches[i].help);
+}
+
+int main(int argc, char **argv)
+{
+        struct bench_ctx ctx;
+        const struct bench *b = NULL;
+        const char *sim_spec = NULL, *stats_name = NULL;
+        int simulate = mcdma_sim_selected(), opt, ret;
+        unsigned int i;
+
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.uio_first = -1;
+        ctx.mode = MCDMA_WAIT_POLL;
+        ctx.spin_ns = MCDMA_WAIT_SPIN_NS_DEFAULT;
+        while ((opt = getopt(argc, argv, "+sS:u:w:p:m:h")) != -1) {
+                switch (opt) {
+                case 's': simulate = 1; break;
+                case 'S': simulate = 1; sim_spec = optarg; break;
+                case 'u': ctx.uio_first = atoi(optarg); break;
+                case 'p': ctx.spin_ns = strtoul(optarg, NULL, 0); break;
+                case 'm': stats_name = optarg; break;
+                case 'w':
+                        if (mcdma_wait_mode_parse(optarg, &ctx.mode)) {
+                                usage(argv[0]);
+                                return 1;
+                        }
+                        break;
+                default: usage(argv[0]); return 1;
+                }
+        }
+        for (i = 0; optind < argc && i < NUM_BENCHES; i++) {
+                if (!strcmp(argv[optind], benches[i].name))
+                        b = &benches[i];
+        }
+        if (!b) {
+                usage(argv[0]);
+                return 1;
+        }
+
+        ctx.simulate = simulate;
+        if (simulate) {
+                struct mcdma_sim_params params = { 0 };
+
+                if (sim_spec && mcdma_sim_parse_params(sim_spec, &params)) {
+                        usage(argv[0]);
+                        return 1;
+                }
+                ctx.sim_params = params;
+                ctx.plat = mcdma_sim_open();
+                if (ctx.plat) {
+                        if (sim_spec)
+                                mcdma_sim_set_params(ctx.plat, 0, &params);
+                        mcdma_sim_add_engine(ctx.plat, AXI_DMA_REGISTER_LOCATION, MCDMA_SIM_MCDMA);
+                        mcdma_sim_add_mem(ctx.plat, PL_LOOP_MEM_ADDRESS, MEMBLOCK_WIDTH + 1);
+                }
+        } else {
+                ctx.plat = mcdma_devmem_open();
+        }
+        if (!ctx.plat) {
+                perror("platform");
+                return 1;
+        }
+        if (mcdma_dev_open(&ctx.dev, ctx.plat, AXI_DMA_REGISTER_LOCATION)) {
+                printf("AXI_DMA_REGISTER_LOCATION failed \n");
+                return 1;
+        }
+        // source first, the BD rings of each run come out of what is left
+        if (mcdma_region_open_platform(&ctx.region, ctx.plat, HP0_DMA_BUFFER_MEM_ADDRESS, HP0_DMA_BUFFER_MEM_WIDTH,
+                                       MCDMA_CACHE_UNCACHED) ||
+            mcdma_arena_init(&ctx.arena, &ctx.region) ||
+            !(ctx.src = mcdma_arena_alloc(&ctx.arena, SOURCE_MEM_WIDTH, &ctx.src_phys))) {
+                printf("mmap failed \n");
+                return 1;
+        }
+
+        if (stats_name && (ret = mcdma_stats_create(&ctx.stats, stats_name))) {
+                printf("stats page %s: %s\n", stats_name, strerror(-ret));
+                return 1;
+        }
+
+        // getopt restarts on the bench's own arguments, argv[0] is the bench name
+        argc -= optind;
+        argv += optind;
+        optind = 1;
+        ret = b->run(&ctx, argc, argv);
+        if (ret == -EINVAL)
+                printf("%s: bad options, %s %s\n", b->name, b->name, b->help);
+
+        mcdma_stats_close(&ctx.stats);
+        mcdma_arena_free(&ctx.arena, ctx.src);
+        mcdma_arena_destroy(&ctx.arena);
+        mcdma_region_close(&ctx.region);
+        mcdma_dev_close(&ctx.dev);
+        ctx.plat->close(ctx.plat);
+        return ret ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "mcdma_engine.h"
+
+#define ENGINE_POLL_LOOPS               1000000
+#define ENGINE_DT_MAX                   256             //compatible property bytes looked at
+
+// what the shared ring code relies on
+_Static_assert(AXIDMA_BD_STATUS == MCDMA_BD_STATUS && AXIDMA_BD_BUFADDR == MCDMA_BD_BUFADDR &&
+               AXIDMA_BD_APP(0) == MCDMA_BD_APP(0) && AXIDMA_BD_SIZE == MCDMA_BD_SIZE,
+               "AXI DMA and MCDMA BDs differ outside the control word");
+_Static_assert(AXIDMA_MM2S_CURDESC == MCDMA_CH_CURDESC && AXIDMA_MM2S_TAILDESC == MCDMA_CH_TAILDESC &&
+               AXIDMA_MM2S_TAILDESC_MSB == MCDMA_CH_TAILDESC_MSB && AXIDMA_MM2S_DMASR == MCDMA_CH_SR,
+               "AXI DMA register map is not one MCDMA channel block");
+_Static_assert(AXIDMA_CR_RESET == MM2S_DMACR_RESET && AXIDMA_MM2S_DMACR == MM2S_DMACR,
+               "soft reset differs");
+_Static_assert(AXIDMA_CR_IRQTHRESH_MASK == MCDMA_CHCR_IRQTHRESH_MASK, "IRQThreshold moved");
+
+/*********************************************************************/
+/*   the inline hot path instantiated once per IP, the traits are    */
+/*   compile time constants in each copy                             */
+/*********************************************************************/
+#define ENGINE_OPS(ip)                                                                                         \
+static int ip##_queue(struct mcdma_ring *ring, uint64_t buf, uint32_t len, uint32_t flags, const uint32_t *app, \
+                      void *cookie)                                                                            \
+{                                                                                                              \
+        return mcdma_engine_queue_t(&mcdma_traits_##ip, ring, buf, len, flags, app, cookie);                  \
+}                                                                                                              \
+static uint32_t ip##_ack(struct mcdma_chan *ch)                                                                \
+{                                                                                                              \
+        return mcdma_engine_ack_t(&mcdma_traits_##ip, ch);                                                     \
+}                                                                                                              \
+static int ip##_failed(const struct mcdma_chan *ch)                                                            \
+{                                                                                                              \
+        return mcdma_engine_failed_t(&mcdma_traits_##ip, ch);                                                  \
+}                                                                                                              \
+static const struct mcdma_engine_ops ip##_ops = {                                                              \
+        .queue = ip##_queue,                                                                                   \
+        .ack = ip##_ack,                                                                                       \
+        .failed = ip##_failed,                                                                                 \
+};
+
+ENGINE_OPS(mcdma)
+ENGINE_OPS(axidma)
+
+/*********************************************************************/
+/*   which IP sits at dev: the device tree says so if we have the    */
+/*   node, otherwise DMASR.  The AXI DMA reports SGIncld (bit 3) in  */
+/*   MM2S_DMASR, the MCDMA is always SG and keeps that bit reserved  */
+/*   at 0.  An AXI DMA built without SG looks like neither and is    */
+/*   not supported.                                                  */
+/*********************************************************************/
+static int detect_dt(const char *dt_node, enum mcdma_engine_type *type)
+{
+        char path[512], buf[ENGINE_DT_MAX];
+        size_t len, off;
+        FILE *f;
+
+        snprintf(path, sizeof(path), "%s/compatible", dt_node);
+        f = fopen(path, "r");
+        if (!f)
+                return -errno;
+        len = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+        buf[len] = 0;
+
+        // a list of NUL separated strings, most specific first
+        for (off = 0; off < len; off += strlen(buf + off) + 1) {
+                if (!strncmp(buf + off, mcdma_traits_mcdma.compatible, strlen(mcdma_traits_mcdma.compatible))) {
+                        *type = MCDMA_ENGINE_MCDMA;
+                        return 0;
+                }
+                if (!strncmp(buf + off, mcdma_traits_axidma.compatible, strlen(mcdma_traits_axidma.compatible))) {
+                        *type = MCDMA_ENGINE_AXIDMA;
+                        return 0;
+                }
+        }
+        return -ENODEV;
+}
+
+int mcdma_engine_detect(struct mcdma_dev *dev, const char *dt_node, enum mcdma_engine_type *type)
+{
+        if (dt_node)
+                return detect_dt(dt_node, type);
+        *type = (mcdma_read(dev, AXIDMA_MM2S_DMASR) & AXIDMA_SR_SGINCLD) ? MCDMA_ENGINE_AXIDMA : MCDMA_ENGINE_MCDMA;
+        return 0;
+}
+
+void mcdma_engine_set_type(struct mcdma_engine *eng, struct mcdma_dev *dev, enum mcdma_engine_type type)
+{
+        eng->dev = dev;
+        eng->type = type;
+        eng->t = type == MCDMA_ENGINE_AXIDMA ? &mcdma_traits_axidma : &mcdma_traits_mcdma;
+        eng->ops = type == MCDMA_ENGINE_AXIDMA ? &axidma_ops : &mcdma_ops;
+}
+
+int mcdma_engine_open(struct mcdma_engine *eng, struct mcdma_dev *dev, const char *dt_node)
+{
+        enum mcdma_engine_type type;
+        int ret = mcdma_engine_detect(dev, dt_node, &type);
+
+        if (ret)
+                return ret;
+        mcdma_engine_set_type(eng, dev, type);
+        return 0;
+}
+
+// DMACR bit 2 at 0 is the soft reset of both IPs
+int mcdma_engine_reset(struct mcdma_engine *eng)
+{
+        return mcdma_dev_reset(eng->dev);
+}
+
+// the MCDMA runs per direction and gates channels with CHEN, the AXI DMA runs with its channel
+int mcdma_engine_run(struct mcdma_engine *eng)
+{
+        return eng->t->has_chen ? mcdma_dev_run(eng->dev) : 0;
+}
+
+/*********************************************************************/
+/*                      channels (MM2S)                              */
+/*********************************************************************/
+int mcdma_engine_chan_open(struct mcdma_engine *eng, struct mcdma_chan *ch, unsigned int id,
+                           void *bd_virt, uint64_t bd_phys, unsigned int depth)
+{
+        int ret;
+
+        if (id < 1 || id > eng->t->nchan)
+                return -EINVAL;
+        ret = mcdma_chan_open(ch, eng->dev, id, bd_virt, bd_phys, depth);
+        if (ret)
+                return ret;
+        ch->base = eng->t->ch_base + (id - 1) * eng->t->ch_stride;
+        ch->ring.regs = ch->base;
+        ch->ring.bd_ctrl = eng->t->bd_ctrl;
+        ch->ring.bd_eof = eng->t->bd_eof;
+        return 0;
+}
+
+/*********************************************************************/
+/*   CHEN on the MCDMA, CURDESC at the ring head, then Fetch/RS with */
+/*   the traits' interrupt enables and threshold 1.  The AXI DMA     */
+/*   leaves Halted once RS is in.                                    */
+/*********************************************************************/
+int mcdma_engine_chan_start(struct mcdma_engine *eng, struct mcdma_chan *ch)
+{
+        uint64_t cur = mcdma_ring_bd_phys(&ch->ring, ch->ring.head);
+        uint32_t chen = ch->common + MM2S_CHEN_OFFSET, cr;
+        int i;
+
+        if (eng->t->has_chen)
+                mcdma_write(ch->dev, chen, mcdma_read(ch->dev, chen) | BIT(ch->id - 1));
+        mcdma_chan_write(ch, MCDMA_CH_CURDESC, (uint32_t)cur);
+        mcdma_chan_write(ch, MCDMA_CH_CURDESC_MSB, (uint32_t)(cur >> 32));
+        cr = mcdma_chan_read(ch, MCDMA_CH_CR) & ~AXIDMA_CR_IRQTHRESH_MASK;
+        cr |= eng->t->cr_run | eng->t->cr_irqen | (1u << AXIDMA_CR_IRQTHRESH_SHIFT);
+        mcdma_chan_write(ch, MCDMA_CH_CR, cr);
+        if (eng->t->has_chen)
+                return 0;
+        for (i = 0; i < ENGINE_POLL_LOOPS; i++) {
+                if (!(mcdma_chan_read(ch, MCDMA_CH_SR) & AXIDMA_SR_HALTED))
+                        return 0;
+        }
+        return -ETIMEDOUT;
+}
+
+void mcdma_engine_chan_stop(struct mcdma_engine *eng, struct mcdma_chan *ch)
+{
+        if (eng->t->has_chen)
+                mcdma_chan_stop(ch);
+        else
+                mcdma_chan_write(ch, MCDMA_CH_CR, mcdma_chan_read(ch, MCDMA_CH_CR) & ~eng->t->cr_run);
+}
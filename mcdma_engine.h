@@ -0,0 +1,174 @@
+#ifndef MCDMA_ENGINE_H
+#define MCDMA_ENGINE_H
+
+#include <stdint.h>
+#include <errno.h>
+
+#include "mcdma.h"
+#include "axidma.h"
+
+/*********************************************************************/
+/*   one driver core for the AXI MCDMA and the AXI DMA.  The two     */
+/*   share the BD status word, the CURDESC/TAILDESC offsets of a     */
+/*   channel block and the soft reset bit, so rings, kicks and       */
+/*   reclaim are the mcdma.c ones.  What differs is collected in a   */
+/*   struct mcdma_engine_traits per IP: where channel blocks sit,    */
+/*   the CR/SR interrupt bits and where the BD control word and its  */
+/*   SOF/EOF bits live.                                              */
+/*                                                                   */
+/*   The hot path functions below take the traits as a pointer to    */
+/*   one of the static const tables and are always inlined, so a     */
+/*   caller that passes &mcdma_traits_mcdma or &mcdma_traits_axidma  */
+/*   gets the constants folded in and no branch on the engine type.  */
+/*   mcdma_engine.c instantiates them once per IP behind             */
+/*   struct mcdma_engine_ops for callers that only know the engine   */
+/*   at run time (one indirect call, still no type test).            */
+/*********************************************************************/
+enum mcdma_engine_type {
+        MCDMA_ENGINE_MCDMA,
+        MCDMA_ENGINE_AXIDMA,
+};
+
+struct mcdma_engine_traits {
+        const char *name;
+        const char *compatible;         //device tree compatible prefix
+        unsigned int nchan;             //MM2S channels
+        uint32_t ch_base;               //register block of channel 1
+        uint32_t ch_stride;
+        uint32_t cr_run;                //MCDMA Fetch, AXI DMA RS
+        uint32_t cr_irqen;              //IOC and Err interrupt enables
+        uint32_t sr_irq_mask;           //write-one-to-clear irq bits
+        uint32_t sr_err;                //Err_Irq
+        uint32_t bd_ctrl;               //offset of the BD word with SOF/EOF and the length
+        uint32_t bd_sof;
+        uint32_t bd_eof;
+        int has_chen;                   //common DMACR and CHEN mask in front of the channel blocks
+};
+
+static const struct mcdma_engine_traits mcdma_traits_mcdma = {
+        .name = "mcdma",
+        .compatible = "xlnx,axi-mcdma",
+        .nchan = MCDMA_MAX_CHANNELS,
+        .ch_base = MM2S_CH_BASE(1),
+        .ch_stride = MM2S_CH_BASE(2) - MM2S_CH_BASE(1),
+        .cr_run = MCDMA_CHCR_FETCH,
+        .cr_irqen = MCDMA_CHCR_IOC_IRQEN | MCDMA_CHCR_ERR_IRQEN,
+        .sr_irq_mask = MCDMA_CHSR_IRQ_MASK,
+        .sr_err = MCDMA_CHSR_ERR_IRQ,
+        .bd_ctrl = MCDMA_BD_CTRL,
+        .bd_sof = MCDMA_BD_CTRL_SOF,
+        .bd_eof = MCDMA_BD_CTRL_EOF,
+        .has_chen = 1,
+};
+
+static const struct mcdma_engine_traits mcdma_traits_axidma = {
+        .name = "axidma",
+        .compatible = "xlnx,axi-dma",
+        .nchan = 1,
+        .ch_base = AXIDMA_MM2S_DMACR,
+        .ch_stride = 0,
+        .cr_run = AXIDMA_CR_RUNSTOP,
+        .cr_irqen = AXIDMA_CR_IOC_IRQEN | AXIDMA_CR_ERR_IRQEN,
+        .sr_irq_mask = AXIDMA_SR_IRQ_MASK,
+        .sr_err = AXIDMA_SR_ERR_IRQ,
+        .bd_ctrl = AXIDMA_BD_CTRL,
+        .bd_sof = AXIDMA_BD_CTRL_SOF,
+        .bd_eof = AXIDMA_BD_CTRL_EOF,
+        .has_chen = 0,
+};
+
+#define MCDMA_ENGINE_INLINE             static inline __attribute__((always_inline))
+
+/*********************************************************************/
+/*   queue one BD at head, flags are MCDMA_BD_CTRL_SOF/EOF whatever  */
+/*   the engine; the BD is built in normal memory and published with */
+/*   mcdma_bd_copy() like mcdma_ring_queue() does                    */
+/*********************************************************************/
+MCDMA_ENGINE_INLINE int mcdma_engine_queue_t(const struct mcdma_engine_traits *t, struct mcdma_ring *ring,
+                                             uint64_t buf, uint32_t len, uint32_t flags, const uint32_t *app,
+                                             void *cookie)
+{
+        struct mcdma_bd bd = { 0 };
+        uint32_t *words = (uint32_t *)&bd;
+        int i;
+
+        if (!mcdma_ring_space(ring))
+                return -EBUSY;
+        if (!len || len > MCDMA_BD_LEN_MASK)
+                return -EINVAL;
+
+        bd.buf = (uint32_t)buf;
+        bd.buf_msb = (uint32_t)(buf >> 32);
+        words[t->bd_ctrl >> 2] = len | (flags & MCDMA_BD_CTRL_SOF ? t->bd_sof : 0) |
+                                 (flags & MCDMA_BD_CTRL_EOF ? t->bd_eof : 0);
+        for (i = 0; app && i < MCDMA_BD_NUM_APP; i++)
+                bd.app[i] = app[i];
+        mcdma_bd_copy(&ring->bd[ring->head], &bd);
+
+        ring->cookie[ring->head] = cookie;
+        ring->head = (ring->head + 1) % ring->depth;
+        ring->pending++;
+        return 0;
+}
+
+// clear the pending irq bits of the channel, returns SR as read
+MCDMA_ENGINE_INLINE uint32_t mcdma_engine_ack_t(const struct mcdma_engine_traits *t, struct mcdma_chan *ch)
+{
+        uint32_t sr = mcdma_chan_read(ch, MCDMA_CH_SR);
+
+        if (sr & t->sr_irq_mask)
+                mcdma_chan_write(ch, MCDMA_CH_SR, sr & t->sr_irq_mask);
+        return sr;
+}
+
+MCDMA_ENGINE_INLINE int mcdma_engine_failed_t(const struct mcdma_engine_traits *t, const struct mcdma_chan *ch)
+{
+        return !!(mcdma_chan_read(ch, MCDMA_CH_SR) & t->sr_err);
+}
+
+/*********************************************************************/
+/*                  run time selected engine                         */
+/*********************************************************************/
+struct mcdma_engine_ops {
+        int (*queue)(struct mcdma_ring *ring, uint64_t buf, uint32_t len, uint32_t flags, const uint32_t *app,
+                     void *cookie);
+        uint32_t (*ack)(struct mcdma_chan *ch);
+        int (*failed)(const struct mcdma_chan *ch);
+};
+
+struct mcdma_engine {
+        struct mcdma_dev *dev;
+        enum mcdma_engine_type type;
+        const struct mcdma_engine_traits *t;
+        const struct mcdma_engine_ops *ops;
+};
+
+// dt_node: a /proc/device-tree node whose compatible decides, NULL to probe DMASR.SGIncld
+int mcdma_engine_detect(struct mcdma_dev *dev, const char *dt_node, enum mcdma_engine_type *type);
+int mcdma_engine_open(struct mcdma_engine *eng, struct mcdma_dev *dev, const char *dt_node);
+void mcdma_engine_set_type(struct mcdma_engine *eng, struct mcdma_dev *dev, enum mcdma_engine_type type);
+int mcdma_engine_reset(struct mcdma_engine *eng);
+int mcdma_engine_run(struct mcdma_engine *eng);
+
+int mcdma_engine_chan_open(struct mcdma_engine *eng, struct mcdma_chan *ch, unsigned int id,
+                           void *bd_virt, uint64_t bd_phys, unsigned int depth);
+int mcdma_engine_chan_start(struct mcdma_engine *eng, struct mcdma_chan *ch);
+void mcdma_engine_chan_stop(struct mcdma_engine *eng, struct mcdma_chan *ch);
+
+static inline int mcdma_engine_queue(const struct mcdma_engine *eng, struct mcdma_ring *ring, uint64_t buf,
+                                     uint32_t len, uint32_t flags, const uint32_t *app, void *cookie)
+{
+        return eng->ops->queue(ring, buf, len, flags, app, cookie);
+}
+
+static inline uint32_t mcdma_engine_ack(const struct mcdma_engine *eng, struct mcdma_chan *ch)
+{
+        return eng->ops->ack(ch);
+}
+
+static inline int mcdma_engine_failed(const struct mcdma_engine *eng, const struct mcdma_chan *ch)
+{
+        return eng->ops->failed(ch);
+}
+
+#endif
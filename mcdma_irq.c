@@ -0,0 +1,294 @@
+#define _GNU_SOURCE                     //ppoll
+
+#include <linux/vfio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <sys/fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+
+#include <time.h>
+
+#include "mcdma_irq.h"
+
+/*********************************************************************/
+/*                        interrupt sources                          */
+/*********************************************************************/
+int mcdma_irq_open_uio(struct mcdma_irq *irq, const char *path)
+{
+        memset(irq, 0, sizeof(*irq));
+        irq->fd = open(path, O_RDWR | O_CLOEXEC);
+        if (irq->fd < 0)
+                return -errno;
+        irq->kind = MCDMA_IRQ_UIO;
+        return mcdma_irq_rearm(irq);
+}
+
+static int vfio_irq_set(int device_fd, unsigned int index, uint32_t flags, int efd)
+{
+        char buf[sizeof(struct vfio_irq_set) + sizeof(int32_t)];
+        struct vfio_irq_set *set = (struct vfio_irq_set *)buf;
+        int32_t fd = efd;
+
+        memset(buf, 0, sizeof(buf));
+        set->argsz = (flags & VFIO_IRQ_SET_DATA_EVENTFD) ? sizeof(buf) : sizeof(*set);
+        set->flags = flags;
+        set->index = index;
+        set->start = 0;
+        set->count = 1;
+        if (flags & VFIO_IRQ_SET_DATA_EVENTFD)
+                memcpy(set->data, &fd, sizeof(fd));
+        return ioctl(device_fd, VFIO_DEVICE_SET_IRQS, set) ? -errno : 0;
+}
+
+int mcdma_irq_open_vfio(struct mcdma_irq *irq, int device_fd, unsigned int index)
+{
+        int ret;
+
+        memset(irq, 0, sizeof(*irq));
+        irq->fd = eventfd(0, EFD_CLOEXEC);
+        if (irq->fd < 0)
+                return -errno;
+        ret = vfio_irq_set(device_fd, index, VFIO_IRQ_SET_DATA_EVENTFD | VFIO_IRQ_SET_ACTION_TRIGGER, irq->fd);
+        if (ret) {
+                close(irq->fd);
+                return ret;
+        }
+        irq->kind = MCDMA_IRQ_VFIO;
+        irq->vfio_dev = device_fd;
+        irq->vfio_index = index;
+        return 0;
+}
+
+int mcdma_irq_open_eventfd(struct mcdma_irq *irq, int efd)
+{
+        memset(irq, 0, sizeof(*irq));
+        if (efd < 0)
+                return -EINVAL;
+        irq->kind = MCDMA_IRQ_EVENTFD;
+        irq->fd = efd;
+        return 0;
+}
+
+void mcdma_irq_close(struct mcdma_irq *irq)
+{
+        if (irq->kind == MCDMA_IRQ_VFIO)
+                vfio_irq_set(irq->vfio_dev, irq->vfio_index, VFIO_IRQ_SET_DATA_NONE | VFIO_IRQ_SET_ACTION_TRIGGER, -1);
+        if (irq->kind == MCDMA_IRQ_UIO || irq->kind == MCDMA_IRQ_VFIO)
+                close(irq->fd);
+        irq->kind = MCDMA_IRQ_NONE;
+        irq->fd = -1;
+}
+
+// re-enable the line after the device has been acked
+int mcdma_irq_rearm(struct mcdma_irq *irq)
+{
+        uint32_t one = 1;
+
+        switch (irq->kind) {
+        case MCDMA_IRQ_UIO:
+                return write(irq->fd, &one, sizeof(one)) == sizeof(one) ? 0 : -errno;
+        case MCDMA_IRQ_VFIO:
+                return vfio_irq_set(irq->vfio_dev, irq->vfio_index, VFIO_IRQ_SET_DATA_NONE | VFIO_IRQ_SET_ACTION_UNMASK, -1);
+        default:
+                return 0;
+        }
+}
+
+// block until the interrupt fires, 1 on interrupt, 0 on timeout
+int mcdma_irq_wait(struct mcdma_irq *irq, int timeout_ms)
+{
+        return mcdma_irq_wait_ns(irq, timeout_ms < 0 ? -1 : (int64_t)timeout_ms * 1000000);
+}
+
+// the same with a timeout in ns, for callers that pace their own work between interrupts
+int mcdma_irq_wait_ns(struct mcdma_irq *irq, int64_t timeout_ns)
+{
+        struct pollfd pfd = { .fd = irq->fd, .events = POLLIN };
+        struct timespec ts = { .tv_sec = timeout_ns / 1000000000, .tv_nsec = timeout_ns % 1000000000 };
+        uint64_t cnt;
+        uint32_t ucnt;
+        ssize_t r;
+        int ret;
+
+        if (irq->kind == MCDMA_IRQ_NONE)
+                return -EINVAL;
+
+        ret = ppoll(&pfd, 1, timeout_ns < 0 ? NULL : &ts, NULL);
+        if (ret <= 0)
+                return ret < 0 ? -errno : 0;
+
+        // uio reports a 32 bit event count, eventfd a 64 bit one
+        if (irq->kind == MCDMA_IRQ_UIO)
+                r = read(irq->fd, &ucnt, sizeof(ucnt));
+        else
+                r = read(irq->fd, &cnt, sizeof(cnt));
+        if (r < 0)
+                return -errno;
+        irq->events++;
+        return 1;
+}
+
+/*********************************************************************/
+/*                        completion modes                           */
+/*********************************************************************/
+static const char *const wait_mode_names[] = {
+        [MCDMA_WAIT_POLL] = "poll",
+        [MCDMA_WAIT_IRQ] = "irq",
+        [MCDMA_WAIT_HYBRID] = "hybrid",
+};
+
+int mcdma_wait_mode_parse(const char *s, enum mcdma_wait_mode *mode)
+{
+        unsigned int i;
+
+        for (i = 0; i < sizeof(wait_mode_names) / sizeof(wait_mode_names[0]); i++) {
+                if (!strcmp(s, wait_mode_names[i])) {
+                        *mode = i;
+                        return 0;
+                }
+        }
+        return -EINVAL;
+}
+
+const char *mcdma_wait_mode_name(enum mcdma_wait_mode mode)
+{
+        return wait_mode_names[mode];
+}
+
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// clear the pending interrupt bits of CHx_SR and unmask the line, returns CHx_SR as read
+uint32_t mcdma_chan_ack(struct mcdma_chan *ch, struct mcdma_irq *irq)
+{
+        uint32_t sr = mcdma_chan_read(ch, MCDMA_CH_SR);
+
+        if (sr & MCDMA_CHSR_IRQ_MASK)
+                mcdma_chan_write(ch, MCDMA_CH_SR, sr & MCDMA_CHSR_IRQ_MASK);
+        mcdma_irq_rearm(irq);
+        return sr;
+}
+
+/*********************************************************************/
+/*   wait until the oldest in-flight BD of the channel is complete.  */
+/*   0 when a BD can be reclaimed, -EIO on Err_Irq, -ETIMEDOUT,      */
+/*   -EAGAIN when nothing is in flight                               */
+/*********************************************************************/
+int mcdma_chan_wait(struct mcdma_chan *ch, struct mcdma_irq *irq, enum mcdma_wait_mode mode,
+                    unsigned long spin_ns, int timeout_ms)
+{
+        struct mcdma_ring *ring = &ch->ring;
+        uint32_t sr;
+        int ret;
+
+        if (!ring->inflight)
+                return -EAGAIN;
+
+        if (mode != MCDMA_WAIT_IRQ) {
+                int forever = mode == MCDMA_WAIT_POLL && timeout_ms < 0;
+                uint64_t end = now_ns() + (mode == MCDMA_WAIT_POLL ? (uint64_t)timeout_ms * 1000000 : spin_ns);
+
+                for (;;) {
+                        if (mcdma_ring_peek(ring))
+                                return 0;
+                        if (mcdma_chan_read(ch, MCDMA_CH_SR) & MCDMA_CHSR_ERR_IRQ)
+                                return -EIO;
+                        if (!forever && now_ns() >= end)
+                                break;
+                }
+                if (mode == MCDMA_WAIT_POLL)
+                        return -ETIMEDOUT;
+        }
+
+        for (;;) {
+                // ack before checking the ring so a completion racing with us raises a new event
+                sr = mcdma_chan_ack(ch, irq);
+                if (sr & MCDMA_CHSR_ERR_IRQ)
+                        return -EIO;
+                if (mcdma_ring_peek(ring))
+                        return 0;
+
+                ret = mcdma_irq_wait(irq, timeout_ms);
+                if (ret < 0)
+                        return ret;
+                if (!ret)
+                        return -ETIMEDOUT;
+        }
+}
+
+/*********************************************************************/
+/*   adaptive coalescing: once per window the completion rate is     */
+/*   folded into a moving average and the threshold set to the       */
+/*   packets that complete within the latency budget, so one         */
+/*   interrupt covers them without any of them waiting longer than   */
+/*   target_ns.  Below one packet per budget it is 1 and the delay   */
+/*   timer off, the lowest latency; above, the delay timer is set to */
+/*   the budget and flushes a batch the load stops filling.  CR is   */
+/*   only rewritten once the target is a packet plus an eighth away. */
+/*********************************************************************/
+void mcdma_coalesce_init(struct mcdma_coalesce *co, unsigned long target_ns, unsigned int max_thresh)
+{
+        memset(co, 0, sizeof(*co));
+        co->target_ns = target_ns;
+        co->max_thresh = max_thresh < 1 ? 1 : max_thresh > MCDMA_CHCR_IRQ_MAX ? MCDMA_CHCR_IRQ_MAX : max_thresh;
+        co->thresh = 1;
+}
+
+// apply the starting point, threshold 1 without delay
+int mcdma_coalesce_start(struct mcdma_coalesce *co, struct mcdma_chan *ch, uint64_t now)
+{
+        co->win_start = now;
+        co->win_pkts = 0;
+        co->thresh = 1;
+        co->delay = 0;
+        co->writes++;
+        return mcdma_chan_set_coalesce(ch, co->thresh, co->delay);
+}
+
+// count n completions at now, 1 if CR was reprogrammed
+int mcdma_coalesce_update(struct mcdma_coalesce *co, struct mcdma_chan *ch, unsigned int n, uint64_t now)
+{
+        uint64_t dt = now - co->win_start;
+        unsigned long delay;
+        double rate, want;
+        unsigned int thresh;
+
+        co->win_pkts += n;
+        if (dt < MCDMA_COALESCE_WINDOW_NS)
+                return 0;
+        rate = co->win_pkts * 1e9 / dt;
+        co->rate = co->rate ? (3 * co->rate + rate) / 4 : rate;
+        co->win_start = now;
+        co->win_pkts = 0;
+
+        want = co->rate * co->target_ns / 1e9;
+        if (want > co->max_thresh)
+                want = co->max_thresh;
+        if (want - co->thresh < 1 + co->thresh / 8.0 && co->thresh - want < 1 + co->thresh / 8.0)
+                return 0;
+        thresh = want < 1 ? 1 : (unsigned int)want;
+
+        delay = thresh > 1 ? (co->target_ns + MCDMA_CHCR_IRQDELAY_UNIT_NS - 1) / MCDMA_CHCR_IRQDELAY_UNIT_NS : 0;
+        if (delay > MCDMA_CHCR_IRQ_MAX)
+                delay = MCDMA_CHCR_IRQ_MAX;
+        if (thresh > 1 && !delay)
+                delay = 1;
+        co->thresh = thresh;
+        co->delay = delay;
+        co->writes++;
+        mcdma_chan_set_coalesce(ch, co->thresh, co->delay);
+        return 1;
+}
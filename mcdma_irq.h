@@ -0,0 +1,80 @@
+#ifndef MCDMA_IRQ_H
+#define MCDMA_IRQ_H
+
+#include <stdint.h>
+
+#include "mcdma.h"
+
+/*********************************************************************/
+/*   interrupt source of one MCDMA channel (mm2s_chN_introut):       */
+/*   a UIO node, a VFIO IRQ index signalled through an eventfd, or   */
+/*   a bare eventfd raised by the software model                     */
+/*********************************************************************/
+enum mcdma_irq_kind {
+        MCDMA_IRQ_NONE,
+        MCDMA_IRQ_UIO,
+        MCDMA_IRQ_VFIO,
+        MCDMA_IRQ_EVENTFD,
+};
+
+struct mcdma_irq {
+        enum mcdma_irq_kind kind;
+        int fd;                         //fd to block on
+        int vfio_dev;                   //VFIO device fd, for unmask
+        unsigned int vfio_index;
+        uint64_t events;                //interrupts taken
+};
+
+int mcdma_irq_open_uio(struct mcdma_irq *irq, const char *path);
+int mcdma_irq_open_vfio(struct mcdma_irq *irq, int device_fd, unsigned int index);
+int mcdma_irq_open_eventfd(struct mcdma_irq *irq, int efd);
+void mcdma_irq_close(struct mcdma_irq *irq);
+int mcdma_irq_rearm(struct mcdma_irq *irq);
+int mcdma_irq_wait(struct mcdma_irq *irq, int timeout_ms);
+int mcdma_irq_wait_ns(struct mcdma_irq *irq, int64_t timeout_ns);
+
+/*********************************************************************/
+/*                        completion modes                           */
+/*   POLL    spin on the BD Cmplt bit                                */
+/*   IRQ     sleep on the interrupt, ack IOC/Dly/Err in CHx_SR       */
+/*   HYBRID  spin for spin_ns first, then sleep like IRQ             */
+/*********************************************************************/
+enum mcdma_wait_mode {
+        MCDMA_WAIT_POLL,
+        MCDMA_WAIT_IRQ,
+        MCDMA_WAIT_HYBRID,
+};
+
+#define MCDMA_WAIT_SPIN_NS_DEFAULT      20000
+
+int mcdma_wait_mode_parse(const char *s, enum mcdma_wait_mode *mode);
+const char *mcdma_wait_mode_name(enum mcdma_wait_mode mode);
+int mcdma_chan_wait(struct mcdma_chan *ch, struct mcdma_irq *irq, enum mcdma_wait_mode mode,
+                    unsigned long spin_ns, int timeout_ms);
+uint32_t mcdma_chan_ack(struct mcdma_chan *ch, struct mcdma_irq *irq);
+
+/*********************************************************************/
+/*   adaptive interrupt coalescing of one channel through the        */
+/*   IRQThreshold and IRQDelay fields of CHx_CR: threshold 1 at      */
+/*   light load, batches of what completes within target_ns under    */
+/*   heavy load, the delay timer bounding the wait for a batch.      */
+/*   Fed from the completion path with mcdma_coalesce_update().      */
+/*********************************************************************/
+#define MCDMA_COALESCE_WINDOW_NS        500000  //rate sampling window
+
+struct mcdma_coalesce {
+        unsigned long target_ns;        //latency an interrupt may add
+        unsigned int max_thresh;        //at most half the ring, so a full batch can be in flight
+        unsigned int thresh;            //as programmed
+        unsigned int delay;             //as programmed, MCDMA_CHCR_IRQDELAY_UNIT_NS ticks
+        double rate;                    //packets/s, moving average
+        uint64_t win_start;
+        uint64_t win_pkts;
+        uint64_t writes;                //CR updates
+};
+
+void mcdma_coalesce_init(struct mcdma_coalesce *co, unsigned long target_ns, unsigned int max_thresh);
+int mcdma_coalesce_start(struct mcdma_coalesce *co, struct mcdma_chan *ch, uint64_t now);
+int mcdma_coalesce_update(struct mcdma_coalesce *co, struct mcdma_chan *ch, unsigned int n, uint64_t now);
+
+#endif
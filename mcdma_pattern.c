@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#include "mcdma_pattern.h"
+
+#define PRBS_MUL1                       0x7feb352du
+#define PRBS_MUL2                       0x846ca68bu
+#define CHAN_SEED_MUL                   0x9e3779b9u             //spreads channel seeds apart
+
+/*********************************************************************/
+/*                    scalar reference of a word                     */
+/*********************************************************************/
+static inline uint32_t prbs_hash(uint32_t x)
+{
+        x ^= x >> 16;
+        x *= PRBS_MUL1;
+        x ^= x >> 15;
+        x *= PRBS_MUL2;
+        x ^= x >> 16;
+        return x;
+}
+
+uint32_t mcdma_pattern_word(enum mcdma_pattern pattern, uint32_t seed, size_t i)
+{
+        uint32_t x = seed + (uint32_t)i;
+
+        return pattern == MCDMA_PATTERN_COUNTER ? x : prbs_hash(x);
+}
+
+uint32_t mcdma_pattern_seed(enum mcdma_pattern pattern, uint32_t seed, unsigned int chan)
+{
+        return pattern == MCDMA_PATTERN_CHAN ? seed ^ (chan * CHAN_SEED_MUL) : seed;
+}
+
+static const char *const pattern_names[] = {
+        [MCDMA_PATTERN_COUNTER] = "counter",
+        [MCDMA_PATTERN_PRBS] = "prbs",
+        [MCDMA_PATTERN_CHAN] = "chan",
+};
+
+int mcdma_pattern_parse(const char *s, enum mcdma_pattern *pattern)
+{
+        unsigned int i;
+
+        for (i = 0; i < sizeof(pattern_names) / sizeof(pattern_names[0]); i++) {
+                if (!strcmp(s, pattern_names[i])) {
+                        *pattern = i;
+                        return 0;
+                }
+        }
+        return -EINVAL;
+}
+
+const char *mcdma_pattern_name(enum mcdma_pattern pattern)
+{
+        return pattern_names[pattern];
+}
+
+/*********************************************************************/
+/*   one vector of VEC_WORDS words: load/store unaligned, the index  */
+/*   ramp {0, 1, ..}, add, hash and an all-lanes-equal test          */
+/*********************************************************************/
+#if defined(__AVX2__)
+#define VEC_ISA                         "avx2"
+#define VEC_WORDS                       8
+typedef __m256i vec_t;
+#define vec_load(p)                     _mm256_loadu_si256((const __m256i *)(p))
+#define vec_store(p, v)                 _mm256_storeu_si256((__m256i *)(p), v)
+#define vec_splat(x)                    _mm256_set1_epi32((int)(x))
+#define vec_ramp()                      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)
+#define vec_add(a, b)                   _mm256_add_epi32(a, b)
+#define vec_xor(a, b)                   _mm256_xor_si256(a, b)
+#define vec_shr(a, n)                   _mm256_srli_epi32(a, n)
+#define vec_mul(a, b)                   _mm256_mullo_epi32(a, b)
+#define vec_equal(a, b)                 (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, b)) == -1)
+#elif defined(__SSE2__)
+#define VEC_ISA                         "sse2"
+#define VEC_WORDS                       4
+typedef __m128i vec_t;
+#define vec_load(p)                     _mm_loadu_si128((const __m128i *)(p))
+#define vec_store(p, v)                 _mm_storeu_si128((__m128i *)(p), v)
+#define vec_splat(x)                    _mm_set1_epi32((int)(x))
+#define vec_ramp()                      _mm_setr_epi32(0, 1, 2, 3)
+#define vec_add(a, b)                   _mm_add_epi32(a, b)
+#define vec_xor(a, b)                   _mm_xor_si128(a, b)
+#define vec_shr(a, n)                   _mm_srli_epi32(a, n)
+#define vec_equal(a, b)                 (_mm_movemask_epi8(_mm_cmpeq_epi32(a, b)) == 0xFFFF)
+
+// SSE2 has no 32 bit mullo, multiply even and odd lanes and interleave
+static inline vec_t vec_mul(vec_t a, vec_t b)
+{
+        __m128i even = _mm_mul_epu32(a, b);
+        __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+#elif defined(__ARM_NEON)
+#define VEC_ISA                         "neon"
+#define VEC_WORDS                       4
+typedef uint32x4_t vec_t;
+#define vec_load(p)                     vld1q_u32((const uint32_t *)(p))
+#define vec_store(p, v)                 vst1q_u32((uint32_t *)(p), v)
+#define vec_splat(x)                    vdupq_n_u32(x)
+#define vec_add(a, b)                   vaddq_u32(a, b)
+#define vec_xor(a, b)                   veorq_u32(a, b)
+#define vec_shr(a, n)                   vshrq_n_u32(a, n)
+#define vec_mul(a, b)                   vmulq_u32(a, b)
+
+static inline vec_t vec_ramp(void)
+{
+        static const uint32_t ramp[VEC_WORDS] = { 0, 1, 2, 3 };
+
+        return vld1q_u32(ramp);
+}
+
+static inline int vec_equal(vec_t a, vec_t b)
+{
+        uint32x4_t eq = vceqq_u32(a, b);
+#if defined(__aarch64__)
+        return vminvq_u32(eq) == 0xFFFFFFFFu;
+#else
+        uint32x2_t m = vand_u32(vget_low_u32(eq), vget_high_u32(eq));
+
+        return (vget_lane_u32(m, 0) & vget_lane_u32(m, 1)) == 0xFFFFFFFFu;
+#endif
+}
+#endif
+
+#ifdef VEC_WORDS
+static inline vec_t vec_hash(vec_t x)
+{
+        x = vec_xor(x, vec_shr(x, 16));
+        x = vec_mul(x, vec_splat(PRBS_MUL1));
+        x = vec_xor(x, vec_shr(x, 15));
+        x = vec_mul(x, vec_splat(PRBS_MUL2));
+        return vec_xor(x, vec_shr(x, 16));
+}
+
+// pattern words first .. first + VEC_WORDS - 1 given x = seed + first + ramp
+static inline vec_t vec_word(enum mcdma_pattern pattern, vec_t x)
+{
+        return pattern == MCDMA_PATTERN_COUNTER ? x : vec_hash(x);
+}
+
+const char *mcdma_pattern_isa(void)
+{
+        return VEC_ISA;
+}
+#else
+const char *mcdma_pattern_isa(void)
+{
+        return "scalar";
+}
+#endif
+
+/*********************************************************************/
+/*                      fill and check a buffer                      */
+/*********************************************************************/
+void mcdma_pattern_fill(void *buf, size_t words, enum mcdma_pattern pattern, uint32_t seed, size_t first)
+{
+        uint32_t *p = buf;
+        size_t i = 0;
+
+#ifdef VEC_WORDS
+        vec_t x = vec_add(vec_splat(seed + (uint32_t)first), vec_ramp());
+        vec_t step = vec_splat(VEC_WORDS);
+
+        // pattern is a loop invariant, the compiler unswitches it
+        for (; i + VEC_WORDS <= words; i += VEC_WORDS) {
+                vec_store(p + i, vec_word(pattern, x));
+                x = vec_add(x, step);
+        }
+#endif
+        for (; i < words; i++)
+                p[i] = mcdma_pattern_word(pattern, seed, first + i);
+}
+
+static void note_mismatch(struct mcdma_mismatch *mis, unsigned int *nmis, unsigned int max_mis, size_t i)
+{
+        struct mcdma_mismatch *last = *nmis ? &mis[*nmis - 1] : NULL;
+
+        if (last && last->first + last->count == i) {
+                last->count++;
+        } else if (*nmis < max_mis) {
+                mis[*nmis].first = i;
+                mis[*nmis].count = 1;
+                (*nmis)++;
+        }
+}
+
+static size_t check_scalar(const uint32_t *p, size_t from, size_t to, enum mcdma_pattern pattern, uint32_t seed,
+                           size_t first, struct mcdma_mismatch *mis, unsigned int *nmis, unsigned int max_mis)
+{
+        size_t i, bad = 0;
+
+        for (i = from; i < to; i++) {
+                if (p[i] != mcdma_pattern_word(pattern, seed, first + i)) {
+                        note_mismatch(mis, nmis, max_mis, first + i);
+                        bad++;
+                }
+        }
+        return bad;
+}
+
+/*********************************************************************/
+/*   returns the number of bad words, the first max_mis runs of bad  */
+/*   words are stored in mis[], later runs are only counted          */
+/*********************************************************************/
+size_t mcdma_pattern_check(const void *buf, size_t words, enum mcdma_pattern pattern, uint32_t seed, size_t first,
+                           struct mcdma_mismatch *mis, unsigned int *nmis, unsigned int max_mis)
+{
+        const uint32_t *p = buf;
+        size_t i = 0, bad = 0;
+
+        *nmis = 0;
+#ifdef VEC_WORDS
+        vec_t x = vec_add(vec_splat(seed + (uint32_t)first), vec_ramp());
+        vec_t step = vec_splat(VEC_WORDS);
+
+        for (; i + VEC_WORDS <= words; i += VEC_WORDS) {
+                // only a failing vector drops to the scalar path to find the lanes
+                if (!vec_equal(vec_load(p + i), vec_word(pattern, x)))
+                        bad += check_scalar(p, i, i + VEC_WORDS, pattern, seed, first, mis, nmis, max_mis);
+                x = vec_add(x, step);
+        }
+#endif
+        return bad + check_scalar(p, i, words, pattern, seed, first, mis, nmis, max_mis);
+}
+
+void mcdma_mem_zero(void *buf, size_t len)
+{
+        uint8_t *p = buf;
+
+#ifdef VEC_WORDS
+        const size_t vec = VEC_WORDS * 4;
+        vec_t zero = vec_splat(0);
+
+        for (; len && ((uintptr_t)p & (vec - 1)); len--)
+                *(volatile uint8_t *)p++ = 0;
+        for (; len >= 4 * vec; len -= 4 * vec, p += 4 * vec) {
+                vec_store(p, zero);
+                vec_store(p + vec, zero);
+                vec_store(p + 2 * vec, zero);
+                vec_store(p + 3 * vec, zero);
+        }
+        for (; len >= vec; len -= vec, p += vec)
+                vec_store(p, zero);
+#endif
+        // volatile keeps the compiler from turning the tail back into memset
+        for (; len >= 4 && !((uintptr_t)p & 3); len -= 4, p += 4)
+                *(volatile uint32_t *)p = 0;
+        for (; len; len--)
+                *(volatile uint8_t *)p++ = 0;
+}
+
+/*********************************************************************/
+/*                              CRC32C                               */
+/*********************************************************************/
+#define CRC32C_POLY                     0x82F63B78u             //reflected
+
+#if defined(__SSE4_2__) && defined(__x86_64__)
+#define crc32c_u8(c, v)                 _mm_crc32_u8(c, v)
+#define crc32c_u64(c, v)                ((uint32_t)_mm_crc32_u64(c, v))
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+#define crc32c_u8(c, v)                 __crc32cb(c, v)
+#define crc32c_u64(c, v)                __crc32cd(c, v)
+#else
+static uint32_t crc32c_table[8][256];
+
+__attribute__((constructor)) static void crc32c_init(void)
+{
+        uint32_t c;
+        int i, j;
+
+        for (i = 0; i < 256; i++) {
+                c = i;
+                for (j = 0; j < 8; j++)
+                        c = (c >> 1) ^ (c & 1 ? CRC32C_POLY : 0);
+                crc32c_table[0][i] = c;
+        }
+        for (i = 0; i < 256; i++) {
+                for (j = 1; j < 8; j++)
+                        crc32c_table[j][i] = (crc32c_table[j - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[j - 1][i] & 0xFF];
+        }
+}
+
+static inline uint32_t crc32c_u8(uint32_t c, uint8_t v)
+{
+        return (c >> 8) ^ crc32c_table[0][(c ^ v) & 0xFF];
+}
+
+// slicing by 8, little endian
+static inline uint32_t crc32c_u64(uint32_t c, uint64_t v)
+{
+        v ^= c;
+        return crc32c_table[7][v & 0xFF] ^ crc32c_table[6][(v >> 8) & 0xFF] ^
+               crc32c_table[5][(v >> 16) & 0xFF] ^ crc32c_table[4][(v >> 24) & 0xFF] ^
+               crc32c_table[3][(v >> 32) & 0xFF] ^ crc32c_table[2][(v >> 40) & 0xFF] ^
+               crc32c_table[1][(v >> 48) & 0xFF] ^ crc32c_table[0][v >> 56];
+}
+#endif
+
+uint32_t mcdma_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+        const uint8_t *p = buf;
+        uint64_t v;
+
+        crc = ~crc;
+        for (; len && ((uintptr_t)p & 7); len--)
+                crc = crc32c_u8(crc, *p++);
+        for (; len >= 8; len -= 8, p += 8) {
+                memcpy(&v, p, sizeof(v));
+                crc = crc32c_u64(crc, v);
+        }
+        for (; len; len--)
+                crc = crc32c_u8(crc, *p++);
+        return ~crc;
+}
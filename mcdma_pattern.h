@@ -0,0 +1,49 @@
+#ifndef MCDMA_PATTERN_H
+#define MCDMA_PATTERN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*********************************************************************/
+/*   test patterns for the loop buffers, generated and checked a     */
+/*   vector at a time (AVX2, SSE2 or NEON, whatever the compiler     */
+/*   targets, scalar otherwise).  Word i of a pattern depends only   */
+/*   on (seed, i), so any slice can be filled or checked on its own. */
+/*   COUNTER  seed + i, the original fill                            */
+/*   PRBS     pseudo random, a 32 bit integer hash of seed + i       */
+/*   CHAN     PRBS with the seed derived from the channel, catches   */
+/*            blocks delivered to another channel's buffer           */
+/*********************************************************************/
+enum mcdma_pattern {
+        MCDMA_PATTERN_COUNTER,
+        MCDMA_PATTERN_PRBS,
+        MCDMA_PATTERN_CHAN,
+};
+
+// consecutive bad words, indices relative to the start of the pattern
+struct mcdma_mismatch {
+        size_t first;
+        size_t count;
+};
+
+int mcdma_pattern_parse(const char *s, enum mcdma_pattern *pattern);
+const char *mcdma_pattern_name(enum mcdma_pattern pattern);
+const char *mcdma_pattern_isa(void);
+uint32_t mcdma_pattern_seed(enum mcdma_pattern pattern, uint32_t seed, unsigned int chan);
+uint32_t mcdma_pattern_word(enum mcdma_pattern pattern, uint32_t seed, size_t i);
+
+void mcdma_pattern_fill(void *buf, size_t words, enum mcdma_pattern pattern, uint32_t seed, size_t first);
+size_t mcdma_pattern_check(const void *buf, size_t words, enum mcdma_pattern pattern, uint32_t seed, size_t first,
+                           struct mcdma_mismatch *mis, unsigned int *nmis, unsigned int max_mis);
+
+// vector stores only, no dc zva / rep stos, so it is safe on uncached and device mappings
+void mcdma_mem_zero(void *buf, size_t len);
+
+/*********************************************************************/
+/*   CRC32C (Castagnoli), SSE4.2 / ARMv8 CRC instructions when the   */
+/*   compiler targets them.  Start with 0, feed the buffer in any    */
+/*   number of pieces.                                               */
+/*********************************************************************/
+uint32_t mcdma_crc32c(uint32_t crc, const void *buf, size_t len);
+
+#endif
@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <sys/eventfd.h>
+
+#include "mcdma_queue.h"
+
+#define QUEUE_ERR_CHECK_SPINS           256     //empty passes of a channel with BDs in flight between fault checks
+#define QUEUE_YIELD_SPINS               64      //idle passes between yields, producers may share the core
+#define QUEUE_SLEEP_MS                  100     //sleeping reaper looks at running this often
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()                     __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define cpu_relax()                     __asm__ __volatile__("yield" ::: "memory")
+#else
+#define cpu_relax()                     do { } while (0)
+#endif
+
+/*********************************************************************/
+/*   bounded MPMC ring (Vyukov): every slot carries a sequence       */
+/*   number, a producer owns a slot once it wins the CAS on tail,    */
+/*   publishes it with seq = pos + 1, a consumer frees it again      */
+/*   with seq = pos + depth.  Depth is a power of two.               */
+/*********************************************************************/
+static int qring_init(struct mcdma_qring *r, unsigned int depth)
+{
+        unsigned int i;
+
+        memset(r, 0, sizeof(*r));
+        if (depth < 2 || (depth & (depth - 1)))
+                return -EINVAL;
+        r->slot = aligned_alloc(64, (size_t)depth * sizeof(*r->slot));
+        if (!r->slot)
+                return -ENOMEM;
+        for (i = 0; i < depth; i++)
+                r->slot[i].seq = i;
+        r->mask = depth - 1;
+        return 0;
+}
+
+static void qring_free(struct mcdma_qring *r)
+{
+        free(r->slot);
+        r->slot = NULL;
+}
+
+static int qring_push(struct mcdma_qring *r, const void *e, size_t size)
+{
+        uint64_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+        struct mcdma_qslot *s;
+        int64_t dif;
+
+        for (;;) {
+                s = &r->slot[pos & r->mask];
+                dif = (int64_t)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) - pos);
+                if (!dif) {
+                        if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                                break;
+                } else if (dif < 0) {
+                        return -EAGAIN;
+                } else {
+                        pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+                }
+        }
+        memcpy(&s->sqe, e, size);
+        __atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+        return 0;
+}
+
+static int qring_pop(struct mcdma_qring *r, void *e, size_t size)
+{
+        uint64_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        struct mcdma_qslot *s;
+        int64_t dif;
+
+        for (;;) {
+                s = &r->slot[pos & r->mask];
+                dif = (int64_t)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+                if (!dif) {
+                        if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                                break;
+                } else if (dif < 0) {
+                        return 0;
+                } else {
+                        pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+                }
+        }
+        memcpy(e, &s->sqe, size);
+        __atomic_store_n(&s->seq, pos + r->mask + 1, __ATOMIC_RELEASE);
+        return 1;
+}
+
+// lower bound for a single producer: consumers only ever make room
+static unsigned int qring_free_slots(const struct mcdma_qring *r)
+{
+        return r->mask + 1 - (unsigned int)(r->tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE));
+}
+
+static int qring_empty(const struct mcdma_qring *r)
+{
+        return __atomic_load_n(&r->head, __ATOMIC_SEQ_CST) == __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST);
+}
+
+/*********************************************************************/
+/*                            setup                                  */
+/*********************************************************************/
+int mcdma_queue_init(struct mcdma_queue *q, struct mcdma_chan **ch, unsigned int nch,
+                     unsigned int sq_depth, unsigned int cq_depth)
+{
+        unsigned int k;
+        int ret = 0;
+
+        memset(q, 0, sizeof(*q));
+        q->qc = calloc(nch, sizeof(*q->qc));
+        if (!q->qc)
+                return -ENOMEM;
+        q->nch = nch;
+        q->idle_spins = MCDMA_QUEUE_IDLE_SPINS;
+        q->efd = eventfd(0, EFD_CLOEXEC);
+        if (q->efd < 0)
+                ret = -errno;
+
+        for (k = 0; k < nch && !ret; k++) {
+                struct mcdma_qchan *c = &q->qc[k];
+
+                c->ch = ch[k];
+                c->pkt = calloc(ch[k]->ring.depth, sizeof(*c->pkt));
+                ret = c->pkt ? qring_init(&c->sq, sq_depth) : -ENOMEM;
+                if (!ret)
+                        ret = qring_init(&c->cq, cq_depth);
+        }
+        if (ret)
+                mcdma_queue_destroy(q);
+        return ret;
+}
+
+void mcdma_queue_destroy(struct mcdma_queue *q)
+{
+        unsigned int k;
+
+        for (k = 0; k < q->nch; k++) {
+                qring_free(&q->qc[k].sq);
+                qring_free(&q->qc[k].cq);
+                free(q->qc[k].pkt);
+        }
+        if (q->efd >= 0)
+                close(q->efd);
+        free(q->qc);
+        q->qc = NULL;
+        q->nch = 0;
+}
+
+int mcdma_queue_attach_stats(struct mcdma_queue *q, struct mcdma_stats *st)
+{
+        unsigned int k;
+
+        for (k = 0; k < q->nch; k++) {
+                q->qc[k].stats = mcdma_stats_slot(st, q->qc[k].ch);
+                if (!q->qc[k].stats)
+                        return -ENOSPC;
+        }
+        q->stats = st;
+        return 0;
+}
+
+int mcdma_queue_set_recover(struct mcdma_queue *q, unsigned int flags)
+{
+        if (flags & ~MCDMA_RECOVER_RETRY)
+                return -EINVAL;
+        q->recover = 1;
+        q->recover_flags = flags;
+        return 0;
+}
+
+/*********************************************************************/
+/*   doorbell stage: as many waiting packets as the BD ring takes,   */
+/*   then a single TAILDESC write for all of them                    */
+/*********************************************************************/
+static unsigned int queue_doorbell(struct mcdma_qchan *c)
+{
+        struct mcdma_ring *ring = &c->ch->ring;
+        uint64_t t = c->stats ? mcdma_stats_now() : 0;
+        unsigned int n = 0;
+
+        for (;;) {
+                struct mcdma_iov iov;
+                struct mcdma_qpkt *p;
+
+                if (!c->has_held && !qring_pop(&c->sq, &c->held, sizeof(c->held)))
+                        break;
+                c->has_held = 1;
+                iov.phys = c->held.buf;
+                iov.len = c->held.len;
+                if (mcdma_ring_queue_iov(ring, &iov, 1, c->held.app, NULL))
+                        break;                  //-EBUSY, mcdma_queue_submit() let nothing else through
+
+                p = &c->pkt[c->pkt_head];
+                p->cookie = c->held.cookie;
+                p->bds = mcdma_iov_bds(&iov, 1, ring->max_len);
+                p->status = 0;
+                p->len = 0;
+                p->t_kick = t;
+                c->pkt_head = (c->pkt_head + 1) % ring->depth;
+                c->has_held = 0;
+                n++;
+        }
+        if (n) {
+                mcdma_ring_kick(ring);
+                c->doorbells++;
+                c->submitted += n;
+        }
+        return n;
+}
+
+/*********************************************************************/
+/*   a halted channel completes nothing, catch it instead of         */
+/*   spinning on it forever.  With recovery only that channel is     */
+/*   restarted, the BDs it skips come back through the next reclaim  */
+/*   as failed packets.                                              */
+/*********************************************************************/
+static void queue_check_chan(struct mcdma_queue *q, struct mcdma_qchan *c)
+{
+        struct mcdma_fault f;
+        int ret = mcdma_chan_fault(c->ch, &f);
+
+        if (!ret)
+                return;
+        if (ret > 0 && q->recover && mcdma_chan_recover(c->ch, &f, q->recover_flags) >= 0)
+                return;
+        __atomic_store_n(&q->error, -EIO, __ATOMIC_RELAXED);
+}
+
+/*********************************************************************/
+/*   reap stage: reclaim no more BDs than the completion ring has    */
+/*   room for (each BD finishes at most one packet), one cqe per     */
+/*   packet once its last BD is back                                 */
+/*********************************************************************/
+static int queue_reap(struct mcdma_queue *q, struct mcdma_qchan *c)
+{
+        struct mcdma_cpl cpl[MCDMA_QUEUE_REAP_BATCH];
+        unsigned int room = qring_free_slots(&c->cq);
+        uint64_t t = 0;
+        int i, n;
+
+        if (!room)
+                return 0;
+        n = mcdma_chan_reclaim(c->ch, cpl, room < MCDMA_QUEUE_REAP_BATCH ? (int)room : MCDMA_QUEUE_REAP_BATCH);
+        if (n)
+                c->stalled = 0;
+        else if (c->ch->ring.inflight && !(++c->stalled % QUEUE_ERR_CHECK_SPINS))
+                queue_check_chan(q, c);
+        if (n && c->stats)
+                t = mcdma_stats_now();
+        for (i = 0; i < n; i++) {
+                struct mcdma_qpkt *p = &c->pkt[c->pkt_tail];
+
+                p->status |= cpl[i].status & MCDMA_BD_STS_ERR_MASK;
+                p->len += cpl[i].len;
+                if (--p->bds)
+                        continue;
+
+                cpl[i].cookie = p->cookie;
+                cpl[i].status |= p->status;
+                cpl[i].len = p->len;
+                if ((cpl[i].status & MCDMA_BD_STS_ERR_MASK) && !q->recover)
+                        __atomic_store_n(&q->error, -EIO, __ATOMIC_RELAXED);
+                if (c->stats)
+                        mcdma_stats_latency(c->stats, t - p->t_kick);
+                qring_push(&c->cq, &cpl[i], sizeof(cpl[i]));
+                c->pkt_tail = (c->pkt_tail + 1) % c->ch->ring.depth;
+                c->completed++;
+        }
+        return n;
+}
+
+static int queue_inflight(const struct mcdma_queue *q)
+{
+        unsigned int k;
+
+        for (k = 0; k < q->nch; k++) {
+                if (q->qc[k].ch->ring.inflight)
+                        return 1;
+        }
+        return 0;
+}
+
+// register samples and counter copies once a period, not per pass
+static void queue_publish(struct mcdma_queue *q)
+{
+        uint64_t now = mcdma_stats_now();
+        unsigned int k;
+
+        if (now < q->stats_next)
+                return;
+        q->stats_next = now + MCDMA_STATS_PERIOD_NS;
+        for (k = 0; k < q->nch; k++) {
+                struct mcdma_qchan *c = &q->qc[k];
+                uint64_t head = __atomic_load_n(&c->sq.head, __ATOMIC_RELAXED);
+
+                __atomic_store_n(&c->stats->queued, __atomic_load_n(&c->sq.tail, __ATOMIC_RELAXED) - head + c->has_held,
+                                 __ATOMIC_RELAXED);
+                mcdma_stats_publish(c->stats, c->ch, now);
+        }
+}
+
+// nothing queued and nothing in flight: sleep until a producer signals
+static void queue_sleep(struct mcdma_queue *q)
+{
+        struct pollfd pfd = { .fd = q->efd, .events = POLLIN };
+        uint64_t v;
+        unsigned int k;
+
+        __atomic_store_n(&q->sleeping, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        for (k = 0; k < q->nch; k++) {
+                if (q->qc[k].has_held || !qring_empty(&q->qc[k].sq))
+                        break;
+        }
+        if (k == q->nch && poll(&pfd, 1, QUEUE_SLEEP_MS) > 0 && read(q->efd, &v, sizeof(v)) < 0)
+                v = 0;
+        __atomic_store_n(&q->sleeping, 0, __ATOMIC_RELAXED);
+}
+
+static void *queue_reaper(void *arg)
+{
+        struct mcdma_queue *q = arg;
+        unsigned long idle = 0;
+        unsigned int k, busy;
+        int n;
+
+        while (__atomic_load_n(&q->running, __ATOMIC_ACQUIRE)) {
+                busy = 0;
+                for (k = 0; k < q->nch; k++)
+                        busy += queue_doorbell(&q->qc[k]);
+                for (k = 0; k < q->nch; k++) {
+                        n = queue_reap(q, &q->qc[k]);
+                        busy += n > 0;
+                }
+                if (q->stats && (busy || !(idle % QUEUE_YIELD_SPINS)))
+                        queue_publish(q);
+                if (busy) {
+                        idle = 0;
+                        continue;
+                }
+                idle++;
+                if (!queue_inflight(q) && idle >= q->idle_spins) {
+                        if (q->stats) {
+                                q->stats_next = 0;
+                                queue_publish(q);       //the last word before going quiet
+                        }
+                        queue_sleep(q);
+                        idle = 0;
+                        continue;
+                }
+                if (idle % QUEUE_YIELD_SPINS)
+                        cpu_relax();
+                else
+                        sched_yield();
+        }
+        return NULL;
+}
+
+int mcdma_queue_start(struct mcdma_queue *q)
+{
+        int ret;
+
+        __atomic_store_n(&q->running, 1, __ATOMIC_RELEASE);
+        ret = pthread_create(&q->reaper, NULL, queue_reaper, q);
+        if (ret)
+                __atomic_store_n(&q->running, 0, __ATOMIC_RELEASE);
+        return -ret;
+}
+
+void mcdma_queue_stop(struct mcdma_queue *q)
+{
+        uint64_t one = 1;
+
+        if (!__atomic_exchange_n(&q->running, 0, __ATOMIC_ACQ_REL))
+                return;
+        if (write(q->efd, &one, sizeof(one)) < 0)
+                perror("queue wakeup");
+        pthread_join(q->reaper, NULL);
+        if (q->stats) {                   //the slots are ours now, leave final values behind
+                q->stats_next = 0;
+                queue_publish(q);
+        }
+}
+
+/*********************************************************************/
+/*                     producer / consumer side                      */
+/*********************************************************************/
+int mcdma_queue_submit(struct mcdma_queue *q, unsigned int chan, const struct mcdma_sqe *sqe)
+{
+        struct mcdma_qchan *c = &q->qc[chan];
+        struct mcdma_iov iov = { .phys = sqe->buf, .len = sqe->len };
+        uint64_t one = 1;
+        int ret;
+
+        // reject here what the reaper could never put on the BD ring
+        if (!sqe->len)
+                return -EINVAL;
+        if (mcdma_iov_bds(&iov, 1, c->ch->ring.max_len) > c->ch->ring.depth - 1)
+                return -E2BIG;
+
+        ret = qring_push(&c->sq, sqe, sizeof(*sqe));
+        if (ret)
+                return ret;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&q->sleeping, __ATOMIC_RELAXED) && write(q->efd, &one, sizeof(one)) < 0)
+                return -errno;
+        return 0;
+}
+
+int mcdma_queue_reap(struct mcdma_queue *q, unsigned int chan, struct mcdma_cpl *cqe, int max)
+{
+        struct mcdma_qchan *c = &q->qc[chan];
+        int n = 0;
+
+        while (n < max && qring_pop(&c->cq, &cqe[n], sizeof(cqe[n])))
+                n++;
+        return n;
+}
@@ -0,0 +1,100 @@
+#ifndef MCDMA_QUEUE_H
+#define MCDMA_QUEUE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "mcdma.h"
+#include "mcdma_stats.h"
+
+/*********************************************************************/
+/*   asynchronous submission, io_uring style.  Any number of threads */
+/*   post packets into a channel's submission ring and pick results  */
+/*   up from its completion ring, both bounded lock-free MPMC rings. */
+/*   One reaper thread owns the BD rings: its doorbell stage moves   */
+/*   whatever is waiting onto the BD ring and writes TAILDESC once   */
+/*   per batch, its reap stage turns finished BDs back into one      */
+/*   completion per packet.  No thread but the reaper touches a      */
+/*   register.                                                       */
+/*********************************************************************/
+struct mcdma_sqe {
+        uint64_t buf;                   //DMA address of the packet
+        uint32_t len;                   //any size, split to ring.max_len
+        uint32_t app[MCDMA_BD_NUM_APP]; //sideband of the SOF BD
+        void *cookie;
+};
+
+struct mcdma_qslot {
+        uint64_t seq;
+        union {
+                struct mcdma_sqe sqe;
+                struct mcdma_cpl cqe;   //status: last BD's, with the error bits of all; len: packet bytes
+        };
+};
+
+struct mcdma_qring {
+        struct mcdma_qslot *slot;
+        uint64_t mask;
+        uint64_t head __attribute__((aligned(64)));     //next to pop
+        uint64_t tail __attribute__((aligned(64)));     //next to push
+};
+
+// one packet on the BD ring, in submission order
+struct mcdma_qpkt {
+        void *cookie;
+        unsigned int bds;               //BDs not yet reclaimed
+        uint32_t status;
+        uint32_t len;
+        uint64_t t_kick;                //doorbell time, with stats only
+};
+
+struct mcdma_qchan {
+        struct mcdma_chan *ch;
+        struct mcdma_qring sq;
+        struct mcdma_qring cq;
+        struct mcdma_sqe held;          //popped, waiting for BD ring space
+        int has_held;
+        struct mcdma_qpkt *pkt;         //FIFO of ch->ring.depth packets
+        unsigned int pkt_head;
+        unsigned int pkt_tail;
+        uint64_t doorbells;             //TAILDESC writes, reaper only
+        uint64_t submitted;             //packets put on the BD ring, reaper only
+        uint64_t completed;             //packets posted to the cq, reaper only
+        unsigned long stalled;          //reap passes with BDs in flight and nothing back, reaper only
+        struct mcdma_stats_chan *stats; //NULL without mcdma_queue_attach_stats
+};
+
+struct mcdma_queue {
+        struct mcdma_qchan *qc;
+        unsigned int nch;
+        pthread_t reaper;
+        int running;
+        int sleeping;                   //reaper blocked on efd, producers must signal
+        int efd;
+        int error;                      //first BD or channel error seen by the reaper
+        int recover;                    //restart faulted channels instead of setting error
+        unsigned int recover_flags;     //MCDMA_RECOVER_*
+        unsigned long idle_spins;       //empty passes before the reaper sleeps
+        struct mcdma_stats *stats;
+        uint64_t stats_next;            //next publish, CLOCK_MONOTONIC ns
+};
+
+#define MCDMA_QUEUE_IDLE_SPINS          4096
+#define MCDMA_QUEUE_REAP_BATCH          32
+
+int mcdma_queue_init(struct mcdma_queue *q, struct mcdma_chan **ch, unsigned int nch,
+                     unsigned int sq_depth, unsigned int cq_depth);
+void mcdma_queue_destroy(struct mcdma_queue *q);
+
+// before start: the reaper records doorbell to completion latency and publishes every channel
+int mcdma_queue_attach_stats(struct mcdma_queue *q, struct mcdma_stats *st);
+// before start: a channel that faults is recovered on its own, its failed packets complete with the error bits
+int mcdma_queue_set_recover(struct mcdma_queue *q, unsigned int flags);
+int mcdma_queue_start(struct mcdma_queue *q);
+void mcdma_queue_stop(struct mcdma_queue *q);
+
+// -EAGAIN when the submission ring is full, completions are popped up to max
+int mcdma_queue_submit(struct mcdma_queue *q, unsigned int chan, const struct mcdma_sqe *sqe);
+int mcdma_queue_reap(struct mcdma_queue *q, unsigned int chan, struct mcdma_cpl *cqe, int max);
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "mcdma_rx.h"
+
+int mcdma_rx_init(struct mcdma_rx *rx, struct mcdma_chan *ch, struct mcdma_pool *pool, unsigned int flags)
+{
+        if (ch->common != S2MM_OFFSET || !pool->count)
+                return -EINVAL;
+
+        memset(rx, 0, sizeof(*rx));
+        rx->ch = ch;
+        rx->pool = pool;
+        rx->flags = flags;
+        rx->buf_len = pool->obj_size < ch->ring.max_len ? (uint32_t)pool->obj_size : ch->ring.max_len;
+        rx->low = ch->ring.depth / 4;
+        return 0;
+}
+
+// CURDESC goes to the ring head before anything is armed, then the ring is filled
+int mcdma_rx_start(struct mcdma_rx *rx)
+{
+        int ret = mcdma_chan_start(rx->ch);
+
+        if (ret)
+                return ret;
+        return mcdma_rx_refill(rx) ? 0 : -ENOBUFS;
+}
+
+// stop fetching and take back the buffers still armed, the engine must be idle or reset
+void mcdma_rx_stop(struct mcdma_rx *rx)
+{
+        struct mcdma_ring *ring = &rx->ch->ring;
+
+        mcdma_chan_stop(rx->ch);
+        while (ring->inflight) {
+                mcdma_pool_put(rx->pool, ring->cookie[ring->tail]);
+                ring->tail = (ring->tail + 1) % ring->depth;
+                ring->inflight--;
+        }
+}
+
+/*********************************************************************/
+/*   arm every free ring slot and hand them over with one TAILDESC   */
+/*   write.  Cached buffers are cleaned and invalidated first so no  */
+/*   dirty line is evicted over what the engine writes.              */
+/*********************************************************************/
+unsigned int mcdma_rx_refill(struct mcdma_rx *rx)
+{
+        struct mcdma_ring *ring = &rx->ch->ring;
+        struct mcdma_region *region = rx->pool->arena->region;
+        unsigned int n = 0;
+        uint64_t phys;
+        void *virt;
+
+        while (mcdma_ring_space(ring)) {
+                virt = mcdma_pool_get(rx->pool, &phys);
+                if (!virt) {
+                        rx->no_buf += !n;
+                        break;
+                }
+                if (region->cache == MCDMA_CACHE_CACHED)
+                        mcdma_region_sync_for_device(region, virt, rx->buf_len);
+                mcdma_ring_queue(ring, phys, rx->buf_len, 0, NULL, virt);
+                n++;
+        }
+        if (n) {
+                mcdma_ring_kick(ring);
+                rx->doorbells++;
+        }
+        return n;
+}
+
+/*********************************************************************/
+/*   completed BDs in ring order.  The status word sits where MM2S   */
+/*   keeps its sideband, so this reads the ring as S2MM BDs instead  */
+/*   of going through mcdma_ring_reclaim.                            */
+/*********************************************************************/
+int mcdma_rx_poll(struct mcdma_rx *rx, struct mcdma_rx_buf *buf, int max)
+{
+        struct mcdma_ring *ring = &rx->ch->ring;
+        volatile struct mcdma_s2mm_bd *bd = (volatile struct mcdma_s2mm_bd *)ring->bd;
+        struct mcdma_region *region = rx->pool->arena->region;
+        int n = 0, a, dry;
+
+        // the engine had nothing left to write into once the last armed BD is filled
+        dry = ring->inflight && (bd[(ring->tail + ring->inflight - 1) % ring->depth].status & MCDMA_BD_STS_CMPLT);
+        while (n < max && ring->inflight) {
+                volatile struct mcdma_s2mm_bd *d = &bd[ring->tail];
+                struct mcdma_rx_buf *b = &buf[n];
+                uint32_t status = d->status, sb;
+
+                if (!(status & MCDMA_BD_STS_CMPLT))
+                        break;
+                mcdma_rmb();
+
+                sb = d->sideband;
+                b->virt = ring->cookie[ring->tail];
+                b->phys = mcdma_arena_phys(rx->pool->arena, b->virt);
+                b->len = status & MCDMA_BD_LEN_MASK;
+                b->status = status;
+                b->tid = MCDMA_BD_SB_TID(sb);
+                b->tdest = MCDMA_BD_SB_TDEST(sb);
+                b->tuser = MCDMA_BD_SB_TUSER(sb);
+                for (a = 0; (rx->flags & MCDMA_RX_APP) && (status & MCDMA_BD_STS_RXEOF) && a < MCDMA_BD_NUM_APP; a++)
+                        b->app[a] = d->app[a];
+                if (region->cache == MCDMA_CACHE_CACHED)
+                        mcdma_region_sync_for_cpu(region, b->virt, b->len);
+
+                mcdma_chan_count_err(rx->ch, status);
+                if (status & MCDMA_BD_STS_RXEOF)
+                        rx->ch->packets++;
+                rx->ch->bytes += b->len;
+                n++;
+
+                ring->tail = (ring->tail + 1) % ring->depth;
+                ring->inflight--;
+                rx->held++;
+        }
+
+        rx->starved += dry;
+        if (n)
+                mcdma_rx_refill(rx);
+        return n;
+}
+
+void mcdma_rx_put(struct mcdma_rx *rx, void *virt)
+{
+        mcdma_pool_put(rx->pool, virt);
+        rx->held--;
+        if (rx->ch->ring.inflight < rx->low)
+                mcdma_rx_refill(rx);
+}
@@ -0,0 +1,55 @@
+#ifndef MCDMA_RX_H
+#define MCDMA_RX_H
+
+#include <stdint.h>
+
+#include "mcdma.h"
+#include "mcdma_arena.h"
+
+/*********************************************************************/
+/*   S2MM receive on one channel.  The BD ring stays armed: every    */
+/*   free ring slot gets a buffer from the pool, completed BDs hand  */
+/*   their buffer to the consumer as is (no copy) and the slot is    */
+/*   re-armed with whatever buffer the pool has next, so buffers may */
+/*   be returned in any order and held for a while.  A pool larger   */
+/*   than the ring keeps the ring full while the consumer holds      */
+/*   buffers; the ring depth covers how long it may stall.  Refills  */
+/*   are batched behind one TAILDESC write per poll, put refills at  */
+/*   once only when the ring runs low.  One consumer thread.  The    */
+/*   channel counts EOF buffers as packets, bytes and BD errors.     */
+/*********************************************************************/
+#define MCDMA_RX_APP                    BIT(0)  //copy the status stream APP words of EOF buffers
+
+struct mcdma_rx_buf {
+        void *virt;
+        uint64_t phys;
+        uint32_t len;                   //bytes received into this buffer
+        uint32_t status;                //BD status, MCDMA_BD_STS_RXSOF/RXEOF and error bits
+        uint16_t tuser;
+        uint8_t tid;
+        uint8_t tdest;
+        uint32_t app[MCDMA_BD_NUM_APP]; //EOF buffers with MCDMA_RX_APP only
+};
+
+struct mcdma_rx {
+        struct mcdma_chan *ch;          //opened with mcdma_chan_open_s2mm
+        struct mcdma_pool *pool;
+        uint32_t buf_len;               //armed length of every BD
+        unsigned int flags;
+        unsigned int low;               //armed BDs below which put refills at once
+        unsigned int held;              //buffers out with the consumer
+        uint64_t starved;               //polls that found every armed BD filled, the engine stalled
+        uint64_t no_buf;                //refills that armed nothing, every buffer with the consumer
+        uint64_t doorbells;
+};
+
+int mcdma_rx_init(struct mcdma_rx *rx, struct mcdma_chan *ch, struct mcdma_pool *pool, unsigned int flags);
+int mcdma_rx_start(struct mcdma_rx *rx);
+void mcdma_rx_stop(struct mcdma_rx *rx);
+unsigned int mcdma_rx_refill(struct mcdma_rx *rx);
+
+// up to max filled buffers in arrival order, each owned by the caller until mcdma_rx_put
+int mcdma_rx_poll(struct mcdma_rx *rx, struct mcdma_rx_buf *buf, int max);
+void mcdma_rx_put(struct mcdma_rx *rx, void *virt);
+
+#endif
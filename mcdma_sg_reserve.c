@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <errno.h>
 #include <unistd.h>
 
@@ -13,304 +14,730 @@
 
 #include <time.h>
 
+#include "mcdma.h"
+#include "mcdma_arena.h"
+#include "mcdma_irq.h"
+#include "mcdma_pattern.h"
+#include "mcdma_sim.h"
+
 //define mmap locations
 #define AXI_DMA_REGISTER_LOCATION          0xB0000000           //AXI DMA Register Address Map
 #define AXI_DMA1_REGISTER_LOCATION         0xB0001000           //AXI DMA1 Register Address Map
 
-#define DESCRIPTOR_REGISTERS_SIZE          0xFFFF
-
-#define SG_DMA_DESCRIPTORS_WIDTH           0xFFFF
 #define MEMBLOCK_WIDTH                     0x3FFFFFF            //size of mem used by s2mm and mm2s,48MB
 #define BUFFER_BLOCK_WIDTH                 0x4000               //size of memory block per descriptor in bytes
-#define NUM_OF_DESCRIPTORS                 0x1                  //number of descriptors for each direction
-
-#define HP0_DMA_BUFFER_MEM_ADDRESS         0x40000000
-#define HP0_MM2S_DMA_BASE_MEM_ADDRESS      (HP0_DMA_BUFFER_MEM_ADDRESS)
-#define HP0_MM2S_DMA_DESCRIPTORS_ADDRESS   (HP0_MM2S_DMA_BASE_MEM_ADDRESS)
-#define HP0_MM2S_SOURCE_MEM_ADDRESS        (HP0_MM2S_DMA_BASE_MEM_ADDRESS + SG_DMA_DESCRIPTORS_WIDTH + 1)
+#define NUM_OF_DESCRIPTORS                 0x8                  //default depth of the BD ring for each engine
+#define NUM_OF_BLOCKS                      0x10                 //default number of blocks streamed through the ring
+#define RECLAIM_BATCH                      32
+#define PATTERN_SEED                       0x00000001           //first source word
+#define PATTERN_CHUNK                      0x10000              //fill and CRC this much while it is cache hot
+#define MAX_MISMATCHES                     16                   //mismatch ranges reported per channel
 
-#define HP0_MM2S_DMA1_BASE_MEM_ADDRESS     (HP0_DMA_BUFFER_MEM_ADDRESS + MEMBLOCK_WIDTH + 1)
-#define HP0_MM2S_DMA1_DESCRIPTORS_ADDRESS  (HP0_MM2S_DMA1_BASE_MEM_ADDRESS)
-#define HP0_MM2S_TARGET_MEM_ADDRESS        (HP0_MM2S_DMA1_BASE_MEM_ADDRESS + SG_DMA_DESCRIPTORS_WIDTH + 1)
+#define HP0_DMA_BUFFER_MEM_ADDRESS         0x40000000           //reserved DDR, BD rings and buffers come from here
+#define HP0_DMA_BUFFER_MEM_WIDTH           (2 * (MEMBLOCK_WIDTH + 1))
+#define BD_RING_MEM_WIDTH                  0x100000             //uncached BD window at the start of HP0 for -M wc|cached
 
+#define PL_LOOP_MEM_ADDRESS                0x80000000           //where the PL datamover parks the stream
 
 /*********************************************************************/
-/*                   define all register locations                   */
-/*               based on "LogiCORE IP Product Guide"                */
+/*        one stream per MM2S channel, each with its own BD ring     */
+/*        from the arena, its slice of the blocks and PL addresses   */
 /*********************************************************************/
-// MM2S CONTROL
-#define MM2S_DMACR			    0x0000					    //MM2S通用控制寄存器
-#define MM2S_DMACR_RESET		BIT(2)					    //MM2S通用复位控制位
-#define MM2S_DMACR_RUNSTOP		BIT(0)					    //MM2S通用启停控制位
-
-#define MM2S_DMASR			    0x0004					    //MM2S通用状态寄存器
-#define MM2S_DMASR_HALTED	    BIT(0)						//MM2S停止状态位
-#define MM2S_DMASR_IDLE		    BIT(1)						//MM2S空闲状态位
-
-#define MM2S_CHEN_OFFSET		0x0008					    //MM2S特定通道启用关闭寄存器
-
-#define MM2S_CH1CR                  0x040
-#define MM2S_CH1SR                  0x044
-#define MM2S_CURDESC                0x048                   // must align 0x40 addresses
-#define MM2S_CURDESC_MSB            0x04c                   // unused with 32bit addresses
-#define MM2S_TAILDESC               0x050                   // must align 0x40 addresses
-#define MM2S_TAILDESC_MSB           0x054                   // unused with 32bit addresses
-#define MM2S_PKTCNT_STAT            0x058
-
-int main(int argc, char **argv)
+struct loop_wait {
+        struct mcdma_platform *plat;
+        int simulate;
+        int uio_first;                  //dma0 channel n on /dev/uio<uio_first + n - 1>, dma1 16 further
+        enum mcdma_wait_mode mode;
+        unsigned long spin_ns;
+};
+
+struct loop_stream {
+        struct mcdma_chan ch;
+        struct mcdma_irq irq;
+        struct mcdma_arena *arena;
+        void *bd;                       //ring slab
+        uint64_t src;
+        uint64_t dst;
+        unsigned int blocks;
+        unsigned int queued;
+        unsigned int done;
+        unsigned int first;             //first block of the stream within a chunk, pipeline only
+        unsigned int per_chunk;         //blocks of the stream per chunk, pipeline only
+};
+
+static int open_irq(const struct loop_wait *w, struct mcdma_irq *irq, struct mcdma_dev *dev,
+                    unsigned int engine, unsigned int id)
 {
-        unsigned int* axi_dma_register_mmap;
-        unsigned int* axi_dma1_register_mmap;
-        unsigned int* mm2s_descriptor_register_mmap;
-        unsigned int* mm2s_DMA1_descriptor_register_mmap;
-        unsigned int* source_mem_map;
-        unsigned int* dest_mem_map;
-        int controlregister_ok = 0,mm2s_status;
-        uint32_t mm2s_current_descriptor_address;
-        uint32_t mm2s_tail_descriptor_address;
-        uint32_t DMA1_mm2s_current_descriptor_address;
-        uint32_t DMA1_mm2s_tail_descriptor_address;
+        char path[32];
 
+        if (w->mode == MCDMA_WAIT_POLL) {
+                memset(irq, 0, sizeof(*irq));
+                return 0;
+        }
+        if (w->simulate)
+                return mcdma_irq_open_eventfd(irq, mcdma_sim_irq_fd(w->plat, dev->phys, id));
+        if (w->uio_first < 0)
+                return -ENODEV;
+        snprintf(path, sizeof(path), "/dev/uio%u", w->uio_first + engine * MCDMA_MAX_CHANNELS + id - 1);
+        return mcdma_irq_open_uio(irq, path);
+}
 
-        /*********************************************************************/
-        /*               mmap the AXI DMA Register Address Map               */
-        /*               the base address is defined in vivado               */
-        /*                 by editing the offset address in                  */
-        /*            address editor tab ("open block diagramm")             */
-        /*********************************************************************/
-
-        int dh = open("/dev/mem", O_RDWR | O_SYNC);
-        axi_dma_register_mmap = mmap(NULL, DESCRIPTOR_REGISTERS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, dh, AXI_DMA_REGISTER_LOCATION);
-        printf("AXI_DMA_REGISTER_LOCATION ok \n");
+// blocks of stream k, the first ones take the remainder
+static unsigned int stream_slice(unsigned int k, unsigned int nch, unsigned int blocks, unsigned int *first)
+{
+        *first = k * (blocks / nch) + (k < blocks % nch ? k : blocks % nch);
+        return blocks / nch + (k < blocks % nch);
+}
 
-        mm2s_descriptor_register_mmap = mmap(NULL, DESCRIPTOR_REGISTERS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, dh, HP0_MM2S_DMA_DESCRIPTORS_ADDRESS);
-        printf("HP0_MM2S_DMA_DESCRIPTORS_ADDRESS ok \n");
+static int open_streams(struct loop_stream *st, unsigned int nch, struct mcdma_dev *dev,
+                        struct mcdma_arena *arena, unsigned int depth,
+                        uint64_t src, uint64_t dst, unsigned int blocks,
+                        const struct loop_wait *w, unsigned int engine)
+{
+        unsigned int k, first;
+        uint64_t bd_phys;
 
-        source_mem_map = mmap(NULL, BUFFER_BLOCK_WIDTH * NUM_OF_DESCRIPTORS, PROT_READ | PROT_WRITE, MAP_SHARED, dh, (off_t)(HP0_MM2S_SOURCE_MEM_ADDRESS));
-        printf("HP0_MM2S_SOURCE_MEM_ADDRESS ok \n");
+        for (k = 0; k < nch; k++) {
+                struct loop_stream *s = &st[k];
 
-        mm2s_DMA1_descriptor_register_mmap = mmap(NULL, DESCRIPTOR_REGISTERS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, dh, HP0_MM2S_DMA1_DESCRIPTORS_ADDRESS);
-        printf("HP0_MM2S_DMA1_DESCRIPTORS_ADDRESS ok \n");
+                s->arena = arena;
+                s->bd = mcdma_arena_alloc_bds(arena, depth, &bd_phys);
+                if (!s->bd) {
+                        printf("channel %u: no room for %u descriptors \n", k + 1, depth);
+                        return -ENOMEM;
+                }
+                if (mcdma_chan_open(&s->ch, dev, k + 1, s->bd, bd_phys, depth))
+                        return -EINVAL;
+                if (open_irq(w, &s->irq, dev, engine, k + 1)) {
+                        printf("channel %u: no interrupt source \n", k + 1);
+                        return -ENODEV;
+                }
+                s->blocks = stream_slice(k, nch, blocks, &first);
+                s->src = src + (uint64_t)first * BUFFER_BLOCK_WIDTH;
+                s->dst = dst + (uint64_t)first * BUFFER_BLOCK_WIDTH;
+                s->queued = s->done = 0;
+        }
+        for (k = 0; k < nch; k++)
+                mcdma_chan_start(&st[k].ch);
+        return mcdma_dev_run(dev);
+}
 
-        dest_mem_map = mmap(NULL, BUFFER_BLOCK_WIDTH * NUM_OF_DESCRIPTORS, PROT_READ | PROT_WRITE, MAP_SHARED, dh, (off_t)(HP0_MM2S_TARGET_MEM_ADDRESS));
-        printf("HP0_S2MM_TARGET_MEM_ADDRESS ok \n");
+static double now_sec(void)
+{
+        struct timespec ts;
 
-        axi_dma1_register_mmap = mmap(NULL, DESCRIPTOR_REGISTERS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, dh, AXI_DMA1_REGISTER_LOCATION);
-        printf("AXI_DMA1_REGISTER_LOCATION ok \n");
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-        int i;
+/*********************************************************************/
+/*   queue one block on the stream's ring                            */
+/*       [APP0]: EOF=1,Type=1,BTT   [APP1/APP2]: PL write address    */
+/*********************************************************************/
+static void queue_block(struct loop_stream *s, uint64_t src, uint64_t dst)
+{
+        uint32_t app[MCDMA_BD_NUM_APP];
+
+        app[0] = DM_CMD_EOF | DM_CMD_TYPE_INCR | BUFFER_BLOCK_WIDTH;
+        app[1] = (uint32_t)dst;
+        app[2] = (uint32_t)(dst >> 32);
+        app[3] = 0xFFFFFF00;
+        app[4] = 0x11111111;                    //unused
+        mcdma_ring_queue(&s->ch.ring, src, BUFFER_BLOCK_WIDTH, MCDMA_BD_CTRL_SOF | MCDMA_BD_CTRL_EOF, app, NULL);
+        s->queued++;
+}
 
-        // fill mm2s-register memory with zeros
-        for (i = 0; i < DESCRIPTOR_REGISTERS_SIZE; i++) {
-                char *p = (char *)mm2s_descriptor_register_mmap;
-                p[i] = 0x00000000;
+// reclaim finished BDs, number reclaimed or -EIO on a BD or channel error
+static int reclaim_stream(struct loop_stream *s)
+{
+        struct mcdma_cpl cpl[RECLAIM_BATCH];
+        int i, n;
+
+        n = mcdma_chan_reclaim(&s->ch, cpl, RECLAIM_BATCH);
+        for (i = 0; i < n; i++) {
+                if (cpl[i].status & MCDMA_BD_STS_ERR_MASK) {
+                        printf("channel %u BD error, status 0x%08x\n", s->ch.id, cpl[i].status);
+                        return -EIO;
+                }
         }
-        printf("fill mm2s-register memory with zeros ok!\n");
+        s->done += n;
 
-        // fill source memory with a counter value
-        for (i = 0; i < (BUFFER_BLOCK_WIDTH / 4) * NUM_OF_DESCRIPTORS; i++) {
-                unsigned int *p = source_mem_map;
-                p[i] = 0x00000001 + i;
-        }
-        printf("fill source memory with a counter value ok!\n");
+        if (!n) {
+                uint32_t chsr = mcdma_chan_read(&s->ch, MCDMA_CH_SR);
 
-        // fill mm2s-DMA1 register memory with zeros
-        for (i = 0; i < DESCRIPTOR_REGISTERS_SIZE; i++) {
-                char *p = (char *)mm2s_DMA1_descriptor_register_mmap;
-                p[i] = 0x00000000;
+                if (chsr & MCDMA_CHSR_ERR_IRQ) {
+                        printf("channel %u ", s->ch.id);
+                        mcdma_print_status(chsr);
+                        printf("MM2S_ERR 0x%08x\n", mcdma_read(s->ch.dev, MM2S_ERR));
+                        return -EIO;
+                }
         }
-        printf("fill mm2s-DMA1 register memory with zeros ok!\n");
+        return n;
+}
 
-        // fill target memory with zeros
-        for (i = 0; i < (BUFFER_BLOCK_WIDTH / 4) * NUM_OF_DESCRIPTORS; i++) {
-                unsigned int *p = dest_mem_map;
-                p[i] = 0x0;
-        }
-        printf("fill target memory with zeros!\n");
+// nothing came back last pass: sleep / spin on the first channel with work in flight
+static int wait_streams(struct loop_stream *st, unsigned int nch, const struct loop_wait *w)
+{
+        unsigned int k;
 
-        /*********************************************************************/
-        /*                 reset and halt all dma operations                 */
-        /*********************************************************************/
-        axi_dma_register_mmap[MM2S_DMACR >> 2] =  0x4;
-        axi_dma_register_mmap[MM2S_DMACR >> 2] =  0x0;
+        for (k = 0; k < nch; k++) {
+                if (st[k].ch.ring.inflight) {
+                        int ret = mcdma_chan_wait(&st[k].ch, &st[k].irq, w->mode, w->spin_ns, 1000);
 
-        /*********************************************************************/
-        /*           build mm2s stream and control stream                    */
-        /* chains will be filled with next desc, buffer width and registers  */
-        /*                         [0]: next descr                           */
-        /*                         [1]: reserved                             */
-        /*                         [2]: buffer addr                          */
-        /*********************************************************************/
+                        if (ret == -ETIMEDOUT) {
+                                printf("channel %u timed out \n", st[k].ch.id);
+                                return ret;
+                        }
+                        // the wait acked Err_Irq, reclaim would not see it in CHx_SR any more
+                        if (ret == -EIO) {
+                                printf("channel %u Err_Irq\n", st[k].ch.id);
+                                printf("MM2S_ERR 0x%08x\n", mcdma_read(st[k].ch.dev, MM2S_ERR));
+                                return ret;
+                        }
+                        return 1;
+                }
+        }
+        return 0;
+}
 
-        mm2s_current_descriptor_address = HP0_MM2S_DMA_DESCRIPTORS_ADDRESS;                     // save current descriptor address
+/*********************************************************************/
+/*      stream blocks through the running rings: keep every ring     */
+/*    full, advance TAILDESC as BDs are queued, reclaim by Cmplt     */
+/*********************************************************************/
+static int stream_blocks(struct loop_stream *st, unsigned int nch, const struct loop_wait *w)
+{
+        unsigned int k, busy = nch, got = 1;
+        int n;
 
-        mm2s_descriptor_register_mmap[0x0 >> 2] = HP0_MM2S_DMA_DESCRIPTORS_ADDRESS + 0x40;      // set next descriptor address
-        mm2s_descriptor_register_mmap[0x4 >> 2] = 0x0;                                          // set next descriptor address MSB                
-        mm2s_descriptor_register_mmap[0x8 >> 2] = HP0_MM2S_SOURCE_MEM_ADDRESS + 0x0;            // set target buffer address
-        mm2s_descriptor_register_mmap[0xc >> 2] = 0x0;
-        mm2s_descriptor_register_mmap[0x14 >> 2] = 0xC0004000;                                   // set mm2s/s2mm buffer length to control register,16Byte
+        while (busy) {
+                if (!got && wait_streams(st, nch, w) < 0)
+                        return -ETIMEDOUT;
+                busy = 0;
+                got = 0;
+                for (k = 0; k < nch; k++) {
+                        struct loop_stream *s = &st[k];
 
+                        while (s->queued < s->blocks && mcdma_ring_space(&s->ch.ring)) {
+                                uint64_t off = (uint64_t)s->queued * BUFFER_BLOCK_WIDTH;
 
-        mm2s_descriptor_register_mmap[0x20 >> 2] = 0x40804000;                                  //EOF=1,Type=1,BTT=0x10, APP0
-        mm2s_descriptor_register_mmap[0x24 >> 2] = 0x80000000;                                  //APP1
-        mm2s_descriptor_register_mmap[0x28 >> 2] = 0x00000000;                                  //写地址为0x80000000,2GB位置, APP2
-        mm2s_descriptor_register_mmap[0x2C >> 2] = 0xFFFFFF00;                                  //高8位, APP3
-        mm2s_descriptor_register_mmap[0x30 >> 2] = 0x11111111;                                  //APP4,没有用▒
+                                queue_block(s, s->src + off, s->dst + off);
+                        }
+                        mcdma_ring_kick(&s->ch.ring);
+                }
 
-        mm2s_tail_descriptor_address = HP0_MM2S_DMA_DESCRIPTORS_ADDRESS;                        // save tail descriptor address, 只有一个描述符
+                for (k = 0; k < nch; k++) {
+                        struct loop_stream *s = &st[k];
 
+                        n = reclaim_stream(s);
+                        if (n < 0)
+                                return n;
+                        got += n;
+                        if (s->done < s->blocks)
+                                busy = 1;
+                }
+        }
+        return 0;
+}
 
-        /*********************************************************************/
-        /*                 set current descriptor addresses                  */
-        /*           and start dma operations (MM2S_DMACR.RS = 1)            */
-        /*********************************************************************/
-        axi_dma_register_mmap[MM2S_CHEN_OFFSET>>2] = 0x1;
+/*********************************************************************/
+/*   pipelined loop: the payload is cut into chunks, chunk c goes    */
+/*   through PL buffer set c % 2.  dma0 writes chunk c while dma1    */
+/*   reads back chunk c - 1; dma0 may only start chunk c once dma1   */
+/*   has drained chunk c - 2 from the same set.  Within a chunk the  */
+/*   blocks are split over the channels like the serial loop.        */
+/*********************************************************************/
+struct loop_stage {
+        struct loop_stream *st;
+        uint64_t src;                   //first chunk, per chunk stride chunk_bytes or ping-pong
+        uint64_t dst;
+        int src_pingpong;               //src (dma1) or dst (dma0) alternates between the two PL sets
+        unsigned int chunks_done;
+        double *t_start;                //per chunk, first BD queued
+        double *t_end;                  //per chunk, last BD reclaimed
+};
+
+static unsigned int stage_chunks_done(const struct loop_stage *g, unsigned int nch)
+{
+        unsigned int k, c, min = ~0u;
 
-        axi_dma_register_mmap[MM2S_CURDESC>>2] =  mm2s_current_descriptor_address;
-        axi_dma_register_mmap[MM2S_CURDESC_MSB >>2] =  0;
+        for (k = 0; k < nch; k++) {
+                c = g->st[k].done / g->st[k].per_chunk;
+                if (c < min)
+                        min = c;
+        }
+        return min;
+}
 
-        //Start the fetch of BDs for channel0.
-        axi_dma_register_mmap[MM2S_CH1CR >> 2] =  0x1;
-        axi_dma_register_mmap[MM2S_DMACR >> 2] =  0x1;
+// queue what the gate allows, chunk c may be queued while c < limit
+static void stage_queue(struct loop_stage *g, unsigned int nch, unsigned int limit, size_t chunk_bytes)
+{
+        unsigned int k;
+
+        for (k = 0; k < nch; k++) {
+                struct loop_stream *s = &g->st[k];
+
+                while (s->queued < s->blocks && mcdma_ring_space(&s->ch.ring)) {
+                        unsigned int c = s->queued / s->per_chunk;
+                        uint64_t in_chunk = (uint64_t)(s->first + s->queued % s->per_chunk) * BUFFER_BLOCK_WIDTH;
+                        uint64_t linear = (uint64_t)c * chunk_bytes + in_chunk;
+                        uint64_t pingpong = (uint64_t)(c % 2) * chunk_bytes + in_chunk;
+
+                        if (c >= limit)
+                                break;
+                        if (!g->t_start[c])
+                                g->t_start[c] = now_sec();
+                        queue_block(s, g->src + (g->src_pingpong ? pingpong : linear),
+                                    g->dst + (g->src_pingpong ? linear : pingpong));
+                }
+                mcdma_ring_kick(&s->ch.ring);
+        }
+}
 
-        //set Interrupt Threshold=1
-        mm2s_status = axi_dma_register_mmap[MM2S_CH1CR >> 2];
-        axi_dma_register_mmap[MM2S_CH1CR >> 2] =  mm2s_status & 0xFF01FFFF;
-        //Interrupt on Complete Interrupt Enable
-        mm2s_status = axi_dma_register_mmap[MM2S_CH1CR >> 2];
-        axi_dma_register_mmap[MM2S_CH1CR >> 2] =  mm2s_status | 0x20;
+static int stage_reclaim(struct loop_stage *g, unsigned int nch, unsigned int *got)
+{
+        unsigned int k, c;
+        int n;
+
+        for (k = 0; k < nch; k++) {
+                n = reclaim_stream(&g->st[k]);
+                if (n < 0)
+                        return n;
+                *got += n;
+        }
+        for (c = stage_chunks_done(g, nch); g->chunks_done < c; g->chunks_done++)
+                g->t_end[g->chunks_done] = now_sec();
+        return 0;
+}
 
-        /*********************************************************************/
-        /*                          start transfer                           */
-        /*                 (by setting the taildescriptors)                  */
-        /*********************************************************************/
-        axi_dma_register_mmap[MM2S_TAILDESC>>2] =  mm2s_tail_descriptor_address;
-        axi_dma_register_mmap[MM2S_TAILDESC_MSB>>2] =  0;
+static int pipe_blocks(struct loop_stage *wr, struct loop_stage *rd, unsigned int nch, unsigned int chunks,
+                       size_t chunk_bytes, const struct loop_wait *w)
+{
+        unsigned int got = 1;
+
+        while (rd->chunks_done < chunks) {
+                if (!got && (wait_streams(wr->st, nch, w) < 0 || wait_streams(rd->st, nch, w) < 0))
+                        return -ETIMEDOUT;
+                got = 0;
+                stage_queue(wr, nch, rd->chunks_done + 2, chunk_bytes);
+                stage_queue(rd, nch, wr->chunks_done, chunk_bytes);
+                if (stage_reclaim(wr, nch, &got) || stage_reclaim(rd, nch, &got))
+                        return -EIO;
+        }
+        return 0;
+}
 
-        /*********************************************************************/
-        /*                 wait until all transfers finished                 */
-        /*********************************************************************/
+// union of the chunk intervals, starts and ends are both in chunk order
+static double stage_busy(const struct loop_stage *g, unsigned int chunks)
+{
+        double busy = 0, from;
+        unsigned int c;
 
-        while (!controlregister_ok)
-        {
-                    mm2s_status = axi_dma_register_mmap[MM2S_CH1SR >> 2];
-                    controlregister_ok = (mm2s_status & 0x00000020);
-                    printf("Memory-mapped to stream status (0x%08x@0x%02x):\n", mm2s_status, MM2S_CH1SR);
-                    printf("MM2S_STATUS_REGISTER status register values:\n");
-                    if (mm2s_status & 0x00000001) printf(" idle");
-                    if (mm2s_status & 0x00000008) printf(" Err_on_other_Irq");
-                    if (mm2s_status & 0x00000020) printf(" IOC_Irq");
-                    if (mm2s_status & 0x00000040) printf(" Dly_Irq");
-                    if (mm2s_status & 0x00000080) printf(" Err_Irq");
-                    printf("\n");
-                    printf("\n");
+        for (c = 0; c < chunks; c++) {
+                from = c && g->t_end[c - 1] > g->t_start[c] ? g->t_end[c - 1] : g->t_start[c];
+                busy += g->t_end[c] - from;
         }
+        return busy;
+}
 
+static void print_stage(const char *name, const struct loop_stage *g, unsigned int chunks, size_t payload)
+{
+        double busy = stage_busy(g, chunks), worst = 0;
+        unsigned int c;
 
-        /*********************************************************************/
-        /*                 reset and halt all dma1 operations                 */
-        /*********************************************************************/
+        for (c = 0; c < chunks; c++) {
+                if (g->t_end[c] - g->t_start[c] > worst)
+                        worst = g->t_end[c] - g->t_start[c];
+        }
+        printf("%s: %.3f ms busy, %.1f MB/s while busy, chunk %.3f ms avg %.3f ms max \n",
+               name, busy * 1e3, payload / busy / 1e6, busy * 1e3 / chunks, worst * 1e3);
+}
 
-        axi_dma1_register_mmap[MM2S_DMACR >> 2] =  0x4;
-        axi_dma1_register_mmap[MM2S_DMACR >> 2] =  0x0;
+static void close_streams(struct loop_stream *st, unsigned int nch)
+{
+        unsigned int k;
 
-        /*********************************************************************/
-        /*           build mm2s and s2mm stream and control stream           */
-        /* chains will be filled with next desc, buffer width and registers  */
-        /*                         [0]: next descr                           */
-        /*                         [1]: reserved                             */
-        /*                         [2]: buffer addr                          */
-        /*********************************************************************/
+        for (k = 0; k < nch; k++) {
+                mcdma_chan_stop(&st[k].ch);
+                mcdma_chan_close(&st[k].ch);
+                mcdma_irq_close(&st[k].irq);
+                mcdma_arena_free(st[k].arena, st[k].bd);
+        }
+}
 
-        DMA1_mm2s_current_descriptor_address = HP0_MM2S_DMA1_DESCRIPTORS_ADDRESS;                     // save current descriptor address
+/*********************************************************************/
+/*   fill each channel's slice of the source with its pattern, with  */
+/*   -C the CRC of the whole payload is taken chunk by chunk while   */
+/*   the chunk is still in cache                                     */
+/*********************************************************************/
+static uint32_t fill_source(uint32_t *src, unsigned int nch, unsigned int blocks, enum mcdma_pattern pattern, int crc)
+{
+        const size_t block_words = BUFFER_BLOCK_WIDTH / 4, chunk = PATTERN_CHUNK / 4;
+        unsigned int k, first, n;
+        uint32_t sum = 0;
+        size_t w, end, len;
+
+        for (k = 0; k < nch; k++) {
+                uint32_t seed = mcdma_pattern_seed(pattern, PATTERN_SEED, k + 1);
+
+                n = stream_slice(k, nch, blocks, &first);
+                end = (size_t)(first + n) * block_words;
+                for (w = (size_t)first * block_words; w < end; w += len) {
+                        len = end - w < chunk ? end - w : chunk;
+                        mcdma_pattern_fill(src + w, len, pattern, seed, w);
+                        if (crc)
+                                sum = mcdma_crc32c(sum, src + w, len * 4);
+                }
+        }
+        return sum;
+}
 
-        mm2s_DMA1_descriptor_register_mmap[0x0 >> 2] = HP0_MM2S_DMA1_DESCRIPTORS_ADDRESS + 0x40;      // set next descriptor address
-        mm2s_DMA1_descriptor_register_mmap[0x4 >> 2] = 0x0;
-        mm2s_DMA1_descriptor_register_mmap[0x8 >> 2] = 0x80000000;            // set target buffer address
-        mm2s_DMA1_descriptor_register_mmap[0xc >> 2] = 0x0;
-        mm2s_DMA1_descriptor_register_mmap[0x18 >> 2] = 0xC0004000;                                   // set mm2s/s2mm buffer length to control register,16Byte
+// number of bad words, only the mismatching ranges are printed
+static size_t verify_target(const uint32_t *dst, unsigned int nch, unsigned int blocks, enum mcdma_pattern pattern)
+{
+        const size_t block_words = BUFFER_BLOCK_WIDTH / 4;
+        struct mcdma_mismatch mis[MAX_MISMATCHES];
+        unsigned int k, first, n, nmis, j;
+        size_t bad = 0, b;
+
+        for (k = 0; k < nch; k++) {
+                n = stream_slice(k, nch, blocks, &first);
+                b = mcdma_pattern_check(dst + (size_t)first * block_words, (size_t)n * block_words, pattern,
+                                        mcdma_pattern_seed(pattern, PATTERN_SEED, k + 1), (size_t)first * block_words,
+                                        mis, &nmis, MAX_MISMATCHES);
+                for (j = 0; j < nmis; j++)
+                        printf("test failed! - channel %u words 0x%zx..0x%zx (%zu) - first 0x%x expected 0x%x\n",
+                               k + 1, mis[j].first, mis[j].first + mis[j].count - 1, mis[j].count, dst[mis[j].first],
+                               mcdma_pattern_word(pattern, mcdma_pattern_seed(pattern, PATTERN_SEED, k + 1), mis[j].first));
+                if (b && nmis == MAX_MISMATCHES)
+                        printf("channel %u: more mismatch ranges not shown \n", k + 1);
+                bad += b;
+        }
+        return bad;
+}
 
+/*********************************************************************/
+/*   reset both engines and start every channel on both, then run    */
+/*   the chunks through the two PL buffer sets                       */
+/*********************************************************************/
+static int run_pipeline(struct mcdma_dev *dma0, struct mcdma_dev *dma1, struct loop_stream *st0,
+                        struct loop_stream *st1, unsigned int nch, unsigned int depth, unsigned int blocks,
+                        unsigned int chunks, const struct loop_wait *w, struct mcdma_arena *arena,
+                        uint64_t src, uint64_t dst)
+{
+        unsigned int chunk_blocks = blocks / chunks, k;
+        size_t chunk_bytes = (size_t)chunk_blocks * BUFFER_BLOCK_WIDTH, payload = (size_t)blocks * BUFFER_BLOCK_WIDTH;
+        double *t = calloc(4 * (size_t)chunks, sizeof(*t)), t0, elapsed;
+        struct loop_stage wr = { .st = st0, .src = src, .dst = PL_LOOP_MEM_ADDRESS };
+        struct loop_stage rd = { .st = st1, .src = PL_LOOP_MEM_ADDRESS, .dst = dst, .src_pingpong = 1 };
+        int ret = -1;
+
+        if (!t)
+                return -ENOMEM;
+        wr.t_start = t;
+        wr.t_end = t + chunks;
+        rd.t_start = t + 2 * chunks;
+        rd.t_end = t + 3 * chunks;
+
+        if (mcdma_dev_reset(dma0) || mcdma_dev_reset(dma1) ||
+            open_streams(st0, nch, dma0, arena, depth, wr.src, wr.dst, chunk_blocks, w, 0) ||
+            open_streams(st1, nch, dma1, arena, depth, rd.src, rd.dst, chunk_blocks, w, 1)) {
+                printf("pipeline start failed \n");
+                goto out;
+        }
+        for (k = 0; k < nch; k++) {
+                st0[k].per_chunk = st1[k].per_chunk = stream_slice(k, nch, chunk_blocks, &st0[k].first);
+                st1[k].first = st0[k].first;
+                st0[k].blocks = st1[k].blocks = st0[k].per_chunk * chunks;
+        }
+        printf("pipeline %u chunks of %zu KB, %u channels, rings of %u descriptors running \n",
+               chunks, chunk_bytes >> 10, nch, depth);
 
-        mm2s_DMA1_descriptor_register_mmap[0x20 >> 2] = 0x40804000;                                  //EOF=1,Type=1,BTT=0x10, APP0
-        mm2s_DMA1_descriptor_register_mmap[0x24 >> 2] = HP0_MM2S_TARGET_MEM_ADDRESS + 0x0;                                  //APP1
-        mm2s_DMA1_descriptor_register_mmap[0x28 >> 2] = 0x00000000;                                  //写地址为0x80000000,2GB位置, APP2
-        mm2s_DMA1_descriptor_register_mmap[0x2C >> 2] = 0xFFFFFF00;                                  //高8位, APP3
-        mm2s_DMA1_descriptor_register_mmap[0x30 >> 2] = 0x11111111;                                  //APP4,没有用▒
+        t0 = now_sec();
+        if (pipe_blocks(&wr, &rd, nch, chunks, chunk_bytes, w)) {
+                printf("pipeline transfer failed \n");
+                goto out;
+        }
+        elapsed = now_sec() - t0;
+
+        for (k = 0; k < nch; k++)
+                printf("dma0/dma1 channel %u: %llu/%llu bytes, PKTCNT %u/%u \n", st0[k].ch.id,
+                       (unsigned long long)st0[k].ch.bytes, (unsigned long long)st1[k].ch.bytes,
+                       mcdma_chan_read(&st0[k].ch, MCDMA_CH_PKTCNT_STAT), mcdma_chan_read(&st1[k].ch, MCDMA_CH_PKTCNT_STAT));
+        print_stage("dma0 write", &wr, chunks, payload);
+        print_stage("dma1 read ", &rd, chunks, payload);
+        printf("pipelined loop: %.3f ms, %.1f MB/s, %.3f ms of the stages overlapped \n", elapsed * 1e3,
+               payload / elapsed / 1e6, (stage_busy(&wr, chunks) + stage_busy(&rd, chunks) - elapsed) * 1e3);
+        ret = 0;
+out:
+        free(t);
+        return ret;
+}
 
-        DMA1_mm2s_tail_descriptor_address = HP0_MM2S_DMA1_DESCRIPTORS_ADDRESS;                        // save tail descriptor address, 只有一个描述符
+static void usage(const char *prog)
+{
+        printf("usage: %s [-s] [-S sim params] [-c channels] [-d ring depth] [-n blocks] [-w poll|irq|hybrid] [-u uio]\n"
+               "       [-P counter|prbs|chan] [-C] [-k chunks] [-m region] [-M uncached|wc|cached]\n", prog);
+        printf("  -s  run against the software model instead of /dev/mem (or MCDMA_BACKEND=sim)\n");
+        printf("  -S  model parameters, e.g. lat_ns=2000,bw_mbps=400,err_every=100,err=slv,err_chan=1\n");
+        printf("  -w  completion mode, -u dma0 channel n interrupts on /dev/uio<uio + n - 1>, dma1 on uio + 16 + n - 1\n");
+        printf("  -P  test pattern, chan seeds every channel differently, -C compare CRC32C first\n");
+        printf("  -m  memory for rings and buffers: mem (default, the HP0 reserved block), udmabuf:<name>,\n"
+               "      heap:<name>@<phys> or memfd (model only)\n");
+        printf("  -M  buffer mapping, cached and wc keep the BD rings in an uncached window of their own\n"
+               "      and sync the buffers around each direction (/dev/mem has no wc, use udmabuf)\n");
+        printf("  -k  pipeline the loop in k chunks through two PL buffer sets, dma1 reading chunk c - 1\n"
+               "      while dma0 writes chunk c (blocks must divide into k chunks of at least -c blocks)\n");
+}
 
+int main(int argc, char **argv)
+{
+        struct mcdma_platform *plat;
+        struct mcdma_dev dma0, dma1;
+        struct loop_stream st0[MCDMA_MAX_CHANNELS], st1[MCDMA_MAX_CHANNELS];
+        struct mcdma_region region, bd_region;
+        struct mcdma_arena arena, bd_arena, *bds = &arena;
+        enum mcdma_cache cache = MCDMA_CACHE_UNCACHED;
+        uint64_t data_phys = HP0_DMA_BUFFER_MEM_ADDRESS;
+        size_t data_size = HP0_DMA_BUFFER_MEM_WIDTH;
+        unsigned int* source_mem_map;
+        unsigned int* dest_mem_map;
+        uint64_t source_phys, dest_phys;
+        const char *region_spec = NULL;
+        unsigned int depth = NUM_OF_DESCRIPTORS, blocks = NUM_OF_BLOCKS, nch = 1, chunks = 0;
+        size_t payload;
+        struct loop_wait wait = { .uio_first = -1, .mode = MCDMA_WAIT_POLL, .spin_ns = MCDMA_WAIT_SPIN_NS_DEFAULT };
+        enum mcdma_pattern pattern = MCDMA_PATTERN_COUNTER;
+        const char *sim_spec = NULL;
+        int simulate = mcdma_sim_selected(), crc = 0, opt;
+        uint32_t src_crc;
+        size_t bad;
+        double t0, t_loop, t_start;
+
+        while ((opt = getopt(argc, argv, "sS:c:d:n:w:u:P:Ck:m:M:h")) != -1) {
+                switch (opt) {
+                case 's': simulate = 1; break;
+                case 'S': simulate = 1; sim_spec = optarg; break;
+                case 'u': wait.uio_first = atoi(optarg); break;
+                case 'w':
+                        if (mcdma_wait_mode_parse(optarg, &wait.mode)) {
+                                usage(argv[0]);
+                                return 1;
+                        }
+                        break;
+                case 'c': nch = strtoul(optarg, NULL, 0); break;
+                case 'd': depth = strtoul(optarg, NULL, 0); break;
+                case 'n': blocks = strtoul(optarg, NULL, 0); break;
+                case 'C': crc = 1; break;
+                case 'k': chunks = strtoul(optarg, NULL, 0); break;
+                case 'm': region_spec = optarg; break;
+                case 'M':
+                        if (mcdma_cache_parse(optarg, &cache)) {
+                                usage(argv[0]);
+                                return 1;
+                        }
+                        break;
+                case 'P':
+                        if (mcdma_pattern_parse(optarg, &pattern)) {
+                                usage(argv[0]);
+                                return 1;
+                        }
+                        break;
+                default: usage(argv[0]); return 1;
+                }
+        }
+        payload = (size_t)blocks * BUFFER_BLOCK_WIDTH;
+        if (nch < 1 || nch > MCDMA_MAX_CHANNELS || depth < 2 || !blocks || payload > MEMBLOCK_WIDTH + 1 ||
+            (chunks && (blocks % chunks || blocks / chunks < nch))) {
+                usage(argv[0]);
+                return 1;
+        }
 
         /*********************************************************************/
-        /*                 set current descriptor addresses                  */
-        /*           and start dma operations (S2MM_DMACR.RS = 1)            */
+        /*               mmap the AXI DMA Register Address Map               */
+        /*               the base address is defined in vivado               */
+        /*                 by editing the offset address in                  */
+        /*            address editor tab ("open block diagramm")             */
         /*********************************************************************/
 
-        axi_dma1_register_mmap[MM2S_CURDESC>>2] =  DMA1_mm2s_current_descriptor_address;
-        axi_dma1_register_mmap[MM2S_CURDESC_MSB >>2] =  0;
+        if (simulate) {
+                struct mcdma_sim_params params;
 
-        //Start the fetch of BDs for channel0.
-        axi_dma1_register_mmap[MM2S_CH1CR >> 2] =  0x1;
-        axi_dma1_register_mmap[MM2S_DMACR >> 2] =  0x1;
+                if (sim_spec && mcdma_sim_parse_params(sim_spec, &params)) {
+                        usage(argv[0]);
+                        return 1;
+                }
+                plat = mcdma_sim_open();
+                if (plat) {
+                        if (sim_spec)
+                                mcdma_sim_set_params(plat, 0, &params);
+                        mcdma_sim_add_engine(plat, AXI_DMA_REGISTER_LOCATION, MCDMA_SIM_MCDMA);
+                        mcdma_sim_add_engine(plat, AXI_DMA1_REGISTER_LOCATION, MCDMA_SIM_MCDMA);
+                        mcdma_sim_add_mem(plat, PL_LOOP_MEM_ADDRESS, MEMBLOCK_WIDTH + 1);
+                }
+        } else {
+                plat = mcdma_devmem_open();
+        }
+        if (!plat) {
+                perror("platform");
+                return 1;
+        }
+        printf("platform %s ok \n", plat->name);
+        wait.plat = plat;
+        wait.simulate = simulate;
 
-        //set Interrupt Threshold=1
-        mm2s_status = axi_dma1_register_mmap[MM2S_CH1CR >> 2];
-        axi_dma1_register_mmap[MM2S_CH1CR >> 2] =  mm2s_status & 0xFF01FFFF;
-        //Interrupt on Complete Interrupt Enable
-        mm2s_status = axi_dma1_register_mmap[MM2S_CH1CR >> 2];
-        axi_dma1_register_mmap[MM2S_CH1CR >> 2] =  mm2s_status | 0x20;
+        if (mcdma_dev_open(&dma0, plat, AXI_DMA_REGISTER_LOCATION)) {
+                printf("AXI_DMA_REGISTER_LOCATION failed \n");
+                return 1;
+        }
+        printf("AXI_DMA_REGISTER_LOCATION ok \n");
 
-        /*********************************************************************/
-        /*                          start transfer                           */
-        /*                 (by setting the taildescriptors)                  */
-        /*********************************************************************/
-        axi_dma1_register_mmap[MM2S_TAILDESC>>2] =  DMA1_mm2s_tail_descriptor_address;
-        axi_dma1_register_mmap[MM2S_TAILDESC_MSB>>2] =  0;
+        if (mcdma_dev_open(&dma1, plat, AXI_DMA1_REGISTER_LOCATION)) {
+                printf("AXI_DMA1_REGISTER_LOCATION failed \n");
+                return 1;
+        }
+        printf("AXI_DMA1_REGISTER_LOCATION ok \n");
 
         /*********************************************************************/
-        /*                 wait until all transfers finished                 */
+        /*    BD rings, source and target all come out of one arena over     */
+        /*    the reserved memory, a memfd stand-in is handed to the model.  */
+        /*    With cached or wc buffers the rings move to an uncached        */
+        /*    window of their own, the engine polls and writes them one BD   */
+        /*    at a time and no per BD cache maintenance is wanted.           */
         /*********************************************************************/
+        t_start = now_sec();
+        if (cache != MCDMA_CACHE_UNCACHED) {
+                if (mcdma_region_open_platform(&bd_region, plat, HP0_DMA_BUFFER_MEM_ADDRESS, BD_RING_MEM_WIDTH,
+                                               MCDMA_CACHE_UNCACHED) ||
+                    mcdma_arena_init(&bd_arena, &bd_region)) {
+                        printf("BD ring memory failed \n");
+                        return 1;
+                }
+                bds = &bd_arena;
+                data_phys += BD_RING_MEM_WIDTH;
+                data_size -= BD_RING_MEM_WIDTH;
+        }
+        if ((region_spec && !strcmp(region_spec, "memfd") && !simulate) ||
+            mcdma_region_open_spec(&region, region_spec, plat, data_phys, data_size, cache) ||
+            (region.kind == MCDMA_REGION_MEMFD &&
+             mcdma_sim_attach_mem(plat, region.phys, region.virt, region.size)) ||
+            mcdma_arena_init(&arena, &region)) {
+                printf("DMA memory region %s (%s) failed: %s \n", region_spec ? region_spec : "mem",
+                       mcdma_cache_name(cache), strerror(errno));
+                return 1;
+        }
+        printf("DMA memory 0x%llx, %zu MB, %s ok \n", (unsigned long long)region.phys, region.size >> 20,
+               mcdma_cache_name(region.cache));
+
+        source_mem_map = mcdma_arena_alloc(&arena, payload, &source_phys);
+        dest_mem_map = mcdma_arena_alloc(&arena, payload, &dest_phys);
+        if (!source_mem_map || !dest_mem_map) {
+                printf("no room for 2 x %zu bytes \n", payload);
+                return 1;
+        }
+        printf("source 0x%llx, target 0x%llx ok \n", (unsigned long long)source_phys, (unsigned long long)dest_phys);
 
-       while (!controlregister_ok)
-        {
-                    mm2s_status = axi_dma_register_mmap[MM2S_CH1SR >> 2];
-                    controlregister_ok = (mm2s_status & 0x00000020);
-                    printf("Memory-mapped to stream status (0x%08x@0x%02x):\n", mm2s_status, MM2S_CH1SR);
-                    printf("MM2S_STATUS_REGISTER status register values:\n");
-                    if (mm2s_status & 0x00000001) printf(" idle");
-                    if (mm2s_status & 0x00000008) printf(" Err_on_other_Irq");
-                    if (mm2s_status & 0x00000020) printf(" IOC_Irq");
-                    if (mm2s_status & 0x00000040) printf(" Dly_Irq");
-                    if (mm2s_status & 0x00000080) printf(" Err_Irq");
-                    printf("\n");
-                    printf("\n");
-        }
-
-
-        int c , flag = 0;
-        int fail_count = 0 , success_count = 0;
-        unsigned int *src_ptr = source_mem_map;
-        unsigned int *dst_ptr = dest_mem_map;
-        for(c = 0; c < (BUFFER_BLOCK_WIDTH / 4) * NUM_OF_DESCRIPTORS; c++) {
-                if(src_ptr[c] != dst_ptr[c]) {
-
-                        if(!flag) {
-                                flag = 1;
-                                //printf("test failed! - %d - 0x%x - 0x%x\n", c, src_ptr[c], dst_ptr[c]);
-                        }
-                        printf("test failed! - %d - 0x%x - 0x%x\n", c, src_ptr[c], dst_ptr[c]);
-                        fail_count++;
+        // fill target memory with zeros, wide stores only so wc and uncached mappings take it
+        mcdma_mem_zero(dest_mem_map, payload);
+        if (mcdma_region_sync_for_device(&region, dest_mem_map, payload)) {
+                printf("target sync failed \n");
+                return 1;
+        }
+        printf("fill target memory with zeros! (startup %.3f ms)\n", (now_sec() - t_start) * 1e3);
+
+        unsigned int i;
+
+        // fill source memory with the test pattern
+        t0 = now_sec();
+        src_crc = fill_source(source_mem_map, nch, blocks, pattern, crc);
+        if (mcdma_region_sync_for_device(&region, source_mem_map, payload)) {
+                printf("source sync failed \n");
+                return 1;
+        }
+        printf("fill source memory with %s pattern ok! (%s, %s, %.1f MB/s)\n", mcdma_pattern_name(pattern),
+               mcdma_pattern_isa(), mcdma_cache_name(region.cache), payload / (now_sec() - t0) / 1e6);
+
+        if (chunks) {
+                if (run_pipeline(&dma0, &dma1, st0, st1, nch, depth, blocks, chunks, &wait, bds,
+                                 source_phys, dest_phys))
+                        return 1;
+        } else {
+                /*********************************************************************/
+                /*      reset dma0, give every channel its own circular BD ring      */
+                /*      (zeroed and chained), start fetching, then stream the        */
+                /*      source to the PL loop memory on all channels at once         */
+                /*********************************************************************/
+                if (mcdma_dev_reset(&dma0) ||
+                    open_streams(st0, nch, &dma0, bds, depth, source_phys, PL_LOOP_MEM_ADDRESS, blocks, &wait, 0)) {
+                        printf("dma0 start failed \n");
+                        return 1;
                 }
-                else{
-                        if(flag) {
-                                flag = 0;
-                                //printf("test success! - %d - 0x%x - 0x%x\n", c, 4*src_ptr[c], dst_ptr[c]);
-                        }
-                        printf("test success! - %d - 0x%x - 0x%x\n", c, src_ptr[c], dst_ptr[c]);
-                        success_count++;
+                printf("dma0 %u channels, rings of %u descriptors running \n", nch, depth);
+
+                t0 = now_sec();
+                if (stream_blocks(st0, nch, &wait)) {
+                        printf("dma0 transfer failed \n");
+                        return 1;
                 }
+                for (i = 0; i < nch; i++)
+                        printf("dma0 channel %u: %llu bytes, PKTCNT %u \n", st0[i].ch.id, (unsigned long long)st0[i].ch.bytes,
+                               mcdma_chan_read(&st0[i].ch, MCDMA_CH_PKTCNT_STAT));
+
+                /*********************************************************************/
+                /*        same for dma1, reading the PL loop memory back into        */
+                /*                         the target buffer                         */
+                /*********************************************************************/
+                if (mcdma_dev_reset(&dma1) ||
+                    open_streams(st1, nch, &dma1, bds, depth, PL_LOOP_MEM_ADDRESS, dest_phys, blocks, &wait, 1)) {
+                        printf("dma1 start failed \n");
+                        return 1;
+                }
+                printf("dma1 %u channels, rings of %u descriptors running \n", nch, depth);
+
+                if (stream_blocks(st1, nch, &wait)) {
+                        printf("dma1 transfer failed \n");
+                        return 1;
+                }
+                t_loop = now_sec() - t0;
+                for (i = 0; i < nch; i++)
+                        printf("dma1 channel %u: %llu bytes, PKTCNT %u \n", st1[i].ch.id, (unsigned long long)st1[i].ch.bytes,
+                               mcdma_chan_read(&st1[i].ch, MCDMA_CH_PKTCNT_STAT));
+                printf("serial loop: %.3f ms, %.1f MB/s \n", t_loop * 1e3, payload / t_loop / 1e6);
         }
-        printf("fail count : %d\n",fail_count);
-        printf("success count : %d\n",success_count);
 
-        return 0;
+        /*********************************************************************/
+        /*   check the target: with -C a matching CRC is enough, otherwise   */
+        /*   or on a CRC mismatch compare against the pattern and report     */
+        /*   only the ranges of bad words                                    */
+        /*********************************************************************/
+        t0 = now_sec();
+        if (mcdma_region_sync_for_cpu(&region, dest_mem_map, payload)) {
+                printf("target sync failed \n");
+                return 1;
+        }
+        if (crc && mcdma_crc32c(0, dest_mem_map, payload) == src_crc) {
+                bad = 0;
+                printf("crc32c 0x%08x ok \n", src_crc);
+        } else {
+                if (crc)
+                        printf("crc32c mismatch, source 0x%08x \n", src_crc);
+                bad = verify_target(dest_mem_map, nch, blocks, pattern);
+        }
+        printf("verify %s %.1f MB/s \n", mcdma_cache_name(region.cache), payload / (now_sec() - t0) / 1e6);
+        printf("fail count : %zu\n", bad);
+        printf("success count : %zu\n", payload / 4 - bad);
+
+        close_streams(st0, nch);
+        close_streams(st1, nch);
+        mcdma_arena_free(&arena, source_mem_map);
+        mcdma_arena_free(&arena, dest_mem_map);
+        mcdma_arena_destroy(&arena);
+        if (bds != &arena) {
+                mcdma_arena_destroy(&bd_arena);
+                mcdma_region_close(&bd_region);
+        }
+        mcdma_dev_close(&dma0);
+        mcdma_dev_close(&dma1);
+        mcdma_region_close(&region);
+        plat->close(plat);
+        return bad ? 1 : 0;
 }
@@ -0,0 +1,1049 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include <time.h>
+
+#include "axidma.h"
+#include "mcdma_sim.h"
+
+#define SIM_MAX_REGIONS                 64
+#define SIM_MAX_ENGINES                 8
+#define SIM_NUM_CHANNELS                MCDMA_MAX_CHANNELS
+#define SIM_RX(n)                       (SIM_NUM_CHANNELS + (n))        //S2MM channels follow the MM2S ones
+#define SIM_CH_STRIDE                   (MM2S_CH_BASE(2) - MM2S_CH_BASE(1))
+#define SIM_SPIN_NS                     50000                   //shorter waits are spun, longer ones slept
+
+/*********************************************************************/
+/*   what differs between the engines: where a channel's register    */
+/*   block sits (the AXI DMA map is one MCDMA channel block at 0),   */
+/*   the interrupt bits (enables sit at the same positions in CR)    */
+/*   and the BD control word                                         */
+/*********************************************************************/
+struct sim_layout {
+        unsigned int nchan;
+        uint32_t ch_base;
+        uint32_t ch_stride;
+        uint32_t irq_ioc;
+        uint32_t irq_dly;
+        uint32_t irq_err;
+        uint32_t irq_err_other;
+        uint32_t sr_idle;
+        uint32_t sr_reset;              //SR value after reset
+        uint32_t bd_ctrl;
+        uint32_t bd_sof;
+        uint32_t bd_eof;
+        int has_pktcnt;
+        int has_s2mm;                   //S2MM block at S2MM_OFFSET, channels SIM_RX(0..nchan - 1)
+};
+
+static const struct sim_layout sim_layouts[] = {
+        [MCDMA_SIM_MCDMA] = {
+                .nchan = MCDMA_MAX_CHANNELS,
+                .ch_base = MM2S_CH_BASE(1),
+                .ch_stride = SIM_CH_STRIDE,
+                .irq_ioc = MCDMA_CHSR_IOC_IRQ,
+                .irq_dly = MCDMA_CHSR_DLY_IRQ,
+                .irq_err = MCDMA_CHSR_ERR_IRQ,
+                .irq_err_other = MCDMA_CHSR_ERR_OTHER_IRQ,
+                .sr_idle = MCDMA_CHSR_IDLE,
+                .sr_reset = MCDMA_CHSR_IDLE,
+                .bd_ctrl = offsetof(struct mcdma_bd, ctrl),
+                .bd_sof = MCDMA_BD_CTRL_SOF,
+                .bd_eof = MCDMA_BD_CTRL_EOF,
+                .has_pktcnt = 1,
+                .has_s2mm = 1,
+        },
+        [MCDMA_SIM_AXIDMA] = {
+                .nchan = 1,
+                .ch_base = AXIDMA_MM2S_DMACR,
+                .ch_stride = 0,
+                .irq_ioc = AXIDMA_SR_IOC_IRQ,
+                .irq_dly = AXIDMA_SR_DLY_IRQ,
+                .irq_err = AXIDMA_SR_ERR_IRQ,
+                .irq_err_other = 0,
+                .sr_idle = AXIDMA_SR_IDLE,
+                .sr_reset = AXIDMA_SR_HALTED | AXIDMA_SR_SGINCLD,
+                .bd_ctrl = offsetof(struct axidma_bd, ctrl),
+                .bd_sof = AXIDMA_BD_CTRL_SOF,
+                .bd_eof = AXIDMA_BD_CTRL_EOF,
+                .has_pktcnt = 0,
+        },
+};
+
+struct sim_region {
+        uint64_t phys;
+        size_t size;
+        uint8_t *mem;
+        int external;                   //caller's memory, not unmapped on close
+};
+
+struct sim_chan {
+        uint64_t next;                  //BD the engine fetches next
+        uint64_t tail;                  //last TAILDESC written
+        int doorbell;                   //tail written but not reached yet
+        int halted;                     //stopped on an error
+        uint64_t sink;                  //datamover write address of the current packet
+        int sink_valid;
+        unsigned int irq_count;         //completions since the last IOC or Dly_Irq
+        uint64_t dly_t;                 //when the delay timer fires, 0 if not running
+        int irq_fd;                     //eventfd standing in for mm2s/s2mm_chN_introut, -1 if unused
+        // S2MM stream source, packets arrive from rx_t0 on at params.rx_pps
+        uint64_t rx_t0;
+        uint64_t rx_done;               //packets written out, also the sequence number of the next
+        uint64_t rx_dropped;            //arrived while the source FIFO was full
+        uint64_t rx_stalls;             //times a packet waited for an armed BD
+        uint64_t rx_stall_ns;
+        uint64_t rx_stall_t;            //start of the current stall
+        uint64_t rx_stall_arr;          //arrivals the FIFO is not charged for in the current stall
+        int rx_stalled;
+        uint32_t rx_off;                //bytes of the current packet already written
+        uint64_t rx_seq;                //sequence number of the current packet
+};
+
+struct mcdma_sim;
+
+struct sim_engine {
+        struct mcdma_sim *sim;
+        uint64_t phys;
+        enum mcdma_sim_engine type;
+        const struct sim_layout *l;
+        struct mcdma_sim_params params;
+        uint64_t t_free;                //model time the stream is busy until, ns
+        uint64_t t_free_rx;             //the same for the S2MM stream
+        uint64_t bd_count;              //BDs processed, for error injection
+        uint32_t *regs;
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+        pthread_t thread;
+        int stop;
+        unsigned int gen;               //bumped by every reset
+        struct sim_chan ch[2 * SIM_NUM_CHANNELS];
+};
+
+struct mcdma_sim {
+        struct mcdma_platform plat;
+        pthread_mutex_t lock;
+        struct sim_region region[SIM_MAX_REGIONS];
+        int nregions;                   //append only, published with release
+        struct sim_engine *engine[SIM_MAX_ENGINES];
+        int nengines;
+        struct mcdma_sim_params defaults;       //from MCDMA_SIM, for engines added later
+};
+
+/*********************************************************************/
+/*                     simulated physical memory                     */
+/*********************************************************************/
+static void *sim_xlate(struct mcdma_sim *sim, uint64_t phys, size_t len)
+{
+        int n = __atomic_load_n(&sim->nregions, __ATOMIC_ACQUIRE);
+        int i;
+
+        for (i = 0; i < n; i++) {
+                struct sim_region *r = &sim->region[i];
+
+                if (phys >= r->phys && phys - r->phys + len <= r->size)
+                        return r->mem + (phys - r->phys);
+        }
+        return NULL;
+}
+
+static struct sim_region *sim_region_new(struct mcdma_sim *sim, uint64_t phys, size_t size, void *mem)
+{
+        struct sim_region *r;
+        int i;
+
+        for (i = 0; i < sim->nregions; i++) {
+                r = &sim->region[i];
+                if (phys < r->phys + r->size && r->phys < phys + size)
+                        return NULL;
+        }
+        if (sim->nregions == SIM_MAX_REGIONS)
+                return NULL;
+
+        r = &sim->region[sim->nregions];
+        r->external = !!mem;
+        r->mem = mem ? mem : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (r->mem == MAP_FAILED)
+                return NULL;
+        r->phys = phys;
+        r->size = size;
+        __atomic_store_n(&sim->nregions, sim->nregions + 1, __ATOMIC_RELEASE);
+        return r;
+}
+
+int mcdma_sim_add_mem(struct mcdma_platform *plat, uint64_t phys, size_t size)
+{
+        struct mcdma_sim *sim = (struct mcdma_sim *)plat;
+        struct sim_region *r;
+
+        pthread_mutex_lock(&sim->lock);
+        r = sim_region_new(sim, phys, size, NULL);
+        pthread_mutex_unlock(&sim->lock);
+        return r ? 0 : -EEXIST;
+}
+
+// make memory the caller owns (e.g. a memfd region) visible to the engines at phys
+int mcdma_sim_attach_mem(struct mcdma_platform *plat, uint64_t phys, void *mem, size_t size)
+{
+        struct mcdma_sim *sim = (struct mcdma_sim *)plat;
+        struct sim_region *r;
+
+        pthread_mutex_lock(&sim->lock);
+        r = sim_region_new(sim, phys, size, mem);
+        pthread_mutex_unlock(&sim->lock);
+        return r ? 0 : -EEXIST;
+}
+
+/*********************************************************************/
+/*                       register file model                         */
+/*********************************************************************/
+static inline uint32_t reg_get(struct sim_engine *e, uint32_t off)
+{
+        return __atomic_load_n(&e->regs[off >> 2], __ATOMIC_ACQUIRE);
+}
+
+static inline void reg_set(struct sim_engine *e, uint32_t off, uint32_t val)
+{
+        __atomic_store_n(&e->regs[off >> 2], val, __ATOMIC_RELEASE);
+}
+
+// channels of the engine including its S2MM ones
+static inline unsigned int sim_nchan(const struct sim_engine *e)
+{
+        return e->l->has_s2mm ? SIM_RX(e->l->nchan) : e->l->nchan;
+}
+
+// offset of the common registers of channel n's direction
+static inline uint32_t ch_common(unsigned int n)
+{
+        return n >= SIM_NUM_CHANNELS ? S2MM_OFFSET : 0;
+}
+
+static inline uint32_t ch_reg(struct sim_engine *e, unsigned int n, uint32_t reg)
+{
+        return ch_common(n) + e->l->ch_base + (n % SIM_NUM_CHANNELS) * e->l->ch_stride + reg;
+}
+
+static inline void ch_set_bits(struct sim_engine *e, unsigned int n, uint32_t reg, uint32_t set, uint32_t clr)
+{
+        uint32_t off = ch_reg(e, n, reg);
+
+        reg_set(e, off, (reg_get(e, off) & ~clr) | set);
+}
+
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_until_ns(uint64_t t)
+{
+        uint64_t now = now_ns();
+        struct timespec ts;
+
+        // sleep overshoots, wake early and spin the rest
+        if (t > now + SIM_SPIN_NS) {
+                ts.tv_sec = (t - SIM_SPIN_NS) / 1000000000ull;
+                ts.tv_nsec = (t - SIM_SPIN_NS) % 1000000000ull;
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+        while (now_ns() < t)
+                ;
+}
+
+static void engine_reset(struct sim_engine *e)
+{
+        unsigned int n;
+
+        memset(e->regs, 0, MCDMA_REG_SPACE);
+        if (e->type == MCDMA_SIM_MCDMA) {
+                reg_set(e, MM2S_DMASR, MM2S_DMASR_HALTED | MM2S_DMASR_IDLE);
+                reg_set(e, S2MM_DMASR, MM2S_DMASR_HALTED | MM2S_DMASR_IDLE);
+        }
+        for (n = 0; n < sim_nchan(e); n++) {
+                int fd = e->ch[n].irq_fd;
+
+                memset(&e->ch[n], 0, sizeof(e->ch[n]));
+                e->ch[n].irq_fd = fd;
+                reg_set(e, ch_reg(e, n, MCDMA_CH_SR), e->l->sr_reset);
+        }
+        e->gen++;
+}
+
+// set status bits of channel n and pulse its interrupt if they are enabled in CR
+static void engine_raise(struct sim_engine *e, unsigned int n, uint32_t bits)
+{
+        uint32_t cr = reg_get(e, ch_reg(e, n, MCDMA_CH_CR));
+        uint64_t one = 1;
+
+        ch_set_bits(e, n, MCDMA_CH_SR, bits, 0);
+        if (bits & e->l->irq_err_other)
+                bits |= e->l->irq_err;
+        // the enable bits sit at the same positions as the status bits
+        if ((cr & bits & (e->l->irq_ioc | e->l->irq_dly | e->l->irq_err)) && e->ch[n].irq_fd >= 0) {
+                if (write(e->ch[n].irq_fd, &one, sizeof(one)) < 0)
+                        perror("sim irq");
+        }
+}
+
+// err is in MM2S_ERR encoding, the AXI DMA keeps the same bits four higher in DMASR and halts
+static void engine_error(struct sim_engine *e, unsigned int n, uint32_t err)
+{
+        uint32_t common = ch_common(n);
+        unsigned int i, first = n - n % SIM_NUM_CHANNELS;
+
+        e->ch[n].halted = 1;
+        if (e->type == MCDMA_SIM_AXIDMA) {
+                ch_set_bits(e, n, MCDMA_CH_SR, (err << 4) | AXIDMA_SR_HALTED, 0);
+                engine_raise(e, n, e->l->irq_err);
+                return;
+        }
+
+        reg_set(e, common + MM2S_ERR, reg_get(e, common + MM2S_ERR) | err);
+        engine_raise(e, n, e->l->irq_err);
+        for (i = 0; i < e->l->nchan; i++) {
+                if (first + i != n && (reg_get(e, common + MM2S_CHEN_OFFSET) & BIT(i)))
+                        engine_raise(e, first + i, e->l->irq_err_other);
+        }
+}
+
+static void engine_chan_write(struct sim_engine *e, unsigned int n, uint32_t reg, uint32_t val)
+{
+        struct sim_chan *c = &e->ch[n];
+        uint32_t off = ch_reg(e, n, reg);
+        uint32_t old = reg_get(e, off);
+
+        switch (reg) {
+        case MCDMA_CH_CR:
+                // MCDMA Fetch and AXI DMA RS are both bit 0
+                reg_set(e, off, val);
+                if ((val & MCDMA_CHCR_FETCH) && !(old & MCDMA_CHCR_FETCH)) {
+                        c->next = reg_get(e, ch_reg(e, n, MCDMA_CH_CURDESC)) |
+                                  (uint64_t)reg_get(e, ch_reg(e, n, MCDMA_CH_CURDESC_MSB)) << 32;
+                        c->halted = 0;
+                        c->doorbell = 0;        //fetching resumes at the next TAILDESC write
+                        c->sink_valid = 0;
+                        c->irq_count = 0;
+                        c->dly_t = 0;
+                        c->rx_t0 = now_ns();
+                        c->rx_done = c->rx_dropped = c->rx_stalls = c->rx_stall_ns = 0;
+                        c->rx_stalled = 0;
+                        c->rx_off = 0;
+                }
+                if (e->type == MCDMA_SIM_AXIDMA) {
+                        if (val & AXIDMA_CR_RUNSTOP)
+                                ch_set_bits(e, n, MCDMA_CH_SR, 0, AXIDMA_SR_HALTED);
+                        else
+                                ch_set_bits(e, n, MCDMA_CH_SR, AXIDMA_SR_HALTED, 0);
+                }
+                break;
+        case MCDMA_CH_SR:
+                reg_set(e, off, old & ~(val & (e->l->irq_ioc | e->l->irq_dly | e->l->irq_err | e->l->irq_err_other)));
+                break;
+        case MCDMA_CH_CURDESC:
+        case MCDMA_CH_CURDESC_MSB:
+                // read only once the channel is fetching
+                if (!(reg_get(e, ch_reg(e, n, MCDMA_CH_CR)) & MCDMA_CHCR_FETCH))
+                        reg_set(e, off, val);
+                break;
+        case MCDMA_CH_TAILDESC:
+                reg_set(e, off, val);
+                c->tail = val | (uint64_t)reg_get(e, ch_reg(e, n, MCDMA_CH_TAILDESC_MSB)) << 32;
+                c->doorbell = 1;
+                ch_set_bits(e, n, MCDMA_CH_SR, 0, e->l->sr_idle);
+                break;
+        case MCDMA_CH_PKTCNT_STAT:
+                if (!e->l->has_pktcnt)
+                        reg_set(e, off, val);
+                break;
+        default:
+                reg_set(e, off, val);
+                break;
+        }
+}
+
+// the S2MM half decodes exactly like the MM2S one, S2MM_OFFSET higher; a soft reset of either resets both
+static void mcdma_reg_write(struct sim_engine *e, uint32_t off, uint32_t val)
+{
+        uint32_t common = off >= S2MM_OFFSET ? S2MM_OFFSET : 0, rel = off - common;
+        unsigned int first = common ? SIM_RX(0) : 0;
+
+        if (rel == MM2S_DMACR) {
+                if (val & MM2S_DMACR_RESET) {
+                        engine_reset(e);
+                } else {
+                        reg_set(e, off, val);
+                        if (val & MM2S_DMACR_RUNSTOP)
+                                reg_set(e, common + MM2S_DMASR, reg_get(e, common + MM2S_DMASR) & ~MM2S_DMASR_HALTED);
+                        else
+                                reg_set(e, common + MM2S_DMASR, reg_get(e, common + MM2S_DMASR) | MM2S_DMASR_HALTED);
+                }
+        } else if (rel >= MM2S_CH_BASE(1) && rel < MM2S_CH_BASE(1) + SIM_NUM_CHANNELS * SIM_CH_STRIDE) {
+                engine_chan_write(e, first + (rel - MM2S_CH_BASE(1)) / SIM_CH_STRIDE,
+                                  (rel - MM2S_CH_BASE(1)) % SIM_CH_STRIDE, val);
+        } else if (rel != MM2S_DMASR && rel != MM2S_ERR) {
+                reg_set(e, off, val);
+        }
+}
+
+static void axidma_reg_write(struct sim_engine *e, uint32_t off, uint32_t val)
+{
+        if (off == AXIDMA_MM2S_DMACR && (val & AXIDMA_CR_RESET))
+                engine_reset(e);
+        else if (off <= AXIDMA_MM2S_TAILDESC_MSB)
+                engine_chan_write(e, 0, off, val);
+        else
+                reg_set(e, off, val);
+}
+
+static void engine_reg_write(void *ctx, uint32_t off, uint32_t val)
+{
+        struct sim_engine *e = ctx;
+
+        pthread_mutex_lock(&e->lock);
+        if (e->type == MCDMA_SIM_AXIDMA)
+                axidma_reg_write(e, off, val);
+        else
+                mcdma_reg_write(e, off, val);
+        pthread_cond_signal(&e->cond);
+        pthread_mutex_unlock(&e->lock);
+}
+
+/*********************************************************************/
+/*                       BD processing thread                        */
+/*********************************************************************/
+// fetching, not halted, engine direction running and channel enabled
+static int chan_enabled(struct sim_engine *e, unsigned int n)
+{
+        uint32_t common = ch_common(n);
+
+        if (e->ch[n].halted || !(reg_get(e, ch_reg(e, n, MCDMA_CH_CR)) & MCDMA_CHCR_FETCH))
+                return 0;
+        return e->type == MCDMA_SIM_AXIDMA ||
+               ((reg_get(e, common + MM2S_DMACR) & MM2S_DMACR_RUNSTOP) &&
+                (reg_get(e, common + MM2S_CHEN_OFFSET) & BIT(n % SIM_NUM_CHANNELS)));
+}
+
+static int chan_runnable(struct sim_engine *e, unsigned int n)
+{
+        return e->ch[n].doorbell && chan_enabled(e, n);
+}
+
+// hold the stream for the injected per-BD latency and the bandwidth cap
+static void engine_throttle(struct sim_engine *e, uint64_t *t_free, uint32_t len)
+{
+        uint64_t cost = e->params.bd_latency_ns, now;
+
+        if (e->params.bandwidth_mbps)
+                cost += (uint64_t)len * 1000 / e->params.bandwidth_mbps;
+        if (!cost)
+                return;
+
+        now = now_ns();
+        if (*t_free < now)
+                *t_free = now;
+        *t_free += cost;
+        sleep_until_ns(*t_free);
+}
+
+static int inject_error(struct sim_engine *e, unsigned int n)
+{
+        const struct mcdma_sim_params *p = &e->params;
+
+        if (!p->error_every || (p->error_chan && p->error_chan != n + 1))
+                return 0;
+        return !(++e->bd_count % p->error_every);
+}
+
+static uint32_t sts_to_err(uint32_t sts)
+{
+        if (sts & MCDMA_BD_STS_DECERR)
+                return MCDMA_ERR_DMA_DEC;
+        if (sts & MCDMA_BD_STS_SLVERR)
+                return MCDMA_ERR_DMA_SLV;
+        return MCDMA_ERR_DMA_INT;
+}
+
+// both engines walk a struct mcdma_bd, only the control word moves
+_Static_assert(offsetof(struct axidma_bd, next) == offsetof(struct mcdma_bd, next) &&
+               offsetof(struct axidma_bd, buf) == offsetof(struct mcdma_bd, buf) &&
+               offsetof(struct axidma_bd, status) == offsetof(struct mcdma_bd, status) &&
+               offsetof(struct axidma_bd, app) == offsetof(struct mcdma_bd, app),
+               "AXI DMA and MCDMA BDs differ outside the control word");
+
+/*********************************************************************/
+/*   a BD of channel n completed: IOC once IRQThreshold BDs are      */
+/*   pending, otherwise (re)start the IRQDelay timer, then move on   */
+/*   to next and go idle at the tail                                 */
+/*********************************************************************/
+static void engine_advance(struct sim_engine *e, unsigned int n, uint64_t bdp, uint64_t next)
+{
+        struct sim_chan *c = &e->ch[n];
+        uint32_t cr = reg_get(e, ch_reg(e, n, MCDMA_CH_CR));
+        uint32_t thresh = (cr & MCDMA_CHCR_IRQTHRESH_MASK) >> MCDMA_CHCR_IRQTHRESH_SHIFT;
+        uint32_t delay = (cr & MCDMA_CHCR_IRQDELAY_MASK) >> MCDMA_CHCR_IRQDELAY_SHIFT;
+
+        if (++c->irq_count >= (thresh ? thresh : 1)) {
+                c->irq_count = 0;
+                c->dly_t = 0;
+                engine_raise(e, n, e->l->irq_ioc);
+        } else if (delay) {
+                c->dly_t = now_ns() + (uint64_t)delay * MCDMA_CHCR_IRQDELAY_UNIT_NS;
+        }
+
+        c->next = next;
+        if (bdp == c->tail) {
+                c->doorbell = 0;
+                ch_set_bits(e, n, MCDMA_CH_SR, e->l->sr_idle, 0);
+        }
+}
+
+// process one BD of channel n, called and returns with e->lock held
+static void engine_process_bd(struct sim_engine *e, unsigned int n)
+{
+        const struct sim_layout *l = e->l;
+        struct mcdma_sim *sim = e->sim;
+        struct sim_chan *c = &e->ch[n];
+        uint64_t bdp = c->next, buf;
+        unsigned int gen = e->gen;
+        uint32_t ctrl, len;
+        volatile struct mcdma_bd *bd;
+        uint8_t *src, *dst = NULL;
+
+        bd = (bdp & (MCDMA_BD_SIZE - 1)) ? NULL : sim_xlate(sim, bdp, MCDMA_BD_SIZE);
+        if (!bd) {
+                engine_error(e, n, MCDMA_ERR_SG_DEC);
+                return;
+        }
+        reg_set(e, ch_reg(e, n, MCDMA_CH_CURDESC), (uint32_t)bdp);
+        reg_set(e, ch_reg(e, n, MCDMA_CH_CURDESC_MSB), (uint32_t)(bdp >> 32));
+
+        if (bd->status & MCDMA_BD_STS_CMPLT) {
+                engine_error(e, n, MCDMA_ERR_SG_INT);
+                return;
+        }
+        ctrl = *(volatile uint32_t *)((volatile uint8_t *)bd + l->bd_ctrl);
+        len = ctrl & MCDMA_BD_LEN_MASK;
+        buf = bd->buf | (uint64_t)bd->buf_msb << 32;
+        src = sim_xlate(sim, buf, len);
+        if (!src || !len) {
+                bd->status = src ? MCDMA_BD_STS_INTERR : MCDMA_BD_STS_DECERR;
+                engine_error(e, n, src ? MCDMA_ERR_DMA_INT : MCDMA_ERR_DMA_DEC);
+                return;
+        }
+        if (inject_error(e, n)) {
+                uint32_t sts = e->params.error_status ? e->params.error_status : MCDMA_BD_STS_SLVERR;
+
+                bd->status = sts;
+                engine_error(e, n, sts_to_err(sts));
+                return;
+        }
+
+        if (ctrl & l->bd_sof) {
+                c->sink_valid = !!(bd->app[0] & DM_CMD_TYPE_INCR);
+                c->sink = bd->app[1] | (uint64_t)bd->app[2] << 32;
+        }
+        if (c->sink_valid)
+                dst = sim_xlate(sim, c->sink, len);
+
+        pthread_mutex_unlock(&e->lock);
+        if (dst)
+                memcpy(dst, src, len);
+        engine_throttle(e, &e->t_free, len);
+        pthread_mutex_lock(&e->lock);
+        if (gen != e->gen)
+                return;
+
+        __atomic_store_n(&bd->status, MCDMA_BD_STS_CMPLT | len, __ATOMIC_RELEASE);
+        c->sink += len;
+        if (ctrl & l->bd_eof) {
+                c->sink_valid = 0;
+                if (l->has_pktcnt)
+                        reg_set(e, ch_reg(e, n, MCDMA_CH_PKTCNT_STAT), reg_get(e, ch_reg(e, n, MCDMA_CH_PKTCNT_STAT)) + 1);
+        }
+
+        engine_advance(e, n, bdp, bd->next | (uint64_t)bd->next_msb << 32);
+}
+
+/*********************************************************************/
+/*   S2MM stream source: rx_count packets of rx_len bytes per        */
+/*   channel, arriving every 1/rx_pps s from the Fetch edge on (back */
+/*   to back if rx_pps is 0).  Without an armed BD the stream is     */
+/*   held, which the upstream FIFO absorbs up to rx_fifo packets,    */
+/*   later arrivals are dropped.  rx_fifo 0 holds the stream         */
+/*   indefinitely, nothing is ever lost.                             */
+/*********************************************************************/
+static uint64_t rx_arrived(struct sim_engine *e, struct sim_chan *c, uint64_t now)
+{
+        const struct mcdma_sim_params *p = &e->params;
+        uint64_t n = p->rx_count ? p->rx_count : UINT64_MAX;
+
+        if (p->rx_pps && now >= c->rx_t0) {
+                uint64_t due = (now - c->rx_t0) * p->rx_pps / 1000000000ull + 1;
+
+                if (due < n)
+                        n = due;
+        } else if (p->rx_pps) {
+                n = 0;
+        }
+        return n;
+}
+
+/*********************************************************************/
+/*   packets waiting at the stream interface of channel n, counting  */
+/*   the drops since the last look.  Only a stall (no armed BD) can  */
+/*   overflow the FIFO, a backlog the model thread built up by being */
+/*   scheduled late is the real engine streaming on and is caught up */
+/*   so the FIFO only holds what arrived after the stall began.      */
+/*********************************************************************/
+static uint64_t rx_backlog(struct sim_engine *e, unsigned int n, uint64_t now)
+{
+        struct sim_chan *c = &e->ch[n];
+        uint64_t arrived, backlog;
+
+        if (!e->params.rx_len)
+                return 0;
+        arrived = rx_arrived(e, c, now);
+        backlog = arrived - c->rx_done - c->rx_dropped;
+        if (c->rx_stalled && e->params.rx_pps && e->params.rx_fifo &&
+            arrived - c->rx_stall_arr > e->params.rx_fifo) {
+                uint64_t over = arrived - c->rx_stall_arr - e->params.rx_fifo;
+
+                c->rx_dropped += over;
+                c->rx_stall_arr += over;
+                backlog -= over;
+        }
+        return backlog;
+}
+
+// when the next packet of channel n arrives, 0 if never
+static uint64_t rx_next_arrival(struct sim_engine *e, unsigned int n)
+{
+        const struct mcdma_sim_params *p = &e->params;
+        struct sim_chan *c = &e->ch[n];
+        uint64_t k = c->rx_done + c->rx_dropped;
+
+        if (!p->rx_len || !p->rx_pps || (p->rx_count && k >= p->rx_count))
+                return 0;
+        return c->rx_t0 + k * 1000000000ull / p->rx_pps;
+}
+
+/*********************************************************************/
+/*   write the next piece of the current packet into the BD of S2MM  */
+/*   channel n: the sequence number (dropped packets use theirs up)  */
+/*   leads the packet, every other byte is its low byte.  RXSOF,     */
+/*   RXEOF and the length go to the status word, TID/TDEST the      */
+/*   channel, TUSER the sequence number, on the EOF BD APP0 the      */
+/*   sequence number and APP4 the packet length like an AXI DMA      */
+/*   status stream.  Lock held.                                      */
+/*********************************************************************/
+static void engine_process_rx_bd(struct sim_engine *e, unsigned int n)
+{
+        struct sim_chan *c = &e->ch[n];
+        uint64_t bdp = c->next, buf, seq;
+        uint32_t pkt = e->params.rx_len, len, sts;
+        unsigned int gen = e->gen, id = n - SIM_RX(0);
+        volatile struct mcdma_s2mm_bd *bd;
+        uint8_t *dst;
+
+        bd = (bdp & (MCDMA_BD_SIZE - 1)) ? NULL : sim_xlate(e->sim, bdp, MCDMA_BD_SIZE);
+        if (!bd) {
+                engine_error(e, n, MCDMA_ERR_SG_DEC);
+                return;
+        }
+        reg_set(e, ch_reg(e, n, MCDMA_CH_CURDESC), (uint32_t)bdp);
+        reg_set(e, ch_reg(e, n, MCDMA_CH_CURDESC_MSB), (uint32_t)(bdp >> 32));
+
+        if (bd->status & MCDMA_BD_STS_CMPLT) {
+                engine_error(e, n, MCDMA_ERR_SG_INT);
+                return;
+        }
+        len = bd->ctrl & MCDMA_BD_LEN_MASK;
+        if (len > pkt - c->rx_off)
+                len = pkt - c->rx_off;
+        buf = bd->buf | (uint64_t)bd->buf_msb << 32;
+        dst = sim_xlate(e->sim, buf, len);
+        if (!dst || !len) {
+                bd->status = dst ? MCDMA_BD_STS_INTERR : MCDMA_BD_STS_DECERR;
+                engine_error(e, n, dst ? MCDMA_ERR_DMA_INT : MCDMA_ERR_DMA_DEC);
+                return;
+        }
+
+        if (!c->rx_off)
+                c->rx_seq = c->rx_done + c->rx_dropped;
+        seq = c->rx_seq;
+
+        pthread_mutex_unlock(&e->lock);
+        if (!c->rx_off && len >= sizeof(seq)) {
+                memcpy(dst, &seq, sizeof(seq));
+                memset(dst + sizeof(seq), (uint8_t)seq, len - sizeof(seq));
+        } else {
+                memset(dst, (uint8_t)seq, len);
+        }
+        engine_throttle(e, &e->t_free_rx, len);
+        pthread_mutex_lock(&e->lock);
+        if (gen != e->gen)
+                return;
+
+        sts = MCDMA_BD_STS_CMPLT | len;
+        if (!c->rx_off)
+                sts |= MCDMA_BD_STS_RXSOF;
+        c->rx_off += len;
+        if (c->rx_off == pkt) {
+                sts |= MCDMA_BD_STS_RXEOF;
+                bd->app[0] = (uint32_t)seq;
+                bd->app[4] = pkt;
+                c->rx_off = 0;
+                c->rx_done++;
+                reg_set(e, ch_reg(e, n, MCDMA_CH_PKTCNT_STAT), reg_get(e, ch_reg(e, n, MCDMA_CH_PKTCNT_STAT)) + 1);
+        }
+        bd->sideband = MCDMA_BD_SB(id, id, seq);
+        __atomic_store_n(&bd->status, sts, __ATOMIC_RELEASE);
+        engine_advance(e, n, bdp, bd->next | (uint64_t)bd->next_msb << 32);
+}
+
+// one step of S2MM channel n: a BD if a packet and a BD are there, else note the stall or the next arrival
+static int engine_rx_step(struct sim_engine *e, unsigned int n, uint64_t now, uint64_t *wake)
+{
+        struct sim_chan *c = &e->ch[n];
+        uint64_t t;
+
+        if (!chan_enabled(e, n))
+                return 0;
+        if (!rx_backlog(e, n, now)) {
+                t = rx_next_arrival(e, n);
+                if (t && (!*wake || t < *wake))
+                        *wake = t;
+                return 0;
+        }
+        if (!c->doorbell) {
+                if (!c->rx_stalled) {
+                        c->rx_stalled = 1;
+                        c->rx_stalls++;
+                        c->rx_stall_t = now;
+                        c->rx_stall_arr = rx_arrived(e, c, now);
+                }
+                return 0;
+        }
+        if (c->rx_stalled) {
+                c->rx_stalled = 0;
+                c->rx_stall_ns += now - c->rx_stall_t;
+        }
+        engine_process_rx_bd(e, n);
+        return 1;
+}
+
+static void *engine_thread(void *arg)
+{
+        struct sim_engine *e = arg;
+        unsigned int rr = 0, i, nchan = sim_nchan(e);
+
+        pthread_mutex_lock(&e->lock);
+        while (!e->stop) {
+                uint64_t now = now_ns(), wake = 0;
+                int busy = 0;
+
+                // expired delay timers flush what is pending below the threshold
+                for (i = 0; i < nchan; i++) {
+                        struct sim_chan *c = &e->ch[i];
+
+                        if (c->dly_t && now >= c->dly_t) {
+                                c->dly_t = 0;
+                                c->irq_count = 0;
+                                engine_raise(e, i, e->l->irq_dly);
+                        } else if (c->dly_t && (!wake || c->dly_t < wake)) {
+                                wake = c->dly_t;
+                        }
+                }
+
+                // round robin, one BD per channel per pass
+                for (i = 0; i < nchan; i++) {
+                        unsigned int n = (rr + i) % nchan;
+
+                        if (n >= SIM_NUM_CHANNELS) {
+                                busy |= engine_rx_step(e, n, now, &wake);
+                        } else if (chan_runnable(e, n)) {
+                                engine_process_bd(e, n);
+                                busy = 1;
+                        }
+                }
+                rr = (rr + 1) % nchan;
+                if (!busy && wake) {
+                        struct timespec ts = { .tv_sec = wake / 1000000000ull, .tv_nsec = wake % 1000000000ull };
+
+                        pthread_cond_timedwait(&e->cond, &e->lock, &ts);
+                } else if (!busy) {
+                        pthread_cond_wait(&e->cond, &e->lock);
+                }
+        }
+        pthread_mutex_unlock(&e->lock);
+        return NULL;
+}
+
+int mcdma_sim_add_engine(struct mcdma_platform *plat, uint64_t phys, enum mcdma_sim_engine type)
+{
+        struct mcdma_sim *sim = (struct mcdma_sim *)plat;
+        struct sim_engine *e;
+        pthread_condattr_t attr;
+        int i;
+
+        if (sim->nengines == SIM_MAX_ENGINES)
+                return -ENOSPC;
+        e = calloc(1, sizeof(*e));
+        if (!e)
+                return -ENOMEM;
+        e->regs = aligned_alloc(4096, MCDMA_REG_SPACE);
+        if (!e->regs) {
+                free(e);
+                return -ENOMEM;
+        }
+        e->sim = sim;
+        e->phys = phys;
+        e->type = type;
+        e->l = &sim_layouts[type];
+        e->params = sim->defaults;
+        for (i = 0; i < 2 * SIM_NUM_CHANNELS; i++)
+                e->ch[i].irq_fd = -1;
+        pthread_mutex_init(&e->lock, NULL);
+        // timed waits for the S2MM source are on the model's clock
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&e->cond, &attr);
+        pthread_condattr_destroy(&attr);
+        engine_reset(e);
+        if (pthread_create(&e->thread, NULL, engine_thread, e)) {
+                free(e->regs);
+                free(e);
+                return -EAGAIN;
+        }
+        sim->engine[sim->nengines++] = e;
+        return 0;
+}
+
+/*********************************************************************/
+/*                        platform callbacks                         */
+/*********************************************************************/
+static struct sim_engine *sim_engine_at(struct mcdma_sim *sim, uint64_t phys)
+{
+        int i;
+
+        for (i = 0; i < sim->nengines; i++) {
+                if (sim->engine[i]->phys == phys)
+                        return sim->engine[i];
+        }
+        return NULL;
+}
+
+// eventfd pulsed on every enabled interrupt of channel chan (1..16, MCDMA_SIM_S2MM(1..16))
+int mcdma_sim_irq_fd(struct mcdma_platform *plat, uint64_t phys, unsigned int chan)
+{
+        struct sim_engine *e = sim_engine_at((struct mcdma_sim *)plat, phys);
+        int fd;
+
+        if (!e || chan < 1 || chan > sim_nchan(e))
+                return -EINVAL;
+
+        pthread_mutex_lock(&e->lock);
+        fd = e->ch[chan - 1].irq_fd;
+        if (fd < 0) {
+                fd = eventfd(0, EFD_CLOEXEC);
+                e->ch[chan - 1].irq_fd = fd;
+        }
+        pthread_mutex_unlock(&e->lock);
+        return fd < 0 ? -errno : fd;
+}
+
+// phys 0 applies to every engine and to engines added later
+int mcdma_sim_set_params(struct mcdma_platform *plat, uint64_t phys, const struct mcdma_sim_params *params)
+{
+        struct mcdma_sim *sim = (struct mcdma_sim *)plat;
+        int i, found = 0;
+
+        if (!phys)
+                sim->defaults = *params;
+        for (i = 0; i < sim->nengines; i++) {
+                struct sim_engine *e = sim->engine[i];
+
+                if (phys && e->phys != phys)
+                        continue;
+                pthread_mutex_lock(&e->lock);
+                e->params = *params;
+                e->bd_count = 0;
+                pthread_mutex_unlock(&e->lock);
+                found = 1;
+        }
+        return found || !phys ? 0 : -ENOENT;
+}
+
+int mcdma_sim_rx_stats(struct mcdma_platform *plat, uint64_t phys, unsigned int chan, struct mcdma_sim_rx_stats *st)
+{
+        struct sim_engine *e = sim_engine_at((struct mcdma_sim *)plat, phys);
+        struct sim_chan *c;
+
+        if (!e || !e->l->has_s2mm || chan < 1 || chan > e->l->nchan)
+                return -EINVAL;
+
+        pthread_mutex_lock(&e->lock);
+        c = &e->ch[SIM_RX(chan - 1)];
+        rx_backlog(e, SIM_RX(chan - 1), now_ns());
+        st->packets = c->rx_done;
+        st->dropped = c->rx_dropped;
+        st->stalls = c->rx_stalls;
+        st->stall_ns = c->rx_stall_ns + (c->rx_stalled ? now_ns() - c->rx_stall_t : 0);
+        pthread_mutex_unlock(&e->lock);
+        return 0;
+}
+
+/*********************************************************************/
+/*   "lat_ns=2000,bw_mbps=400,err_every=1000,err=slv,err_chan=3"     */
+/*   S2MM source: "rx_len=1500,rx_pps=100000,rx_fifo=64,rx_count=0"  */
+/*********************************************************************/
+int mcdma_sim_parse_params(const char *spec, struct mcdma_sim_params *params)
+{
+        char buf[256], *tok, *save = NULL;
+
+        memset(params, 0, sizeof(*params));
+        if (!spec)
+                return 0;
+        snprintf(buf, sizeof(buf), "%s", spec);
+        for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+                char *val = strchr(tok, '=');
+
+                if (!val)
+                        return -EINVAL;
+                *val++ = 0;
+                if (!strcmp(tok, "lat_ns"))
+                        params->bd_latency_ns = strtoul(val, NULL, 0);
+                else if (!strcmp(tok, "bw_mbps"))
+                        params->bandwidth_mbps = strtoul(val, NULL, 0);
+                else if (!strcmp(tok, "err_every"))
+                        params->error_every = strtoul(val, NULL, 0);
+                else if (!strcmp(tok, "err_chan"))
+                        params->error_chan = strtoul(val, NULL, 0);
+                else if (!strcmp(tok, "rx_len"))
+                        params->rx_len = strtoul(val, NULL, 0);
+                else if (!strcmp(tok, "rx_pps"))
+                        params->rx_pps = strtoul(val, NULL, 0);
+                else if (!strcmp(tok, "rx_fifo"))
+                        params->rx_fifo = strtoul(val, NULL, 0);
+                else if (!strcmp(tok, "rx_count"))
+                        params->rx_count = strtoul(val, NULL, 0);
+                else if (!strcmp(tok, "err") && !strcmp(val, "slv"))
+                        params->error_status = MCDMA_BD_STS_SLVERR;
+                else if (!strcmp(tok, "err") && !strcmp(val, "dec"))
+                        params->error_status = MCDMA_BD_STS_DECERR;
+                else if (!strcmp(tok, "err") && !strcmp(val, "int"))
+                        params->error_status = MCDMA_BD_STS_INTERR;
+                else
+                        return -EINVAL;
+        }
+        return 0;
+}
+
+int mcdma_sim_selected(void)
+{
+        const char *backend = getenv("MCDMA_BACKEND");
+
+        return backend && !strcmp(backend, "sim");
+}
+
+static void *sim_map(struct mcdma_platform *plat, uint64_t phys, size_t size)
+{
+        struct mcdma_sim *sim = (struct mcdma_sim *)plat;
+        struct sim_engine *e = sim_engine_at(sim, phys);
+        struct sim_region *r;
+        void *p;
+
+        if (e)
+                return e->regs;
+
+        pthread_mutex_lock(&sim->lock);
+        p = sim_xlate(sim, phys, size);
+        if (!p) {
+                r = sim_region_new(sim, phys, size, NULL);
+                p = r ? r->mem : NULL;
+        }
+        pthread_mutex_unlock(&sim->lock);
+        return p;
+}
+
+// the model's memory is coherent, every mode maps the same pages
+static void *sim_map_mem(struct mcdma_platform *plat, uint64_t phys, size_t size, enum mcdma_cache cache)
+{
+        (void)cache;
+        return sim_map(plat, phys, size);
+}
+
+static void sim_unmap(struct mcdma_platform *plat, void *virt, size_t size)
+{
+        // memory lives as long as the platform, like DDR
+        (void)plat;
+        (void)virt;
+        (void)size;
+}
+
+static void sim_attach(struct mcdma_platform *plat, struct mcdma_dev *dev)
+{
+        struct sim_engine *e = sim_engine_at((struct mcdma_sim *)plat, dev->phys);
+
+        if (e) {
+                dev->reg_hook = engine_reg_write;
+                dev->hook_ctx = e;
+        }
+}
+
+static void sim_close(struct mcdma_platform *plat)
+{
+        struct mcdma_sim *sim = (struct mcdma_sim *)plat;
+        int i, j;
+
+        for (i = 0; i < sim->nengines; i++) {
+                struct sim_engine *e = sim->engine[i];
+
+                pthread_mutex_lock(&e->lock);
+                e->stop = 1;
+                pthread_cond_signal(&e->cond);
+                pthread_mutex_unlock(&e->lock);
+                pthread_join(e->thread, NULL);
+                for (j = 0; j < (int)sim_nchan(e); j++) {
+                        if (e->ch[j].irq_fd >= 0)
+                                close(e->ch[j].irq_fd);
+                }
+                free(e->regs);
+                free(e);
+        }
+        for (i = 0; i < sim->nregions; i++) {
+                if (!sim->region[i].external)
+                        munmap(sim->region[i].mem, sim->region[i].size);
+        }
+        free(sim);
+}
+
+struct mcdma_platform *mcdma_sim_open(void)
+{
+        struct mcdma_sim *sim = calloc(1, sizeof(*sim));
+
+        if (!sim)
+                return NULL;
+        pthread_mutex_init(&sim->lock, NULL);
+        if (mcdma_sim_parse_params(getenv("MCDMA_SIM"), &sim->defaults))
+                fprintf(stderr, "MCDMA_SIM: bad parameters, ignored\n");
+        sim->plat.name = "sim";
+        sim->plat.map = sim_map;
+        sim->plat.map_mem = sim_map_mem;
+        sim->plat.unmap = sim_unmap;
+        sim->plat.attach = sim_attach;
+        sim->plat.close = sim_close;
+        return &sim->plat;
+}
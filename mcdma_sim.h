@@ -0,0 +1,57 @@
+#ifndef MCDMA_SIM_H
+#define MCDMA_SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mcdma.h"
+
+/*********************************************************************/
+/*   software model of the MCDMA register file and DDR, lets the     */
+/*   same driver code run without the FPGA.  Each engine walks its   */
+/*   BD chains in a worker thread and loops the MM2S stream back     */
+/*   through the datamover command in APP0..APP2.  The MCDMA's S2MM  */
+/*   channels are fed by a paced packet source (the rx_* params).    */
+/*   Selected with -s or MCDMA_BACKEND=sim, MCDMA_SIM carries the    */
+/*   default parameters (see mcdma_sim_parse_params).                */
+/*********************************************************************/
+enum mcdma_sim_engine {
+        MCDMA_SIM_MCDMA,                //16 channel AXI MCDMA
+        MCDMA_SIM_AXIDMA,               //single channel AXI DMA, axidma.h
+};
+
+struct mcdma_sim_params {
+        unsigned long bd_latency_ns;    //fixed cost of every BD
+        unsigned long bandwidth_mbps;   //stream cap per engine, 0 unlimited
+        unsigned long error_every;      //fail every Nth BD, 0 never
+        uint32_t error_status;          //BD status error bit to report, default SlvErr
+        unsigned int error_chan;        //only fail BDs of this channel (1-based), 0 any
+        uint32_t rx_len;                //S2MM packet length, 0 no S2MM source
+        unsigned long rx_pps;           //S2MM packets per second per channel, 0 back to back
+        unsigned long rx_fifo;          //packets the source holds while no BD is armed, 0 unbounded
+        unsigned long rx_count;         //S2MM packets per channel and Fetch, 0 unlimited
+};
+
+// S2MM source of one channel since its Fetch bit was set
+struct mcdma_sim_rx_stats {
+        uint64_t packets;               //written to BDs
+        uint64_t dropped;               //lost to a full source FIFO
+        uint64_t stalls;                //times the source found no armed BD
+        uint64_t stall_ns;              //time spent so
+};
+
+// irq line of S2MM channel chan for mcdma_sim_irq_fd
+#define MCDMA_SIM_S2MM(chan)            ((chan) + MCDMA_MAX_CHANNELS)
+
+struct mcdma_platform *mcdma_sim_open(void);
+int mcdma_sim_selected(void);
+
+int mcdma_sim_add_engine(struct mcdma_platform *plat, uint64_t phys, enum mcdma_sim_engine type);
+int mcdma_sim_add_mem(struct mcdma_platform *plat, uint64_t phys, size_t size);
+int mcdma_sim_attach_mem(struct mcdma_platform *plat, uint64_t phys, void *mem, size_t size);
+int mcdma_sim_irq_fd(struct mcdma_platform *plat, uint64_t phys, unsigned int chan);
+int mcdma_sim_set_params(struct mcdma_platform *plat, uint64_t phys, const struct mcdma_sim_params *params);
+int mcdma_sim_parse_params(const char *spec, struct mcdma_sim_params *params);
+int mcdma_sim_rx_stats(struct mcdma_platform *plat, uint64_t phys, unsigned int chan, struct mcdma_sim_rx_stats *st);
+
+#endif
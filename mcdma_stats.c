@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mcdma_stats.h"
+
+static void stats_path(struct mcdma_stats *st, const char *name)
+{
+        snprintf(st->path, sizeof(st->path), "/mcdma-%s", name ? name : MCDMA_STATS_NAME_DEFAULT);
+}
+
+// create (or take over) the page, zeroed, world readable
+int mcdma_stats_create(struct mcdma_stats *st, const char *name)
+{
+        struct mcdma_stats_page *p;
+        int fd, ret = 0;
+
+        memset(st, 0, sizeof(*st));
+        stats_path(st, name);
+        fd = shm_open(st->path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+                return -errno;
+        if (ftruncate(fd, sizeof(*p)) < 0)
+                ret = -errno;
+        p = ret ? MAP_FAILED : mmap(NULL, sizeof(*p), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (!ret && p == MAP_FAILED)
+                ret = -errno;
+        close(fd);
+        if (ret)
+                return ret;
+
+        __atomic_store_n(&p->magic, 0, __ATOMIC_RELAXED);
+        memset(&p->version, 0, sizeof(*p) - offsetof(struct mcdma_stats_page, version));
+        p->version = MCDMA_STATS_VERSION;
+        p->nslots = MCDMA_STATS_MAX_SLOTS;
+        p->pid = getpid();
+        __atomic_store_n(&p->magic, MCDMA_STATS_MAGIC, __ATOMIC_RELEASE);
+        st->page = p;
+        st->writer = 1;
+        return 0;
+}
+
+int mcdma_stats_attach(struct mcdma_stats *st, const char *name)
+{
+        struct mcdma_stats_page *p;
+        struct stat sb;
+        int fd, ret = 0;
+
+        memset(st, 0, sizeof(*st));
+        stats_path(st, name);
+        fd = shm_open(st->path, O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0)
+                return -errno;
+        if (fstat(fd, &sb) < 0)
+                ret = -errno;
+        else if ((size_t)sb.st_size < sizeof(*p))
+                ret = -EPROTO;
+        p = ret ? MAP_FAILED : mmap(NULL, sizeof(*p), PROT_READ, MAP_SHARED, fd, 0);
+        if (!ret && p == MAP_FAILED)
+                ret = -errno;
+        close(fd);
+        if (ret)
+                return ret;
+
+        if (__atomic_load_n(&p->magic, __ATOMIC_ACQUIRE) != MCDMA_STATS_MAGIC || p->version != MCDMA_STATS_VERSION) {
+                munmap(p, sizeof(*p));
+                return -EPROTO;
+        }
+        st->page = p;
+        return 0;
+}
+
+// the page outlives the writer so the last values can still be scraped, unlink it by hand
+void mcdma_stats_close(struct mcdma_stats *st)
+{
+        if (st->page)
+                munmap(st->page, sizeof(*st->page));
+        st->page = NULL;
+}
+
+// the slot of (engine, direction, channel), claimed on first use; setup time only
+struct mcdma_stats_chan *mcdma_stats_slot(struct mcdma_stats *st, const struct mcdma_chan *ch)
+{
+        uint64_t dir = ch->common ? MCDMA_STATS_S2MM : MCDMA_STATS_MM2S;
+        unsigned int i;
+
+        if (!st->writer)
+                return NULL;
+        for (i = 0; i < MCDMA_STATS_MAX_SLOTS; i++) {
+                struct mcdma_stats_chan *s = &st->page->slot[i];
+
+                if (s->engine == ch->dev->phys && s->dir == dir && s->id == ch->id)
+                        return s;
+        }
+        for (i = 0; i < MCDMA_STATS_MAX_SLOTS; i++) {
+                struct mcdma_stats_chan *s = &st->page->slot[i];
+
+                if (!s->engine) {
+                        __atomic_store_n(&s->id, ch->id, __ATOMIC_RELAXED);
+                        __atomic_store_n(&s->dir, dir, __ATOMIC_RELAXED);
+                        __atomic_store_n(&s->engine, ch->dev->phys, __ATOMIC_RELEASE);
+                        return s;
+                }
+        }
+        return NULL;
+}
+
+/*********************************************************************/
+/*   copy the channel's counters and sample its registers.  Three    */
+/*   register reads, so call it on a timer (MCDMA_STATS_PERIOD_NS),  */
+/*   not per completion.                                             */
+/*********************************************************************/
+void mcdma_stats_publish(struct mcdma_stats_chan *s, const struct mcdma_chan *ch, uint64_t now)
+{
+        if (!s)
+                return;
+        __atomic_store_n(&s->packets, ch->packets, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->bytes, ch->bytes, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->errors, ch->errors, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->err_int, ch->err_int, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->err_slv, ch->err_slv, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->err_dec, ch->err_dec, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->inflight, ch->ring.inflight, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->pktcnt, mcdma_chan_read(ch, MCDMA_CH_PKTCNT_STAT), __ATOMIC_RELAXED);
+        __atomic_store_n(&s->chsr, mcdma_chan_read(ch, MCDMA_CH_SR), __ATOMIC_RELAXED);
+        __atomic_store_n(&s->err_reg, mcdma_read(ch->dev, ch->common + MM2S_ERR), __ATOMIC_RELAXED);
+        __atomic_store_n(&s->updated_ns, now, __ATOMIC_RELEASE);
+}
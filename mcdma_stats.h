@@ -0,0 +1,117 @@
+#ifndef MCDMA_STATS_H
+#define MCDMA_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "mcdma.h"
+
+/*********************************************************************/
+/*   per channel telemetry in a POSIX shared memory page             */
+/*   (/dev/shm/mcdma-<name>) that other processes map read only.     */
+/*   Each slot has exactly one writer, the thread that owns the      */
+/*   channel, and every field is a naturally aligned 64 bit word     */
+/*   stored with a relaxed atomic: readers never lock and never see  */
+/*   a torn value, the writer never waits on them.  Counters only    */
+/*   grow; a snapshot across fields can be a publish apart.          */
+/*                                                                   */
+/*   The data path keeps counting in struct mcdma_chan as before,    */
+/*   mcdma_stats_publish() copies those counters and samples the     */
+/*   registers (PKTCNT_STAT, CHx_SR, the ERR register) at most every */
+/*   MCDMA_STATS_PERIOD_NS; completion latencies go straight into    */
+/*   the slot's log2 histogram.                                      */
+/*********************************************************************/
+#define MCDMA_STATS_MAGIC               0x4D434453              //"MCDS"
+#define MCDMA_STATS_VERSION             1
+#define MCDMA_STATS_MAX_SLOTS           64                      //two engines, both directions
+#define MCDMA_STATS_PERIOD_NS           1000000
+#define MCDMA_STATS_NAME_DEFAULT        "mcdma"
+
+// bucket k counts latencies below 2^(k + MCDMA_STATS_LAT_SHIFT) ns, the last one everything above
+#define MCDMA_STATS_LAT_SHIFT           8
+#define MCDMA_STATS_LAT_BUCKETS         24
+
+enum mcdma_stats_dir {
+        MCDMA_STATS_MM2S,
+        MCDMA_STATS_S2MM,
+};
+
+struct mcdma_stats_chan {
+        uint64_t engine;                //register base, 0 for an unused slot
+        uint64_t id;                    //channel 1..16
+        uint64_t dir;                   //enum mcdma_stats_dir
+        uint64_t packets;               //MM2S: EOF BDs, S2MM: RXEOF buffers
+        uint64_t bytes;
+        uint64_t errors;                //BDs completed with an error
+        uint64_t err_int;               //DMAIntErr in BD status
+        uint64_t err_slv;               //DMASlvErr
+        uint64_t err_dec;               //DMADecErr
+        uint64_t pktcnt;                //PKTCNT_STAT as last sampled
+        uint64_t chsr;                  //CHx_SR as last sampled
+        uint64_t err_reg;               //MM2S_ERR / S2MM_ERR as last sampled, SG errors show here
+        uint64_t inflight;              //BDs owned by the engine
+        uint64_t queued;                //packets waiting in software ahead of the BD ring, if the owner knows
+        uint64_t updated_ns;            //CLOCK_MONOTONIC of the last publish
+        uint64_t lat_count;
+        uint64_t lat_sum_ns;
+        uint64_t lat[MCDMA_STATS_LAT_BUCKETS];
+} __attribute__((aligned(64)));
+
+struct mcdma_stats_page {
+        uint32_t magic;                 //written last, readers wait for it
+        uint32_t version;
+        uint32_t nslots;
+        uint32_t pid;
+        struct mcdma_stats_chan slot[MCDMA_STATS_MAX_SLOTS];
+};
+
+struct mcdma_stats {
+        struct mcdma_stats_page *page;
+        char path[64];                  //shm name, for unlink
+        int writer;
+};
+
+int mcdma_stats_create(struct mcdma_stats *st, const char *name);
+int mcdma_stats_attach(struct mcdma_stats *st, const char *name);     //read only
+void mcdma_stats_close(struct mcdma_stats *st);
+
+struct mcdma_stats_chan *mcdma_stats_slot(struct mcdma_stats *st, const struct mcdma_chan *ch);
+void mcdma_stats_publish(struct mcdma_stats_chan *s, const struct mcdma_chan *ch, uint64_t now);
+
+// the page's time base
+static inline uint64_t mcdma_stats_now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// single writer: a plain add published with a relaxed store, no locked instruction
+static inline void mcdma_stats_add(uint64_t *field, uint64_t v)
+{
+        __atomic_store_n(field, __atomic_load_n(field, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t mcdma_stats_get(const uint64_t *field)
+{
+        return __atomic_load_n(field, __ATOMIC_RELAXED);
+}
+
+static inline unsigned int mcdma_stats_lat_bucket(uint64_t ns)
+{
+        uint64_t v = ns >> MCDMA_STATS_LAT_SHIFT;
+        unsigned int b = v ? 64 - __builtin_clzll(v) : 0;
+
+        return b < MCDMA_STATS_LAT_BUCKETS ? b : MCDMA_STATS_LAT_BUCKETS - 1;
+}
+
+static inline void mcdma_stats_latency(struct mcdma_stats_chan *s, uint64_t ns)
+{
+        mcdma_stats_add(&s->lat[mcdma_stats_lat_bucket(ns)], 1);
+        mcdma_stats_add(&s->lat_sum_ns, ns);
+        mcdma_stats_add(&s->lat_count, 1);
+}
+
+#endif
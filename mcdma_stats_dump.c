@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <time.h>
+
+#include "mcdma_stats.h"
+
+/*********************************************************************/
+/*   mcdma_stats_dump: map a process's telemetry page read only and  */
+/*   write it out in the Prometheus text format, once or every -i    */
+/*   ms.  The file is written next to the target and renamed over    */
+/*   it, so a node_exporter textfile collector (or anything else     */
+/*   reading it) only ever sees a complete scrape.  Nothing here     */
+/*   touches the DMA or slows the process being watched.             */
+/*********************************************************************/
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+        (void)sig;
+        stop = 1;
+}
+
+static const char *const dir_name[] = { "mm2s", "s2mm" };
+
+static const struct {
+        uint32_t bit;
+        const char *name;
+} err_bits[] = {
+        { MCDMA_ERR_DMA_INT, "dma_int" },
+        { MCDMA_ERR_DMA_SLV, "dma_slv" },
+        { MCDMA_ERR_DMA_DEC, "dma_dec" },
+        { MCDMA_ERR_SG_INT, "sg_int" },
+        { MCDMA_ERR_SG_SLV, "sg_slv" },
+        { MCDMA_ERR_SG_DEC, "sg_dec" },
+};
+
+// one relaxed load per word, the writer is never held up
+static unsigned int snapshot(const struct mcdma_stats_page *page, struct mcdma_stats_chan *snap)
+{
+        unsigned int i, j, n = 0;
+
+        for (i = 0; i < page->nslots && i < MCDMA_STATS_MAX_SLOTS; i++) {
+                const uint64_t *src = (const uint64_t *)&page->slot[i];
+                uint64_t *dst = (uint64_t *)&snap[n];
+
+                if (!__atomic_load_n(&page->slot[i].engine, __ATOMIC_ACQUIRE))
+                        continue;
+                for (j = 0; j < sizeof(*snap) / sizeof(uint64_t); j++)
+                        dst[j] = mcdma_stats_get(&src[j]);
+                n++;
+        }
+        return n;
+}
+
+static void family(FILE *f, const char *name, const char *type, const char *help)
+{
+        fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static int labels(char *buf, size_t size, const struct mcdma_stats_chan *s)
+{
+        return snprintf(buf, size, "engine=\"0x%llx\",dir=\"%s\",chan=\"%llu\"", (unsigned long long)s->engine,
+                        dir_name[s->dir & 1], (unsigned long long)s->id);
+}
+
+#define FOR_SLOTS(i, n)         for (i = 0; i < n; i++) if (labels(l, sizeof(l), &snap[i]) > 0)
+
+static void write_prometheus(FILE *f, const struct mcdma_stats_page *page, const struct mcdma_stats_chan *snap,
+                             unsigned int n, uint64_t now)
+{
+        char l[128];
+        uint64_t cum;
+        unsigned int i, b, j;
+
+        family(f, "mcdma_packets_total", "counter", "Packets completed (MM2S: EOF BDs, S2MM: RXEOF buffers).");
+        FOR_SLOTS(i, n)
+                fprintf(f, "mcdma_packets_total{%s} %llu\n", l, (unsigned long long)snap[i].packets);
+        family(f, "mcdma_bytes_total", "counter", "Bytes transferred.");
+        FOR_SLOTS(i, n)
+                fprintf(f, "mcdma_bytes_total{%s} %llu\n", l, (unsigned long long)snap[i].bytes);
+        family(f, "mcdma_bd_errors_total", "counter", "BDs completed with an error bit set.");
+        FOR_SLOTS(i, n)
+                fprintf(f, "mcdma_bd_errors_total{%s} %llu\n", l, (unsigned long long)snap[i].errors);
+        family(f, "mcdma_bd_error_bits_total", "counter", "BD status error bits: DMAIntErr, DMASlvErr, DMADecErr.");
+        FOR_SLOTS(i, n) {
+                fprintf(f, "mcdma_bd_error_bits_total{%s,type=\"int\"} %llu\n", l, (unsigned long long)snap[i].err_int);
+                fprintf(f, "mcdma_bd_error_bits_total{%s,type=\"slv\"} %llu\n", l, (unsigned long long)snap[i].err_slv);
+                fprintf(f, "mcdma_bd_error_bits_total{%s,type=\"dec\"} %llu\n", l, (unsigned long long)snap[i].err_dec);
+        }
+        family(f, "mcdma_hw_pktcnt", "gauge", "PKTCNT_STAT of the channel as last sampled.");
+        FOR_SLOTS(i, n)
+                fprintf(f, "mcdma_hw_pktcnt{%s} %llu\n", l, (unsigned long long)snap[i].pktcnt);
+        family(f, "mcdma_inflight_bds", "gauge", "BDs owned by the engine.");
+        FOR_SLOTS(i, n)
+                fprintf(f, "mcdma_inflight_bds{%s} %llu\n", l, (unsigned long long)snap[i].inflight);
+        family(f, "mcdma_queued_packets", "gauge", "Packets waiting in software ahead of the BD ring.");
+        FOR_SLOTS(i, n)
+                fprintf(f, "mcdma_queued_packets{%s} %llu\n", l, (unsigned long long)snap[i].queued);
+        family(f, "mcdma_chan_error", "gauge", "1 while CHx_SR has Err_Irq set.");
+        FOR_SLOTS(i, n)
+                fprintf(f, "mcdma_chan_error{%s} %d\n", l, !!(snap[i].chsr & MCDMA_CHSR_ERR_IRQ));
+
+        // MM2S_ERR / S2MM_ERR belong to the engine's direction, emitted once per pair
+        family(f, "mcdma_engine_error", "gauge", "MM2S_ERR / S2MM_ERR bits, DMA and SG errors.");
+        for (i = 0; i < n; i++) {
+                for (j = 0; j < i && (snap[j].engine != snap[i].engine || snap[j].dir != snap[i].dir); j++)
+                        ;
+                if (j < i)
+                        continue;
+                for (b = 0; b < sizeof(err_bits) / sizeof(err_bits[0]); b++)
+                        fprintf(f, "mcdma_engine_error{engine=\"0x%llx\",dir=\"%s\",bit=\"%s\"} %d\n",
+                                (unsigned long long)snap[i].engine, dir_name[snap[i].dir & 1], err_bits[b].name,
+                                !!(snap[i].err_reg & err_bits[b].bit));
+        }
+
+        family(f, "mcdma_completion_latency_seconds", "histogram", "Doorbell to completion latency.");
+        FOR_SLOTS(i, n) {
+                for (b = 0, cum = 0; b < MCDMA_STATS_LAT_BUCKETS - 1; b++) {
+                        cum += snap[i].lat[b];
+                        fprintf(f, "mcdma_completion_latency_seconds_bucket{%s,le=\"%g\"} %llu\n", l,
+                                (double)(1ull << (b + MCDMA_STATS_LAT_SHIFT)) / 1e9, (unsigned long long)cum);
+                }
+                cum += snap[i].lat[b];
+                fprintf(f, "mcdma_completion_latency_seconds_bucket{%s,le=\"+Inf\"} %llu\n", l, (unsigned long long)cum);
+                fprintf(f, "mcdma_completion_latency_seconds_sum{%s} %.9f\n", l, snap[i].lat_sum_ns / 1e9);
+                fprintf(f, "mcdma_completion_latency_seconds_count{%s} %llu\n", l, (unsigned long long)cum);
+        }
+
+        family(f, "mcdma_stats_age_seconds", "gauge", "Time since the owner last published the channel.");
+        FOR_SLOTS(i, n)
+                fprintf(f, "mcdma_stats_age_seconds{%s} %.6f\n", l,
+                        snap[i].updated_ns && now > snap[i].updated_ns ? (now - snap[i].updated_ns) / 1e9 : 0.0);
+        family(f, "mcdma_stats_writer_pid", "gauge", "Process that owns the telemetry page.");
+        fprintf(f, "mcdma_stats_writer_pid %u\n", page->pid);
+}
+
+static int dump(const struct mcdma_stats *st, const char *out)
+{
+        struct mcdma_stats_chan snap[MCDMA_STATS_MAX_SLOTS];
+        unsigned int n = snapshot(st->page, snap);
+        char tmp[4096];
+        FILE *f;
+
+        if (!strcmp(out, "-")) {
+                write_prometheus(stdout, st->page, snap, n, mcdma_stats_now());
+                return fflush(stdout) ? -errno : 0;
+        }
+        snprintf(tmp, sizeof(tmp), "%s.tmp", out);
+        f = fopen(tmp, "w");
+        if (!f)
+                return -errno;
+        write_prometheus(f, st->page, snap, n, mcdma_stats_now());
+        if (fclose(f) || rename(tmp, out)) {
+                int ret = -errno;
+
+                unlink(tmp);
+                return ret;
+        }
+        return 0;
+}
+
+static void usage(const char *prog)
+{
+        printf("usage: %s [-n name] [-o file|-] [-i interval ms]\n", prog);
+        printf("  -n  page /dev/shm/mcdma-<name> (default %s)\n", MCDMA_STATS_NAME_DEFAULT);
+        printf("  -o  Prometheus text file, replaced atomically (default -, stdout)\n");
+        printf("  -i  rewrite every interval ms until interrupted, 0 (default) writes once\n");
+}
+
+int main(int argc, char **argv)
+{
+        struct mcdma_stats st;
+        const char *name = MCDMA_STATS_NAME_DEFAULT, *out = "-";
+        unsigned long interval = 0;
+        int opt, ret;
+
+        while ((opt = getopt(argc, argv, "n:o:i:h")) != -1) {
+                switch (opt) {
+                case 'n': name = optarg; break;
+                case 'o': out = optarg; break;
+                case 'i': interval = strtoul(optarg, NULL, 0); break;
+                default: usage(argv[0]); return 1;
+                }
+        }
+        ret = mcdma_stats_attach(&st, name);
+        if (ret) {
+                printf("stats page %s: %s\n", name, strerror(-ret));
+                return 1;
+        }
+        signal(SIGINT, on_signal);
+        signal(SIGTERM, on_signal);
+
+        do {
+                struct timespec ts = { .tv_sec = interval / 1000, .tv_nsec = interval % 1000 * 1000000 };
+
+                ret = dump(&st, out);
+                if (ret) {
+                        printf("%s: %s\n", out, strerror(-ret));
+                        break;
+                }
+                if (interval)
+                        nanosleep(&ts, NULL);
+        } while (interval && !stop);
+
+        mcdma_stats_close(&st);
+        return ret ? 1 : 0;
+}
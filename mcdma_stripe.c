@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "mcdma_stripe.h"
+
+int mcdma_stripe_init(struct mcdma_stripe *s, unsigned int nstreams, unsigned int depth, uint32_t chunk)
+{
+        unsigned int k;
+
+        memset(s, 0, sizeof(*s));
+        if (!nstreams || !depth || !chunk || chunk > DM_CMD_BTT_MASK)
+                return -EINVAL;
+        s->st = calloc(nstreams, sizeof(*s->st));
+        if (!s->st)
+                return -ENOMEM;
+        s->nstreams = nstreams;
+        s->depth = depth;
+        s->chunk = chunk;
+        for (k = 0; k < nstreams; k++) {
+                s->st[k].x = calloc(depth, sizeof(*s->st[k].x));
+                if (!s->st[k].x) {
+                        mcdma_stripe_destroy(s);
+                        return -ENOMEM;
+                }
+        }
+        return 0;
+}
+
+void mcdma_stripe_destroy(struct mcdma_stripe *s)
+{
+        unsigned int k;
+
+        for (k = 0; s->st && k < s->nstreams; k++)
+                free(s->st[k].x);
+        free(s->st);
+        s->st = NULL;
+        s->nstreams = 0;
+        s->nlanes = 0;
+}
+
+int mcdma_stripe_add(struct mcdma_stripe *s, struct mcdma_engine *eng, struct mcdma_chan *ch)
+{
+        if (s->nlanes == MCDMA_STRIPE_MAX_LANES)
+                return -ENOSPC;
+        if (s->chunk > ch->ring.max_len)
+                return -EINVAL;
+        s->lane[s->nlanes].eng = eng;
+        s->lane[s->nlanes].ch = ch;
+        s->nlanes++;
+        return 0;
+}
+
+/*********************************************************************/
+/*   the lane with the fewest BDs queued and in flight that still    */
+/*   has room, ties go round robin from s->next so equal engines     */
+/*   take turns instead of lane 0 getting every small transfer       */
+/*********************************************************************/
+static struct mcdma_stripe_lane *pick_lane(struct mcdma_stripe *s)
+{
+        struct mcdma_stripe_lane *best = NULL;
+        unsigned int i, load, best_load = ~0u;
+
+        for (i = 0; i < s->nlanes; i++) {
+                struct mcdma_stripe_lane *l = &s->lane[(s->next + i) % s->nlanes];
+                const struct mcdma_ring *ring = &l->ch->ring;
+
+                load = ring->pending + ring->inflight;
+                if (mcdma_ring_space(ring) && load < best_load) {
+                        best = l;
+                        best_load = load;
+                }
+        }
+        s->next = (s->next + 1) % s->nlanes;
+        return best;
+}
+
+int mcdma_stripe_submit(struct mcdma_stripe *s, unsigned int stream, uint64_t src, uint64_t dst, uint32_t len,
+                        const uint32_t *app, void *cookie)
+{
+        struct mcdma_stripe_stream *st;
+        struct mcdma_stripe_xfer *x;
+        uint32_t words[MCDMA_BD_NUM_APP] = { 0 };
+        unsigned int parts, room = 0, i;
+        uint32_t off, piece;
+        int ret;
+
+        if (stream >= s->nstreams || !len || !s->nlanes)
+                return -EINVAL;
+        st = &s->st[stream];
+        parts = mcdma_stripe_pieces(s, len);
+        for (i = 0; i < s->nlanes; i++)
+                room += mcdma_ring_space(&s->lane[i].ch->ring);
+        if (st->count == s->depth || room < parts)
+                return -EBUSY;
+
+        x = &st->x[(st->head + st->count) % s->depth];
+        x->cookie = cookie;
+        x->parts = parts;
+        x->status = 0;
+        x->len = 0;
+        st->count++;
+        if (app) {
+                words[3] = app[3];
+                words[4] = app[4];
+        }
+
+        for (off = 0; off < len; off += piece) {
+                struct mcdma_stripe_lane *l = pick_lane(s);
+
+                piece = len - off < s->chunk ? len - off : s->chunk;
+                words[0] = DM_CMD_EOF | DM_CMD_TYPE_INCR | piece;
+                words[1] = (uint32_t)(dst + off);
+                words[2] = (uint32_t)((dst + off) >> 32);
+                // room was checked, only a bad length gets here
+                ret = mcdma_engine_queue(l->eng, &l->ch->ring, src + off, piece,
+                                         MCDMA_BD_CTRL_SOF | MCDMA_BD_CTRL_EOF, words, x);
+                if (ret)
+                        return ret;
+        }
+        s->pieces += parts;
+        s->split += parts > 1;
+        return 0;
+}
+
+void mcdma_stripe_kick(struct mcdma_stripe *s)
+{
+        unsigned int i;
+
+        for (i = 0; i < s->nlanes; i++)
+                mcdma_ring_kick(&s->lane[i].ch->ring);
+}
+
+/*********************************************************************/
+/*   reclaim every lane into the transfers the pieces belong to,     */
+/*   then hand out the finished heads of each stream.  A finished    */
+/*   transfer behind an unfinished one of the same stream waits.     */
+/*********************************************************************/
+int mcdma_stripe_reap(struct mcdma_stripe *s, struct mcdma_cpl *cpl, int max)
+{
+        struct mcdma_cpl bd[MCDMA_STRIPE_REAP_BATCH];
+        unsigned int i, k;
+        int j, n, done = 0;
+
+        for (i = 0; i < s->nlanes; i++) {
+                do {
+                        n = mcdma_chan_reclaim(s->lane[i].ch, bd, MCDMA_STRIPE_REAP_BATCH);
+                        for (j = 0; j < n; j++) {
+                                struct mcdma_stripe_xfer *x = bd[j].cookie;
+
+                                x->status |= bd[j].status & MCDMA_BD_STS_ERR_MASK;
+                                x->len += bd[j].len;
+                                x->parts--;
+                        }
+                } while (n == MCDMA_STRIPE_REAP_BATCH);
+        }
+
+        for (k = 0; k < s->nstreams && done < max; k++) {
+                struct mcdma_stripe_stream *st = &s->st[k];
+
+                while (st->count && !st->x[st->head].parts && done < max) {
+                        struct mcdma_stripe_xfer *x = &st->x[st->head];
+
+                        cpl[done].cookie = x->cookie;
+                        cpl[done].status = x->status | MCDMA_BD_STS_CMPLT;
+                        cpl[done].len = x->len;
+                        done++;
+                        st->head = (st->head + 1) % s->depth;
+                        st->count--;
+                }
+        }
+        return done;
+}
+
+int mcdma_stripe_failed(const struct mcdma_stripe *s)
+{
+        unsigned int i;
+
+        for (i = 0; i < s->nlanes; i++) {
+                if (mcdma_engine_failed(s->lane[i].eng, s->lane[i].ch))
+                        return -EIO;
+        }
+        return 0;
+}
@@ -0,0 +1,87 @@
+#ifndef MCDMA_STRIPE_H
+#define MCDMA_STRIPE_H
+
+#include <stdint.h>
+
+#include "mcdma.h"
+#include "mcdma_engine.h"
+
+/*********************************************************************/
+/*   several engine instances driven as one logical MM2S device.     */
+/*   Each lane is one started channel of one engine (DMA0 and DMA1   */
+/*   of the design, or any number of model engines).  A transfer is  */
+/*   cut into chunk sized pieces and every piece goes to the lane    */
+/*   with the fewest BDs queued and in flight, so a large transfer   */
+/*   is spread over all engines and small independent ones fill      */
+/*   whichever engine has drained furthest; a slower engine simply   */
+/*   gets fewer pieces.  Every piece carries its own datamover       */
+/*   command for dst + offset, the order the pieces land in does     */
+/*   not matter.                                                     */
+/*                                                                   */
+/*   Completion semantics are those of a single ring per stream: a   */
+/*   transfer completes once all of its pieces are back, with the    */
+/*   error bits of all of them, and the transfers of one stream      */
+/*   complete in submission order whichever engine finished first.   */
+/*   Streams do not wait for each other.                             */
+/*********************************************************************/
+#define MCDMA_STRIPE_MAX_LANES          8
+#define MCDMA_STRIPE_REAP_BATCH         32
+
+struct mcdma_stripe_lane {
+        struct mcdma_engine *eng;
+        struct mcdma_chan *ch;          //started, bytes/packets/errors count the lane's pieces
+};
+
+// one transfer of a stream, in submission order
+struct mcdma_stripe_xfer {
+        void *cookie;
+        unsigned int parts;             //pieces not yet reclaimed
+        uint32_t status;
+        uint32_t len;
+};
+
+struct mcdma_stripe_stream {
+        struct mcdma_stripe_xfer *x;    //FIFO of depth transfers
+        unsigned int head;              //oldest outstanding
+        unsigned int count;
+};
+
+struct mcdma_stripe {
+        struct mcdma_stripe_lane lane[MCDMA_STRIPE_MAX_LANES];
+        unsigned int nlanes;
+        unsigned int next;              //lane tried first on a tie, rotates
+        uint32_t chunk;                 //largest piece
+        struct mcdma_stripe_stream *st;
+        unsigned int nstreams;
+        unsigned int depth;             //outstanding transfers per stream
+        uint64_t pieces;                //BDs queued
+        uint64_t split;                 //transfers that went out in more than one piece
+};
+
+// chunk: piece size, at most DM_CMD_BTT_MASK and the ring's max_len of every lane
+int mcdma_stripe_init(struct mcdma_stripe *s, unsigned int nstreams, unsigned int depth, uint32_t chunk);
+void mcdma_stripe_destroy(struct mcdma_stripe *s);
+int mcdma_stripe_add(struct mcdma_stripe *s, struct mcdma_engine *eng, struct mcdma_chan *ch);
+
+/*********************************************************************/
+/*   queue len bytes from src to the sink at dst on stream, app[0]   */
+/*   to app[2] of each piece are its datamover command (EOF, INCR,   */
+/*   BTT and the address), app[3] and app[4] are taken from app.     */
+/*   All or nothing: -EBUSY when the lanes or the stream have no     */
+/*   room for every piece.  Nothing is handed over before kick.      */
+/*********************************************************************/
+int mcdma_stripe_submit(struct mcdma_stripe *s, unsigned int stream, uint64_t src, uint64_t dst, uint32_t len,
+                        const uint32_t *app, void *cookie);
+void mcdma_stripe_kick(struct mcdma_stripe *s);
+
+// one completion per finished transfer, streams in order, returns the count
+int mcdma_stripe_reap(struct mcdma_stripe *s, struct mcdma_cpl *cpl, int max);
+// -EIO once any lane's engine reports Err_Irq
+int mcdma_stripe_failed(const struct mcdma_stripe *s);
+
+static inline unsigned int mcdma_stripe_pieces(const struct mcdma_stripe *s, uint32_t len)
+{
+        return (len + s->chunk - 1) / s->chunk;
+}
+
+#endif